@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+
+namespace game
+{
+
+	// subsystems that report allocations
+	enum class MemoryTag : uint8_t
+	{
+		General,
+		UI,
+		Sprites,
+		Lighting,
+		Capture,
+		Streaming,
+		Particles,
+		Collision,
+		Navigation,
+		Count
+	};
+
+	namespace Memory
+	{
+		struct Stats
+		{
+			uint64_t allocations = 0;	// lifetime count
+			uint64_t liveBytes = 0;
+			uint64_t peakBytes = 0;
+			uint64_t frameAllocations = 0;
+			uint64_t frameBytes = 0;
+		};
+
+		// thread safe, counters are atomics.
+		void RecordAllocation(MemoryTag tag, size_t bytes);
+		void RecordFree(MemoryTag tag, size_t bytes);
+
+		// closes the per frame counters, called by FrameArena::BeginFrame.
+		void BeginFrame();
+
+		Stats GetStats(MemoryTag tag);
+		const char* GetTagName(MemoryTag tag);
+	}
+
+
+	// Linear allocator for transient data, double-buffered so data written during
+	// frame N can still be read during frame N+1. Nothing is freed individually,
+	// the whole buffer is reset when it comes back around.
+	// Not thread safe, use it from the main thread.
+	class FrameArena
+	{
+	public:
+		FrameArena() = default;
+		~FrameArena() { Shutdown(); }
+
+		FrameArena(const FrameArena&) = delete;
+		FrameArena& operator=(const FrameArena&) = delete;
+
+		void Initialize(size_t capacityPerFrame);
+		void Shutdown();
+
+		// flips the buffers and resets the one that becomes current.
+		void BeginFrame();
+
+		void* Allocate(size_t size, size_t alignment, MemoryTag tag);
+
+		template<typename T>
+		T* AllocateArray(size_t count, MemoryTag tag)
+		{
+			return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T), tag));
+		}
+
+		size_t GetUsed() const { return m_buffers[m_current].used; }
+		size_t GetCapacity() const { return m_capacity; }
+		size_t GetPeak() const { return m_peak; }
+		size_t GetOverflowBytes() const { return m_buffers[m_current].overflowBytes; }
+
+	private:
+
+		struct Buffer
+		{
+			uint8_t* data = nullptr;
+			size_t used = 0;
+			std::vector<void*> overflow;	// heap fallbacks, released with the buffer
+			size_t overflowBytes = 0;
+			size_t tagBytes[static_cast<size_t>(MemoryTag::Count)] = {};
+		};
+
+		void Reset(Buffer& buffer);
+
+		Buffer m_buffers[2];
+		int m_current = 0;
+		size_t m_capacity = 0;
+		size_t m_peak = 0;
+	};
+
+
+	// std allocator adaptor so standard containers can live in the frame arena.
+	// deallocate is a no-op, the memory goes away with the frame.
+	// Without an arena it falls back to the heap, so code can use frame containers whether or not it was given one.
+	template<typename T>
+	class ArenaAllocator
+	{
+	public:
+		using value_type = T;
+
+		ArenaAllocator(FrameArena* arena, MemoryTag tag) : m_arena(arena), m_tag(tag) {}
+
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena), m_tag(other.m_tag) {}
+
+		T* allocate(size_t n)
+		{
+			if (m_arena)
+				return m_arena->AllocateArray<T>(n, m_tag);
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+		void deallocate(T* p, size_t)
+		{
+			if (!m_arena)
+				::operator delete(p);
+		}
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+	private:
+		template<typename U> friend class ArenaAllocator;
+
+		FrameArena* m_arena;
+		MemoryTag m_tag;
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+
+// Compile time level filter: calls below GAME_LOG_MIN_LEVEL expand to nothing, arguments are not evaluated.
+// 0 trace, 1 info, 2 warning, 3 error, 4 critical
+#ifndef GAME_LOG_MIN_LEVEL
+	#ifdef PRODUCTION_BUILD
+		#define GAME_LOG_MIN_LEVEL 2
+	#else
+		#define GAME_LOG_MIN_LEVEL 0
+	#endif
+#endif
+
+#if GAME_LOG_MIN_LEVEL <= 0
+	#define GAME_LOG_TRACE(...) ::game::Log::Write(::game::LogLevel::Trace, __VA_ARGS__)
+#else
+	#define GAME_LOG_TRACE(...) ((void)0)
+#endif
+
+#if GAME_LOG_MIN_LEVEL <= 1
+	#define GAME_LOG_INFO(...) ::game::Log::Write(::game::LogLevel::Info, __VA_ARGS__)
+#else
+	#define GAME_LOG_INFO(...) ((void)0)
+#endif
+
+#if GAME_LOG_MIN_LEVEL <= 2
+	#define GAME_LOG_WARNING(...) ::game::Log::Write(::game::LogLevel::Warning, __VA_ARGS__)
+#else
+	#define GAME_LOG_WARNING(...) ((void)0)
+#endif
+
+#if GAME_LOG_MIN_LEVEL <= 3
+	#define GAME_LOG_ERROR(...) ::game::Log::Write(::game::LogLevel::Error, __VA_ARGS__)
+#else
+	#define GAME_LOG_ERROR(...) ((void)0)
+#endif
+
+#define GAME_LOG_CRITICAL(...) ::game::Log::Write(::game::LogLevel::Critical, __VA_ARGS__)
+
+
+namespace game
+{
+
+	enum class LogLevel : uint8_t
+	{
+		Trace,
+		Info,
+		Warning,
+		Error,
+		Critical,
+		Count
+	};
+
+	// Asynchronous logger.
+	// Write() copies the message into fixed size slots of a lock-free multi-producer ring and returns,
+	// a background thread drains the ring and writes batches to the console and to rotating log files.
+	// The format is printf-like, arguments are packed by type so std::string can be passed directly.
+	// In binary mode the producer only packs the arguments and the formatting happens on the
+	// background thread, the format string must then outlive the logger (use literals).
+	// When the ring is full messages are dropped and counted, except Critical which waits for a slot.
+	// Before Initialize and after Shutdown messages are written synchronously to the console.
+	namespace Log
+	{
+		struct Settings
+		{
+			std::string directory = "logs";
+			std::string fileName = "game";		// game.log, rotated to game.1.log ... game.<maxFiles>.log
+			size_t maxFileSize = 4 << 20;
+			int maxFiles = 3;
+			bool console = true;
+			bool file = true;
+			bool binary = false;
+			size_t capacity = 4096;				// slots, rounded up to a power of two
+		};
+
+		struct Stats
+		{
+			uint64_t written = 0;
+			uint64_t dropped = 0;
+			uint64_t truncated = 0;
+		};
+
+		void Initialize(const Settings& settings);
+		void Shutdown();
+
+		// blocks until everything written so far reached the sinks.
+		void Flush();
+
+		Stats GetStats();
+		const char* GetLevelName(LogLevel level);
+
+
+		namespace detail
+		{
+			// argument tags of the packed payload
+			enum ArgType : uint8_t
+			{
+				ArgSigned,
+				ArgUnsigned,
+				ArgDouble,
+				ArgPointer,
+				ArgString,
+			};
+
+			struct Packer
+			{
+				char* data;
+				size_t size;
+				size_t used = 0;
+				bool truncated = false;
+
+				void PutRaw(ArgType type, const void* value, size_t bytes)
+				{
+					if (used + 1 + bytes > size)
+					{
+						truncated = true;
+						return;
+					}
+					data[used++] = static_cast<char>(type);
+					std::memcpy(data + used, value, bytes);
+					used += bytes;
+				}
+
+				void PutString(const char* text, size_t length)
+				{
+					if (used + 3 > size)
+					{
+						truncated = true;
+						return;
+					}
+					if (length > size - used - 3)
+					{
+						length = size - used - 3;
+						truncated = true;
+					}
+					uint16_t length16 = static_cast<uint16_t>(length);
+					data[used++] = static_cast<char>(ArgString);
+					std::memcpy(data + used, &length16, 2);
+					std::memcpy(data + used + 2, text, length);
+					used += 2 + length;
+				}
+
+				template<typename T>
+				void Put(const T& value)
+				{
+					using U = std::decay_t<T>;
+					if constexpr (std::is_array_v<T>)
+					{
+						Put(static_cast<const std::remove_extent_t<T>*>(value));
+					}
+					else if constexpr (std::is_same_v<U, std::string> || std::is_same_v<U, std::string_view>)
+					{
+						PutString(value.data(), value.size());
+					}
+					else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>)
+					{
+						if (value)
+							PutString(value, std::strlen(value));
+						else
+							PutString("(null)", 6);
+					}
+					else if constexpr (std::is_enum_v<U>)
+					{
+						int64_t v = static_cast<int64_t>(value);
+						PutRaw(ArgSigned, &v, sizeof(v));
+					}
+					else if constexpr (std::is_floating_point_v<U>)
+					{
+						double v = static_cast<double>(value);
+						PutRaw(ArgDouble, &v, sizeof(v));
+					}
+					else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+					{
+						int64_t v = static_cast<int64_t>(value);
+						PutRaw(ArgSigned, &v, sizeof(v));
+					}
+					else if constexpr (std::is_integral_v<U>)
+					{
+						uint64_t v = static_cast<uint64_t>(value);
+						PutRaw(ArgUnsigned, &v, sizeof(v));
+					}
+					else if constexpr (std::is_pointer_v<U>)
+					{
+						const void* v = static_cast<const void*>(value);
+						PutRaw(ArgPointer, &v, sizeof(v));
+					}
+					else
+					{
+						static_assert(std::is_pointer_v<U>, "unsupported log argument type");
+					}
+				}
+			};
+
+			// longer messages are truncated, a message spans as many ring slots as it needs
+			constexpr size_t s_maxMessageSize = 2048;
+
+			// fmt + packed arguments, see asyncLog.cpp
+			void Submit(LogLevel level, const char* fmt, const char* args, size_t argsSize, bool truncated);
+		}
+
+
+		template<typename... Args>
+		void Write(LogLevel level, const char* fmt, const Args&... args)
+		{
+			char buffer[detail::s_maxMessageSize];
+			detail::Packer packer = { buffer, sizeof(buffer) };
+			(packer.Put(args), ...);
+			detail::Submit(level, fmt, buffer, packer.used, packer.truncated);
+		}
+
+		// message without format, "%" is not interpreted
+		inline void Write(LogLevel level, const std::string& message)
+		{
+			Write(level, "%s", message);
+		}
+	}
+
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "allocators.h"
+#include "spriteBatch.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+namespace game
+{
+
+	// Streaming tilemap backed by an on-disk chunked map file.
+	//
+	// File layout (little endian):
+	//   header       magic "LTMP", version, width, height, chunkSize, layerCount
+	//   chunk index  one {offset, size} per (layer, chunk), chunks in row major order, offset 0 = empty chunk
+	//   tile data    run-length encoded tiles, each run is varint(length) varint(tile)
+	//
+	// Chunks around the camera are decoded on a worker thread (tiles + prebuilt sprite records),
+	// resident chunks that left the range are evicted least recently used first once the memory
+	// budget is exceeded. Tiles equal to s_emptyTile are not drawn, so upper layers can be sparse.
+	// Tile (x, y) covers [origin + (x, y) * tileSize, origin + (x + 1, y + 1) * tileSize].
+	class ChunkedTilemap
+	{
+	public:
+		static constexpr uint32_t s_emptyTile = 0xFFFFFFFF;
+
+		struct Settings
+		{
+			glm::vec2 origin = { 0.f, 0.f };
+			float tileSize = 1.f;
+			int loadMargin = 1;					// chunks loaded around the visible ones
+			size_t memoryBudget = 64 << 20;		// bytes of resident chunk data
+		};
+
+		struct Stats
+		{
+			int residentChunks = 0;
+			int pendingChunks = 0;
+			int loadedChunks = 0;	// lifetime
+			int evictedChunks = 0;	// lifetime
+			size_t residentBytes = 0;
+		};
+
+		ChunkedTilemap() = default;
+		~ChunkedTilemap() { Close(); }
+
+		ChunkedTilemap(const ChunkedTilemap&) = delete;
+		ChunkedTilemap& operator=(const ChunkedTilemap&) = delete;
+
+		// same mapping as TilemapRenderer, must be set before Open.
+		void SetTileSetTexture(LittleEngine::Graphics::Texture& texture, LittleEngine::Graphics::TextureAtlas& atlas);
+		void SetTileSetAtlasKey(const std::vector<LittleEngine::Graphics::AtlasCoord>& key);
+
+		bool Open(const std::string& path, const Settings& settings);
+		void Close();
+		bool IsOpen() const { return m_open; }
+
+		// viewMin / viewMax: visible world rectangle.
+		void Update(glm::vec2 viewMin, glm::vec2 viewMax);
+		void Draw(SpriteBatch& batch, glm::vec2 viewMin, glm::vec2 viewMax);
+
+		// s_emptyTile if the chunk is not resident.
+		uint32_t GetTile(int layer, int x, int y) const;
+
+		glm::ivec2 GetSize() const { return { static_cast<int>(m_width), static_cast<int>(m_height) }; }
+		int GetLayerCount() const { return static_cast<int>(m_layerCount); }
+		Stats GetStats();
+
+		// layers[l] holds width * height tiles, row major, row 0 at the bottom.
+		static bool WriteMapFile(const std::string& path, uint32_t width, uint32_t height, uint32_t chunkSize,
+			const std::vector<std::vector<uint32_t>>& layers);
+
+	private:
+
+		struct IndexEntry
+		{
+			uint64_t offset;
+			uint32_t size;
+			uint32_t padding;
+		};
+
+		struct Chunk
+		{
+			std::vector<uint32_t> tiles;						// layer after layer, chunkSize * chunkSize each
+			std::vector<std::vector<QuadInstance>> instances;	// per layer, empty tiles skipped
+			size_t bytes = 0;
+			uint64_t lastUsed = 0;
+		};
+
+		static uint64_t Key(int cx, int cy) { return (static_cast<uint64_t>(static_cast<uint32_t>(cy)) << 32) | static_cast<uint32_t>(cx); }
+		glm::ivec4 GetChunkRange(glm::vec2 viewMin, glm::vec2 viewMax, int margin) const;
+
+		void WorkerLoop();
+		bool LoadChunk(std::ifstream& file, uint64_t key, Chunk& chunk);
+		void Evict(const glm::ivec4& keepRange);
+
+
+		Settings m_settings;
+		bool m_open = false;
+		std::string m_path;
+
+		uint32_t m_width = 0;
+		uint32_t m_height = 0;
+		uint32_t m_chunkSize = 0;
+		uint32_t m_layerCount = 0;
+		uint32_t m_chunksX = 0;
+		uint32_t m_chunksY = 0;
+		std::vector<IndexEntry> m_index;	// [layer][chunk]
+
+		LittleEngine::Graphics::Texture* m_texture = nullptr;
+		LittleEngine::Graphics::TextureAtlas* m_atlas = nullptr;
+		std::vector<glm::vec4> m_tileUVs;
+
+		// main thread only
+		std::unordered_map<uint64_t, Chunk> m_resident;
+		size_t m_residentBytes = 0;
+		uint64_t m_frame = 0;
+		int m_loaded = 0;
+		int m_evicted = 0;
+
+		// shared with the worker
+		std::thread m_worker;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<uint64_t> m_requests;		// rebuilt every Update, nearest first
+		std::unordered_set<uint64_t> m_inFlight;
+		std::vector<std::pair<uint64_t, Chunk>> m_finished;
+		bool m_stopWorker = false;
+	};
+
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "allocators.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+namespace game
+{
+
+	enum class ShapeType : uint8_t
+	{
+		Circle,
+		Box,
+		Polygon,
+	};
+
+	struct ColliderHandle
+	{
+		uint32_t index = 0;
+		uint32_t generation = 0;
+
+		bool operator==(const ColliderHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const ColliderHandle& other) const { return !(*this == other); }
+	};
+
+	struct ColliderDesc
+	{
+		glm::vec2 position = { 0.f, 0.f };
+		uint32_t layers = 1;		// what the collider is
+		uint32_t mask = ~0u;		// what it collides with
+		uint32_t userData = 0;
+		bool isStatic = false;		// static colliders are never paired with each other
+	};
+
+	// normal points from a to b, depth is the penetration along it.
+	// Tile contacts have an invalid b and the tile coordinates in tile.
+	struct Contact
+	{
+		ColliderHandle a;
+		ColliderHandle b;
+		glm::ivec2 tile = { -1, -1 };
+		glm::vec2 normal = { 0.f, 0.f };
+		float depth = 0.f;
+		glm::vec2 points[2] = {};
+		int pointCount = 0;
+	};
+
+	struct Ray
+	{
+		glm::vec2 origin = { 0.f, 0.f };
+		glm::vec2 direction = { 1.f, 0.f };		// normalized
+		float maxDistance = 100.f;
+		uint32_t mask = ~0u;
+	};
+
+	struct RayHit
+	{
+		bool hit = false;
+		ColliderHandle collider;		// invalid for tile hits
+		glm::ivec2 tile = { -1, -1 };	// valid for tile hits
+		glm::vec2 point = { 0.f, 0.f };
+		glm::vec2 normal = { 0.f, 0.f };
+		float distance = 0.f;			// for shape casts: distance travelled before the contact
+	};
+
+
+	struct CollisionShape;
+
+
+	// Collision world for circles, axis aligned boxes and convex polygons (translation only).
+	// Step() rebuilds the broadphase, a spatial hash stored as a sorted list of (cell, collider) entries,
+	// and runs the SAT narrowphase on the candidate pairs in parallel, producing contact manifolds
+	// (up to 2 points) between colliders and against the solid tiles of the tile grid.
+	// Queries use the broadphase of the last Step and are const, so batches of them can run in parallel.
+	class CollisionWorld
+	{
+	public:
+
+		struct Stats
+		{
+			int colliders = 0;
+			int cellEntries = 0;
+			int pairs = 0;
+			int contacts = 0;
+			float stepMs = 0.f;
+		};
+
+		explicit CollisionWorld(float cellSize = 2.f) : m_cellSize(cellSize) {}
+
+		// optional, the candidate pairs of Step are allocated from it.
+		void SetFrameArena(FrameArena* frameArena) { m_frameArena = frameArena; }
+
+		ColliderHandle CreateCircle(const ColliderDesc& desc, float radius);
+		ColliderHandle CreateBox(const ColliderDesc& desc, glm::vec2 halfExtents);
+		// vertices relative to desc.position, their convex hull is used.
+		ColliderHandle CreatePolygon(const ColliderDesc& desc, const std::vector<glm::vec2>& vertices);
+		// world space polygon, positioned at its centroid.
+		ColliderHandle CreatePolygon(const LittleEngine::Math::Polygon& polygon, ColliderDesc desc = {});
+
+		void Destroy(ColliderHandle handle);
+		bool IsAlive(ColliderHandle handle) const;
+
+		glm::vec2 GetPosition(ColliderHandle handle) const;
+		void SetPosition(ColliderHandle handle, glm::vec2 position);
+		void Move(ColliderHandle handle, glm::vec2 delta);
+		uint32_t GetUserData(ColliderHandle handle) const;
+
+		// row major, row 0 at the bottom (same as ChunkedTilemap), tile (x, y) covers origin + (x, y) * tileSize.
+		void SetTileGrid(const unsigned int* tiles, int width, int height, glm::vec2 origin, float tileSize,
+			const std::vector<unsigned int>& solidTiles);
+		void ClearTileGrid();
+		bool IsSolidTile(int x, int y) const;
+
+		void Step();
+		const std::vector<Contact>& GetContacts() const { return m_contacts; }
+
+		// rays starting inside a shape or a solid tile do not hit it
+		bool Raycast(const Ray& ray, RayHit& hit) const;
+		// all rays run in parallel, hits[i] answers rays[i].
+		void RaycastBatch(const Ray* rays, RayHit* hits, size_t count) const;
+
+		// moves the collider's shape from its position towards target and stops at the first contact.
+		// The collider itself and shapes it already overlaps are ignored, the collider is not moved.
+		bool ShapeCast(ColliderHandle handle, glm::vec2 target, RayHit& hit, uint32_t mask = ~0u) const;
+
+		void QueryAabb(glm::vec2 min, glm::vec2 max, std::vector<ColliderHandle>& out, uint32_t mask = ~0u) const;
+
+		const Stats& GetStats() const { return m_stats; }
+
+	private:
+
+		struct Slot
+		{
+			uint32_t dense = 0;
+			uint32_t generation = 1;
+			bool alive = false;
+		};
+
+		using Shape = CollisionShape;
+		ColliderHandle Create(const ColliderDesc& desc, ShapeType type, float radius, glm::vec2 halfExtents, std::vector<glm::vec2> vertices);
+		int GetDense(ColliderHandle handle) const;
+		ColliderHandle GetHandle(uint32_t dense) const;
+		void UpdateBounds(uint32_t dense);
+		Shape GetShape(uint32_t dense, glm::vec2 offset = { 0.f, 0.f }) const;
+
+		Shape GetTileShape(int x, int y) const;
+
+		void BuildBroadphase(FrameVector<glm::uvec2>& pairs);
+		void CollideTiles(uint32_t dense, std::vector<Contact>& out) const;
+		bool RaycastTiles(const Ray& ray, RayHit& hit) const;
+		// fn(dense) for every entry of the cells overlapping bounds, a collider can be visited more than once
+		template<typename Fn>
+		void ForEachInCells(glm::vec4 bounds, Fn&& fn) const;
+		// fn(x, y) for every solid tile overlapping bounds, stops when fn returns true
+		template<typename Fn>
+		bool ForEachSolidTile(glm::vec4 bounds, Fn&& fn) const;
+
+		static uint64_t CellKey(int x, int y) { return (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32) | static_cast<uint32_t>(x); }
+
+
+		float m_cellSize;
+
+		// dense collider data, swap-remove on destroy
+		std::vector<glm::vec2> m_positions;
+		std::vector<glm::vec4> m_bounds;			// min x, min y, max x, max y
+		std::vector<ShapeType> m_types;
+		std::vector<float> m_radii;
+		std::vector<glm::vec2> m_halfExtents;
+		std::vector<std::vector<glm::vec2>> m_vertices;	// local, counter clockwise
+		std::vector<std::vector<glm::vec2>> m_normals;
+		std::vector<uint32_t> m_layers;
+		std::vector<uint32_t> m_masks;
+		std::vector<uint32_t> m_userData;
+		std::vector<uint8_t> m_static;
+		std::vector<uint32_t> m_denseToSlot;
+
+		std::vector<Slot> m_slots;
+		std::vector<uint32_t> m_freeSlots;
+
+		// broadphase, built by Step. Destroy remaps the moved collider and marks the removed one.
+		static constexpr uint32_t s_removedEntry = ~0u;
+		struct CellEntry
+		{
+			uint64_t key;
+			uint32_t dense;
+		};
+		std::vector<CellEntry> m_entries;
+		std::unordered_map<uint64_t, glm::uvec2> m_cells;	// key -> [begin, end) in m_entries
+		FrameArena* m_frameArena = nullptr;
+
+		// narrowphase output, one bucket per parallel range so the result order is deterministic
+		std::vector<std::vector<Contact>> m_buckets;
+		std::vector<Contact> m_contacts;
+
+		// tiles
+		std::vector<uint8_t> m_solid;
+		glm::ivec2 m_tileGridSize = { 0, 0 };
+		glm::vec2 m_tileOrigin = { 0.f, 0.f };
+		float m_tileSize = 1.f;
+		glm::vec2 m_tileVertices[4] = {};
+		glm::vec2 m_tileNormals[4] = {};
+
+		Stats m_stats;
+	};
+
+}
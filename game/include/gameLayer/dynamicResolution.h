@@ -0,0 +1,93 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include <chrono>
+
+
+namespace game
+{
+
+	// Picks the scene and light render target scales from the measured frame time.
+	// GPU time comes from GL_TIME_ELAPSED queries kept in a small ring so reading them never stalls,
+	// CPU time is the Update + Render work without the swap. Only GPU time moves the resolution,
+	// a CPU bound frame does not get faster with fewer pixels.
+	// Scales are quantized to a few levels so the render graph pool keeps reusing the same targets,
+	// and a level only changes after several frames on the same side of the budget.
+	class DynamicResolution
+	{
+	public:
+
+		struct Settings
+		{
+			float targetFrameMs = 1000.f / 60.f;
+
+			float sceneMinScale = 0.5f;
+			float sceneMaxScale = 1.f;
+			float lightMinScale = 0.125f;
+			float lightMaxScale = 0.5f;
+			int levels = 6;					// quantized steps from min to max
+
+			float lowerThreshold = 0.95f;	// fraction of the budget above which a frame counts as too slow
+			float raiseThreshold = 0.75f;	// below which it counts as having headroom
+			int lowerFrames = 5;			// consecutive slow frames before dropping a level
+			int raiseFrames = 90;			// consecutive fast frames before raising a level
+			int cooldownFrames = 20;		// after a change, the queries in flight still measure the old level
+		};
+
+		DynamicResolution() = default;
+		~DynamicResolution() { Shutdown(); }
+
+		DynamicResolution(const DynamicResolution&) = delete;
+		DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+		// settings can be changed at any time, e.g. before Initialize
+		void Initialize();
+		void Shutdown();
+
+		// brackets the frame work: BeginFrame at the start of Update, EndFrame at the end of Render.
+		void BeginFrame();
+		void EndFrame();
+
+		// disabled: max scales, the measurements keep running
+		void SetEnabled(bool enabled);
+		bool IsEnabled() const { return m_enabled; }
+
+		float GetSceneScale() const;
+		float GetLightScale() const;
+		int GetLevel() const { return m_level; }
+
+		float GetCpuMilliseconds() const { return m_cpuMs; }
+		float GetGpuMilliseconds() const { return m_gpuMs; }
+		int GetLevelChanges() const { return m_levelChanges; }
+
+		Settings settings;
+
+	private:
+
+		void CollectQueries();
+		void Adjust(float frameMs);
+
+		static constexpr int s_queryCount = 4;
+		static constexpr float s_smoothing = 0.1f;
+
+		unsigned int m_queries[s_queryCount] = {};
+		bool m_pending[s_queryCount] = {};
+		int m_queryIndex = 0;
+		bool m_queryActive = false;
+
+		std::chrono::steady_clock::time_point m_frameStart;
+		float m_cpuMs = 0.f;
+		float m_gpuMs = 0.f;
+		bool m_hasGpuSample = false;
+
+		int m_level = 0;				// 0 is full quality
+		int m_slowFrames = 0;
+		int m_fastFrames = 0;
+		int m_cooldown = 0;
+		int m_levelChanges = 0;
+
+		bool m_enabled = true;
+		bool m_initialized = false;
+	};
+
+}
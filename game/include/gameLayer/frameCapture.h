@@ -0,0 +1,117 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "allocators.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace game
+{
+
+	// Non blocking replacement for Renderer::SaveScreenshot.
+	// Pixels are read into a ring of pixel buffer objects and collected a few frames later,
+	// encoding and disk writes happen on a worker thread.
+	class FrameCapture
+	{
+	public:
+		enum class Format
+		{
+			Tga,	// uncompressed 24 bit, bottom-left origin like OpenGL so no flip is needed
+			Raw,	// tightly packed RGBA8 rows, bottom row first
+		};
+
+		FrameCapture() = default;
+		~FrameCapture() { Shutdown(); }
+
+		FrameCapture(const FrameCapture&) = delete;
+		FrameCapture& operator=(const FrameCapture&) = delete;
+
+		void Initialize(const std::string& outputDirectory, int ringSize = 3);
+		void Shutdown();
+
+		// captures the target (or the window if nullptr) at the end of the current frame.
+		void RequestScreenshot(LittleEngine::Graphics::RenderTarget* target = nullptr);
+
+		// records every nth frame of the window for the given duration.
+		void StartSequence(int everyNthFrame, float durationSeconds);
+		void StopSequence();
+		bool IsRecording() const { return m_sequenceActive; }
+
+		// must be called once at the end of Game::Render, after the window content is complete.
+		void EndFrame(float dt);
+
+		Format format = Format::Tga;
+
+		int GetPendingReadbacks() const;
+		int GetQueuedWrites();
+		int GetDroppedCount() const { return m_dropped; }
+		int GetWrittenCount() const { return m_written; }
+
+	private:
+
+		struct Slot
+		{
+			unsigned int pbo = 0;
+			void* fence = nullptr;	// GLsync
+			glm::ivec2 size = { 0, 0 };
+			uint64_t frame = 0;
+			std::string path;
+			bool pending = false;
+		};
+
+		struct Job
+		{
+			std::vector<uint8_t> pixels;
+			glm::ivec2 size;
+			std::string path;
+			Format format;
+		};
+
+		// pixel buffers are recycled between captures instead of hitting the heap every frame of a sequence.
+		std::vector<uint8_t> AcquireBuffer(size_t size);
+		void ReleaseBuffer(std::vector<uint8_t>&& buffer);
+
+		void IssueReadback(LittleEngine::Graphics::RenderTarget* target, const std::string& path);
+		void CollectReadbacks(bool wait);
+		std::string MakePath(const std::string& prefix, uint64_t index) const;
+
+		void WorkerLoop();
+		static bool WriteTga(const Job& job);
+		static bool WriteRaw(const Job& job);
+
+
+		std::string m_outputDirectory;
+		std::vector<Slot> m_slots;
+		int m_nextSlot = 0;
+		uint64_t m_frame = 0;
+
+		bool m_screenshotRequested = false;
+		LittleEngine::Graphics::RenderTarget* m_screenshotTarget = nullptr;
+
+		bool m_sequenceActive = false;
+		int m_sequenceInterval = 1;
+		float m_sequenceTimeLeft = 0.f;
+		int m_sequenceIndex = 0;
+		std::string m_sequencePrefix;
+
+		int m_dropped = 0;
+		std::atomic<int> m_written = { 0 };
+
+		std::thread m_worker;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<Job> m_jobs;
+		std::vector<std::vector<uint8_t>> m_freeBuffers;
+		bool m_stopWorker = false;
+		bool m_initialized = false;
+	};
+
+}
@@ -2,6 +2,21 @@
 #include <LittleEngine/little_engine.h>
 
 #include "gameData.h"
+#include "allocators.h"
+#include "shaderCache.h"
+#include "retainedUI.h"
+#include "spriteBatch.h"
+#include "frameCapture.h"
+#include "lightStore.h"
+#include "chunkedTilemap.h"
+#include "visibilityLights.h"
+#include "particleSystem.h"
+#include "collisionWorld.h"
+#include "renderGraph.h"
+#include "dynamicResolution.h"
+#include "textureManager.h"
+#include "navGrid.h"
+#include "snapshot.h"
 
 
 namespace game
@@ -38,12 +53,22 @@ namespace game
 		void InitializeUI();
 		void InitializeScene();
 		void InitializeLight();
+		void InitializeWorld();
+		void InitializeParticles();
+		void InitializeCollision();
+		void InitializeNavigation();
 
+		void LoadSnapshot();
+		void SaveSnapshot();
 
+		void MovePlayer(glm::vec2 step);
+		void UpdateCollisionBodies(float dt);
+		void UpdateAgents(float dt);
 
-		void ResizeFBOs();
 
-		void BlurLightTexture(LittleEngine::Graphics::RenderTarget& lightFBO, int passes, LittleEngine::Graphics::Shader& shader);
+
+		void RenderScene(LittleEngine::Graphics::RenderTarget& sceneTarget);
+		RenderResource AddBlurPasses(RenderResource source, const TargetDesc& desc, int passes);
 		
 
 
@@ -55,7 +80,22 @@ namespace game
 		std::unique_ptr<LittleEngine::Graphics::Renderer> m_renderer;
 		std::unique_ptr<LittleEngine::Audio::AudioSystem> m_audioSystem;
 		std::unique_ptr<LittleEngine::UI::UISystem> m_uiSystem; // UI system for handling UI elements and contexts
+		FrameArena m_frameArena; // transient per frame data, reset at the start of each frame
+		RenderGraph m_renderGraph; // scene, light, blur and merge passes on pooled, aliased targets
+		DynamicResolution m_dynamicResolution; // scene and light target scales from the measured GPU time
+		ShaderCache m_shaderCache; // program binary cache and hot reload for the game shaders
+		RetainedUI m_retainedUI; // caches each UI context in a render target, redrawn only when dirty
+		SpriteBatch m_spriteBatch; // instanced quad path for large sprite counts
+		TextureManager m_textures; // budgeted residency for file textures, least recently drawn are evicted
+		FrameCapture m_frameCapture; // non blocking screenshots and frame sequences
 		std::unique_ptr<LittleEngine::Graphics::LightSystem> m_lightSystem; // light system for rendering lights and shadows
+		LightStore m_lights; // handle based SoA storage mirrored into the light system
+		VisibilityLights m_visibility; // visibility polygon shadow mode and line of sight queries
+		ParticleSystem m_particles; // SoA particle pools updated in parallel, drawn through the sprite batch
+		ChunkedTilemap m_world; // large tilemap streamed from disk around the camera
+		CollisionWorld m_collision; // spatial hash broadphase, SAT contacts, ray and shape casts
+		NavGrid m_nav; // HPA* paths and shared flow fields over the world tiles around the origin
+		SnapshotStore m_snapshots; // versioned chunked saves, written incrementally on a worker, loaded from a mapped file
 
 		// temporary
 
@@ -63,8 +103,41 @@ namespace game
 		LittleEngine::Math::Polygon polygon = {};
 
 
-		std::vector<LittleEngine::Math::Polygon*> obstacles;
-		std::vector<LittleEngine::Graphics::LightSource*> lightSources;
+		std::vector<ObstacleHandle> obstacles;
+		std::vector<LightHandle> lightSources;
+
+		struct Flash
+		{
+			LightHandle light;
+			float lifetime;
+			float timeLeft;
+			float intensity;
+		};
+		std::vector<Flash> flashes;
+		int flashCount = 20;
+
+		EmitterHandle sparks;
+		EmitterHandle explosions;
+		EmitterHandle particleStress;
+		int particleStressRate = 0;
+		int explosionSize = 2000;
+
+		static constexpr uint32_t s_bodyLayer = 2;
+		ColliderHandle playerCollider;
+		bool playerCollides = true;
+		std::vector<ColliderHandle> bodies;
+		std::vector<glm::vec2> bodyVelocities;
+		int bodyCount = 0;
+		bool sightRays = false;
+		std::vector<Ray> rays;
+		std::vector<RayHit> rayHits;
+
+		std::vector<glm::vec2> agents;
+		int agentCount = 0;
+		float agentSpeed = 4.f;
+		glm::vec2 flowGoal = { 0.f, 0.f };
+		bool showPath = false;
+		std::vector<glm::vec2> navPath;
 
 		LittleEngine::Audio::Sound sound;
 		float pitch = 1.f;
@@ -80,6 +153,9 @@ namespace game
 		LittleEngine::Graphics::Texture torch;
 		LittleEngine::Graphics::Texture minecraft_blocks;
 		LittleEngine::Graphics::TextureAtlas minecraft_atlas;
+		std::vector<TextureHandle> faces;
+		bool drawFaces = false;
+		int textureBudgetMB = 128;
 		std::vector<LittleEngine::Graphics::Texture> textures;
 		std::vector<glm::vec4> rect;
 		std::vector<glm::vec4> rect_uv;
@@ -88,11 +164,22 @@ namespace game
 
 		float scale = 1.f;
 
+		bool instancedSprites = true;
+		int spriteStressCount = 0;
+
+		int captureInterval = 2;
+		float captureDuration = 5.f;
+		bool captureRaw = false;
+
 		float delta = 0;
 
+		float autosaveInterval = 0.f;
+		float autosaveTimer = 0.f;
+
 		float speed = 10.f;
 
 
+		bool blurLight = false;
 		int blurPasses = 5;
 		int downscaleFactor = 2;
 		float lightIntensity = 1.f;
@@ -106,23 +193,26 @@ namespace game
 		LittleEngine::Graphics::TilemapRenderer tilemap;
 		std::vector<LittleEngine::Graphics::AtlasCoord> tileIDs;
 
+		bool drawWorld = true;
+		glm::vec2 viewMin = { 0.f, 0.f };
+		glm::vec2 viewMax = { 0.f, 0.f };
+
 		int length = 1;
 		bool w = false;
 		bool v = true;
-		// fps:
+		// fps: ring buffers, allocated once
 		std::vector<float> fpsHistory;
 		std::vector<float> distHistory;
+		int historyOffset = 0;
 		const int historySize = 1000;
 
 
 		LittleEngine::Graphics::RenderTarget target = {};
-		LittleEngine::Graphics::RenderTarget sceneFBO = {};
-		LittleEngine::Graphics::RenderTarget lightFBO = {};
 
 		LittleEngine::Graphics::Camera sceneCamera = {};
 
 
-		LittleEngine::Graphics::Shader blurShader = {};
+		ShaderProgram* blurShader = nullptr;
 		//LittleEngine::Graphics::Shader lightSceneMergingShader = {};
 
 		//LittleEngine::Graphics::Shader lightShader = {};
@@ -133,6 +223,8 @@ namespace game
 		//LittleEngine::Graphics::Shader fullscreenImageBlitShader = {};
 
 		bool enableShadows = true;
+		bool visibilityPolygons = false;
+		bool playerLit = false;
 
 
 		LittleEngine::UI::UICheckbox* cb_ptr = nullptr;
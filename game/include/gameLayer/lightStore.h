@@ -0,0 +1,130 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include <cstdint>
+#include <vector>
+
+
+namespace game
+{
+
+	// generation 0 is never handed out, a default constructed handle is invalid.
+	struct LightHandle
+	{
+		uint32_t index = 0;
+		uint32_t generation = 0;
+
+		bool operator==(const LightHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const LightHandle& other) const { return !(*this == other); }
+	};
+
+	struct ObstacleHandle
+	{
+		uint32_t index = 0;
+		uint32_t generation = 0;
+
+		bool operator==(const ObstacleHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const ObstacleHandle& other) const { return !(*this == other); }
+	};
+
+
+	// Handle based front end for LightSystem lights and obstacles.
+	// Data lives in dense structure-of-arrays storage (swap-remove on destroy) that can be iterated
+	// linearly, handles stay valid until destroyed and stale handles are detected by their generation.
+	// The engine objects are only a mirror: Sync() copies the dense arrays into one LightSource / Polygon
+	// per live light / obstacle, matched by dense index. Creating and destroying store lights between two
+	// Syncs does not touch the engine; Sync creates engine objects when the live count grew and removes the
+	// surplus from the LightSystem when it shrank, so a short-lived light costs one engine create and remove.
+	class LightStore
+	{
+	public:
+
+		struct ObstacleRange
+		{
+			uint32_t first;
+			uint32_t count;
+		};
+
+		void Initialize(LittleEngine::Graphics::LightSystem* lightSystem);
+
+		LightHandle CreateLight(glm::vec2 position, glm::vec3 color, float intensity, float radius);
+		void DestroyLight(LightHandle handle);
+		bool IsAlive(LightHandle handle) const;
+
+		glm::vec2 GetPosition(LightHandle handle) const;
+		glm::vec3 GetColor(LightHandle handle) const;
+		float GetIntensity(LightHandle handle) const;
+		float GetRadius(LightHandle handle) const;
+
+		void SetPosition(LightHandle handle, glm::vec2 position);
+		void Move(LightHandle handle, glm::vec2 delta);
+		void SetColor(LightHandle handle, glm::vec3 color);
+		void SetIntensity(LightHandle handle, float intensity);
+		void SetRadius(LightHandle handle, float radius);
+
+		ObstacleHandle CreateObstacle(const std::vector<glm::vec2>& vertices);
+		void DestroyObstacle(ObstacleHandle handle);
+		bool IsAlive(ObstacleHandle handle) const;
+		void SetObstacleVertices(ObstacleHandle handle, const std::vector<glm::vec2>& vertices);
+
+		// dense views, valid until the next create/destroy.
+		size_t GetLightCount() const { return m_positions.size(); }
+		const glm::vec2* GetPositions() const { return m_positions.data(); }
+		const glm::vec3* GetColors() const { return m_colors.data(); }
+		const float* GetIntensities() const { return m_intensities.data(); }
+		const float* GetRadii() const { return m_radii.data(); }
+		LightHandle GetLightHandle(size_t denseIndex) const;
+		int GetLightIndex(LightHandle handle) const { return GetLightDense(handle); }	// -1 if stale
+
+		size_t GetObstacleCount() const { return m_obstacleRanges.size(); }
+		const ObstacleRange* GetObstacleRanges() const { return m_obstacleRanges.data(); }
+		const glm::vec2* GetObstacleVertices() const { return m_obstacleVertices.data(); }
+
+		// pushes the dense data to the engine objects, call once per frame before RenderLighting.
+		void Sync();
+
+		size_t GetEngineLightPoolSize() const { return m_engineLights.size(); }
+
+	private:
+
+		struct Slot
+		{
+			uint32_t dense = 0;
+			uint32_t generation = 1;
+			bool alive = false;
+		};
+
+		static uint32_t AllocateSlot(std::vector<Slot>& slots, std::vector<uint32_t>& freeSlots);
+		int GetLightDense(LightHandle handle) const;
+		int GetObstacleDense(ObstacleHandle handle) const;
+		void CompactObstacleVertices();
+
+
+		LittleEngine::Graphics::LightSystem* m_lightSystem = nullptr;
+
+		// lights, SoA
+		std::vector<glm::vec2> m_positions;
+		std::vector<glm::vec3> m_colors;
+		std::vector<float> m_intensities;
+		std::vector<float> m_radii;
+		std::vector<uint32_t> m_lightDenseToSlot;
+
+		std::vector<Slot> m_lightSlots;
+		std::vector<uint32_t> m_freeLightSlots;
+
+		// obstacles, vertex ranges into one contiguous array
+		std::vector<glm::vec2> m_obstacleVertices;
+		std::vector<ObstacleRange> m_obstacleRanges;
+		std::vector<uint8_t> m_obstacleDirty;
+		std::vector<uint32_t> m_obstacleDenseToSlot;
+		size_t m_deadObstacleVertices = 0;
+
+		std::vector<Slot> m_obstacleSlots;
+		std::vector<uint32_t> m_freeObstacleSlots;
+
+		// engine mirror, one object per live light / obstacle
+		std::vector<LittleEngine::Graphics::LightSource*> m_engineLights;
+		std::vector<LittleEngine::Math::Polygon*> m_enginePolygons;
+	};
+
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "allocators.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+namespace game
+{
+
+	// Integrated cost to one goal for every tile, shared by all agents heading there.
+	struct FlowField
+	{
+		glm::ivec2 goal = { 0, 0 };
+		std::vector<float> cost;			// per tile, infinity when the goal can not be reached
+		std::vector<int8_t> direction;		// per tile, index of the next step (see NavGrid::GetDirection), -1 at the goal and when unreachable
+	};
+
+
+	// Navigation over a tile grid, walkability and cost come from the tile ids.
+	// Movement is 8 way without cutting corners, a step costs the entered tile's cost times the step length.
+	//
+	// Paths use HPA*: the grid is split into clusters, entrances are placed on the walkable runs of the
+	// cluster borders and the shortest paths between the entrances of a cluster are cached (costs plus a
+	// predecessor tree per entrance). A query searches that small abstract graph and then expands the
+	// cached paths. Tile edits only rebuild the clusters they touch.
+	//
+	// Flow fields are one Dijkstra pass from the goal over the whole grid, cached per goal tile.
+	// Update builds the requested ones in parallel, fields that are not requested for a while are dropped.
+	// Tile (x, y) covers [origin + (x, y) * tileSize, origin + (x + 1, y + 1) * tileSize], row 0 at the bottom.
+	class NavGrid
+	{
+	public:
+		static constexpr uint8_t s_blocked = 0;
+
+		struct Settings
+		{
+			int clusterSize = 16;			// only read by Initialize, 2 to 255
+			int maxIdleUpdates = 120;		// flow fields not requested for this many updates are dropped
+		};
+
+		struct Stats
+		{
+			int clusters = 0;
+			int entrances = 0;
+			int rebuiltClusters = 0;		// lifetime
+			int flowFields = 0;
+			int builtFields = 0;			// last update
+			float updateMs = 0.f;			// last update
+			int pathQueries = 0;			// lifetime
+			int expandedNodes = 0;			// abstract nodes expanded by the last path query
+		};
+
+		NavGrid() = default;
+		~NavGrid() { Shutdown(); }
+
+		NavGrid(const NavGrid&) = delete;
+		NavGrid& operator=(const NavGrid&) = delete;
+
+		void Initialize(int width, int height, glm::vec2 origin, float tileSize);
+		void Shutdown();
+
+		// optional, the search scratch of FindPath is allocated from it.
+		void SetFrameArena(FrameArena* frameArena) { m_frameArena = frameArena; }
+
+		// cost 1 is normal ground, s_blocked is not walkable, ids without a cost are 1.
+		void SetTileCost(uint32_t tile, uint8_t cost);
+		// width * height tiles, row major, row 0 at the bottom (same as ChunkedTilemap).
+		void SetTiles(const uint32_t* tiles);
+		void SetTile(int x, int y, uint32_t tile);
+		uint32_t GetTile(int x, int y) const;
+		bool IsWalkable(glm::ivec2 tile) const;
+
+		glm::ivec2 WorldToTile(glm::vec2 position) const;
+		glm::vec2 TileToWorld(glm::ivec2 tile) const;		// tile center
+		glm::ivec2 GetSize() const { return { m_width, m_height }; }
+		// changes whenever a tile does
+		uint64_t GetRevision() const { return m_revision; }
+		// changes whenever a tile in [min, max) does, tracked per cluster
+		uint64_t GetRevision(glm::ivec2 min, glm::ivec2 max) const;
+
+		// path from the tile of from to the tile of to, as tile centers with to as the last point.
+		bool FindPath(glm::vec2 from, glm::vec2 to, std::vector<glm::vec2>& path);
+
+		// the field for the goal tile, null until an Update built it. After tile edits the old field is
+		// returned until the next Update. Valid until the next Update.
+		const FlowField* RequestFlowField(glm::vec2 goal);
+		// normalized, towards the center of the next tile, zero at the goal and where it can not be reached
+		glm::vec2 GetFlowDirection(const FlowField& field, glm::vec2 position) const;
+
+		// rebuilds dirty clusters and the requested flow fields, both in parallel
+		void Update();
+
+		static glm::ivec2 GetDirection(int index);
+
+		const Stats& GetStats() const { return m_stats; }
+
+		Settings settings;
+
+	private:
+
+		struct Entrance
+		{
+			uint32_t tile;
+			uint8_t exits;		// bit per orthogonal direction with the matching entrance of the neighbour cluster
+		};
+
+		struct Cluster
+		{
+			glm::ivec2 min = { 0, 0 };
+			glm::ivec2 max = { 0, 0 };			// exclusive
+			std::vector<Entrance> entrances;
+			std::vector<float> costs;			// entrances^2, [from * count + to]
+			std::vector<uint16_t> parents;		// a predecessor tree over the cluster tiles per entrance
+			uint64_t revision = 0;				// grid revision of the last tile change inside
+			bool dirty = true;
+		};
+
+		struct FieldEntry
+		{
+			FlowField field;
+			uint64_t lastRequested = 0;
+			bool built = false;
+			bool dirty = true;
+		};
+
+		enum class EdgeKind : uint8_t
+		{
+			Start,		// start tile to an entrance of its cluster, start tree
+			Inside,		// between entrances of one cluster, cached tree
+			Across,		// to the neighbour cluster
+			Goal,		// to the goal tile, goal tree
+		};
+
+		// trees inside one cluster, local tile indices, 0xFFFF is no parent
+		struct ClusterSearch
+		{
+			std::vector<float> cost;
+			std::vector<uint16_t> parents;
+		};
+
+		uint32_t Index(glm::ivec2 tile) const { return static_cast<uint32_t>(tile.y) * m_width + tile.x; }
+		glm::ivec2 Tile(uint32_t index) const { return { static_cast<int>(index % m_width), static_cast<int>(index / m_width) }; }
+		uint8_t LookupCost(uint32_t tile) const;
+		bool CanStep(glm::ivec2 from, glm::ivec2 direction, glm::ivec2 min, glm::ivec2 max) const;
+		int ClusterOf(glm::ivec2 tile) const;
+		int FindEntrance(const Cluster& cluster, uint32_t tile) const;
+
+		void MarkDirty(glm::ivec2 tile);
+		void RebuildClusters();
+		void RebuildCluster(Cluster& cluster) const;
+		void AddBorderEntrances(Cluster& cluster, int direction) const;
+		// reverse: costs to reach the start instead of from it, the tree then points towards the start
+		void SearchCluster(const Cluster& cluster, glm::ivec2 start, bool reverse, ClusterSearch& out) const;
+		void AppendClusterPath(const Cluster& cluster, const uint16_t* parents, glm::ivec2 from, glm::ivec2 to, bool reverse,
+			FrameVector<uint32_t>& tiles) const;
+		void BuildFlowField(FlowField& field) const;
+
+		int m_width = 0;
+		int m_height = 0;
+		glm::vec2 m_origin = { 0.f, 0.f };
+		float m_tileSize = 1.f;
+
+		std::vector<uint32_t> m_tiles;
+		std::vector<uint8_t> m_costs;
+		std::unordered_map<uint32_t, uint8_t> m_tileCosts;
+		uint64_t m_revision = 1;
+
+		int m_clusterSize = 16;
+		int m_clustersX = 0;
+		int m_clustersY = 0;
+		std::vector<Cluster> m_clusters;
+		bool m_clustersDirty = false;
+
+		std::unordered_map<uint32_t, std::unique_ptr<FieldEntry>> m_fields;	// by goal tile, stable addresses
+		std::vector<FieldEntry*> m_buildList;
+		uint64_t m_updateCount = 1;
+
+		FrameArena* m_frameArena = nullptr;
+		Stats m_stats;
+		bool m_initialized = false;
+	};
+
+}
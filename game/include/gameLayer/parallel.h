@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+
+namespace game
+{
+
+	// Small fork-join pool for data parallel loops (one loop at a time).
+	// The calling thread takes part in the loop, so it returns once every range was processed.
+	// Calls before Initialize, with a single range, or from inside a loop body run serially on the caller.
+	namespace Parallel
+	{
+		// workerCount < 0: hardware threads - 1
+		void Initialize(int workerCount = -1);
+		void Shutdown();
+
+		int GetWorkerCount();
+
+		// fn(begin, end) is called for consecutive ranges of at most grain items covering [0, count).
+		void For(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+	}
+
+}
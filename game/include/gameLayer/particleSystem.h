@@ -0,0 +1,141 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "allocators.h"
+#include "lightStore.h"
+#include "spriteBatch.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+namespace game
+{
+
+	struct EmitterHandle
+	{
+		uint32_t index = 0;
+		uint32_t generation = 0;
+
+		bool operator==(const EmitterHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const EmitterHandle& other) const { return !(*this == other); }
+	};
+
+	struct EmitterSettings
+	{
+		glm::vec2 position = { 0.f, 0.f };
+		float rate = 100.f;						// particles per second, 0 for burst only emitters
+		int maxParticles = 1 << 14;
+
+		float lifetimeMin = 0.5f;
+		float lifetimeMax = 1.f;
+		float direction = 1.5708f;				// radians, 0 = +x
+		float spread = 6.2832f;					// full cone angle
+		float speedMin = 1.f;
+		float speedMax = 2.f;
+		glm::vec2 gravity = { 0.f, 0.f };
+		float drag = 0.f;						// fraction of the velocity lost per second
+
+		LittleEngine::Graphics::Color colorStart = LittleEngine::Graphics::Colors::White;
+		LittleEngine::Graphics::Color colorEnd = { 1.f, 1.f, 1.f, 0.f };
+		float sizeStart = 0.1f;
+		float sizeEnd = 0.f;
+
+		LittleEngine::Graphics::Texture* texture = nullptr;
+		glm::vec4 uv = { 0.f, 0.f, 1.f, 1.f };	// sub-rect, e.g. TextureAtlas::GetUV
+
+		// a few particles of the emitter carry a light, fading with their lifetime
+		bool emitLight = false;
+		int maxLights = 8;
+		glm::vec3 lightColor = { 1.f, 0.7f, 0.3f };
+		float lightIntensity = 1.f;
+		float lightRadius = 2.f;
+	};
+
+
+	// Particle system with structure-of-arrays pools, one per emitter.
+	// Update integrates 4 particles at a time with SSE (scalar fallback elsewhere) and writes the sprite
+	// records in the same pass, the work is split in ranges across Parallel::For. Render only appends
+	// the prebuilt records to a SpriteBatch.
+	class ParticleSystem
+	{
+	public:
+		ParticleSystem() = default;
+		~ParticleSystem() { Shutdown(); }
+
+		ParticleSystem(const ParticleSystem&) = delete;
+		ParticleSystem& operator=(const ParticleSystem&) = delete;
+
+		// lights is optional, it is needed by emitters with emitLight.
+		// frameArena is optional, the per frame work list is allocated from it.
+		void Initialize(LightStore* lights = nullptr, FrameArena* frameArena = nullptr);
+		void Shutdown();
+
+		EmitterHandle CreateEmitter(const EmitterSettings& settings);
+		void DestroyEmitter(EmitterHandle handle);
+		bool IsAlive(EmitterHandle handle) const;
+
+		// nullptr if the handle is stale, changes apply to newly spawned particles
+		// (color, size, gravity and drag apply to every particle of the emitter).
+		EmitterSettings* GetSettings(EmitterHandle handle);
+
+		void SetPosition(EmitterHandle handle, glm::vec2 position);
+		void Burst(EmitterHandle handle, int count);
+
+		void Update(float dt);
+		void Render(SpriteBatch& batch);
+
+		int GetAliveCount() const { return m_aliveCount; }
+		int GetEmitterCount() const;
+		float GetUpdateMilliseconds() const { return m_updateMs; }
+
+	private:
+
+		struct Emitter
+		{
+			EmitterSettings settings;
+			uint32_t generation = 1;
+			bool alive = false;
+			float spawnAccumulator = 0.f;
+			int pendingBurst = 0;
+
+			// SoA pool, rounded up to a multiple of 4
+			std::vector<float> posX, posY;
+			std::vector<float> velX, velY;
+			std::vector<float> age;			// 0 at spawn, 1 at death
+			std::vector<float> ageRate;		// 1 / lifetime
+			int count = 0;
+			int capacity = 0;
+
+			std::vector<QuadInstance> instances;
+			std::vector<LightHandle> lights;
+		};
+
+		struct Range
+		{
+			Emitter* emitter;
+			int begin;
+			int end;
+		};
+
+		void Allocate(Emitter& emitter);
+		void Release(Emitter& emitter);
+		void RemoveDead(Emitter& emitter);
+		void Spawn(Emitter& emitter, int count);
+		void Integrate(Emitter& emitter, int begin, int end, float dt);
+		void UpdateLights(Emitter& emitter);
+		float Random();
+
+		LightStore* m_lights = nullptr;
+		FrameArena* m_frameArena = nullptr;
+		std::vector<std::unique_ptr<Emitter>> m_emitters;
+		std::vector<uint32_t> m_freeEmitters;
+
+		uint32_t m_random = 0x9E3779B9u;
+		int m_aliveCount = 0;
+		float m_updateMs = 0.f;
+		bool m_initialized = false;
+	};
+
+}
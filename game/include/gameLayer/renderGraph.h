@@ -0,0 +1,137 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace game
+{
+
+	// a resource of the graph being built, only valid until the next Execute
+	struct RenderResource
+	{
+		uint32_t index = ~0u;
+
+		bool IsValid() const { return index != ~0u; }
+		bool operator==(const RenderResource& other) const { return index == other.index; }
+		bool operator!=(const RenderResource& other) const { return !(*this == other); }
+	};
+
+	struct TargetDesc
+	{
+		int format = 0;			// GL internal format, 0 for the RenderTarget default
+		float scale = 1.f;		// relative to the window size
+	};
+
+
+	// Frame graph for the post process chain.
+	// Every frame the passes are declared with the targets they read and write, Execute then culls the passes
+	// that do not contribute to the backbuffer, computes the lifetime of each transient target and backs it
+	// with a pooled RenderTarget of the same format and size that is free by then, so targets whose lifetimes
+	// do not overlap share one FBO. The pool persists across frames and is only rebuilt on resize.
+	class RenderGraph
+	{
+	public:
+
+		using PassFunction = std::function<void(RenderGraph& graph)>;
+
+		struct Stats
+		{
+			int passes = 0;
+			int culledPasses = 0;
+			int transientTargets = 0;
+			int pooledTargets = 0;			// physical targets alive in the pool
+			int createdTargets = 0;			// since the start, FBO churn
+			size_t pooledBytes = 0;			// estimate of the pool's VRAM
+			size_t unaliasedBytes = 0;		// what the transient targets would take without aliasing
+		};
+
+		RenderGraph() = default;
+		~RenderGraph() { Shutdown(); }
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+
+		void Initialize(glm::ivec2 windowSize);
+		void Shutdown();
+
+		// every pooled target is recreated at the new size when it is used next
+		void Resize(glm::ivec2 windowSize);
+
+		RenderResource CreateTarget(const std::string& name, const TargetDesc& desc);
+		// passes writing it are never culled
+		RenderResource GetBackbuffer() const { return { 0 }; }
+
+		void AddPass(const std::string& name, std::initializer_list<RenderResource> reads,
+			std::initializer_list<RenderResource> writes, PassFunction execute);
+
+		// runs the live passes in declaration order and clears the graph for the next frame
+		void Execute();
+
+		// valid inside a pass for the resources it declared
+		LittleEngine::Graphics::RenderTarget& GetTarget(RenderResource resource);
+		glm::ivec2 GetSize(RenderResource resource) const;
+
+		const Stats& GetStats() const { return m_stats; }
+
+	private:
+
+		struct Resource
+		{
+			std::string name;
+			TargetDesc desc;
+			glm::ivec2 size = { 0, 0 };
+			int firstPass = -1;
+			int lastPass = -1;
+			int physical = -1;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			uint32_t firstRead = 0;		// ranges in m_reads / m_writes
+			uint32_t readCount = 0;
+			uint32_t firstWrite = 0;
+			uint32_t writeCount = 0;
+			PassFunction execute;
+			bool alive = false;
+		};
+
+		struct PhysicalTarget
+		{
+			std::unique_ptr<LittleEngine::Graphics::RenderTarget> target;
+			int format = 0;
+			glm::ivec2 size = { 0, 0 };
+			int busyUntil = -1;		// last pass of the current occupant this frame
+			int idleFrames = 0;
+		};
+
+		void Cull();
+		void Allocate();
+		int AcquirePhysical(int format, glm::ivec2 size, int firstPass, int lastPass);
+		void TrimPool();
+		void ReleasePool();
+
+		static size_t EstimateBytes(int format, glm::ivec2 size);
+		static constexpr int s_maxIdleFrames = 120;
+
+		glm::ivec2 m_windowSize = { 1, 1 };
+
+		std::vector<Resource> m_resources;		// [0] is the backbuffer
+		std::vector<Pass> m_passes;
+		std::vector<RenderResource> m_reads;
+		std::vector<RenderResource> m_writes;
+		std::vector<uint8_t> m_needed;
+
+		std::vector<PhysicalTarget> m_pool;
+
+		Stats m_stats;
+		bool m_initialized = false;
+	};
+
+}
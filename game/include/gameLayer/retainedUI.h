@@ -0,0 +1,108 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "shaderCache.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace game
+{
+
+	// Retained-mode layer on top of UISystem.
+	// Every context is rendered once into its own cached render target and only redrawn when it is
+	// marked dirty (hover change, click, visibility change, resize or an explicit Invalidate).
+	// A UI frame is then one textured fullscreen quad per visible context.
+	// Hit testing goes through a uniform grid so UISystem::Update only runs while the cursor
+	// interacts with an element.
+	class RetainedUI
+	{
+	public:
+		RetainedUI() = default;
+		~RetainedUI() { Shutdown(); }
+
+		RetainedUI(const RetainedUI&) = delete;
+		RetainedUI& operator=(const RetainedUI&) = delete;
+
+		void Initialize(LittleEngine::UI::UISystem* uiSystem, ShaderCache& shaderCache, glm::ivec2 windowSize);
+		void Shutdown();
+
+		LittleEngine::UI::UIContext* CreateContext(const std::string& name);
+
+		// hitRect is {x, y, w, h} in window coordinates, leave it empty for non interactive elements.
+		template<typename T>
+		T* AddElement(const std::string& context, std::unique_ptr<T> element, glm::vec4 hitRect = {})
+		{
+			return static_cast<T*>(AddElementInternal(context, std::move(element), hitRect));
+		}
+
+		void ShowContext(const std::string& name);
+		void HideContext(const std::string& name);
+		void ToggleContext(const std::string& name);
+
+		// to be called when game code changes an element (text, state...) directly.
+		void Invalidate(const std::string& name);
+		void InvalidateAll();
+
+		void UpdateWindowSize(int w, int h);
+
+		void Update();
+		void Render(LittleEngine::Graphics::Renderer* renderer);
+
+		int GetRedrawCount() const { return m_redrawCount; }
+		int GetEngineUpdateCount() const { return m_engineUpdateCount; }
+
+	private:
+
+		struct HitBox
+		{
+			glm::vec4 rect;
+			uint32_t context;
+		};
+
+		struct Context
+		{
+			std::string name;
+			LittleEngine::UI::UIContext* context = nullptr;
+			std::unique_ptr<LittleEngine::Graphics::RenderTarget> target;
+			bool visible = false;
+			bool dirty = true;
+		};
+
+		LittleEngine::UI::UIElement* AddElementInternal(const std::string& context, std::unique_ptr<LittleEngine::UI::UIElement> element, glm::vec4 hitRect);
+
+		Context* FindContext(const std::string& name);
+		void SetVisible(Context& context, bool visible);
+		void RebuildGrid();
+		int QueryHitBox(glm::vec2 point) const;
+		void RedrawContext(LittleEngine::Graphics::Renderer* renderer, Context& context);
+
+
+		LittleEngine::UI::UISystem* m_uiSystem = nullptr;
+		std::vector<Context> m_contexts;
+		std::unordered_map<std::string, uint32_t> m_contextIndex;
+
+		// spatial index
+		static constexpr int s_cellSize = 64;
+		std::vector<HitBox> m_hitBoxes;
+		std::vector<std::vector<uint32_t>> m_cells;
+		glm::ivec2 m_gridSize = { 0, 0 };
+		bool m_gridDirty = true;
+
+		glm::ivec2 m_windowSize = { 0, 0 };
+		glm::ivec2 m_lastMouse = { -1, -1 };
+		int m_hovered = -1;
+		bool m_pointerEvent = false;
+
+		ShaderProgram* m_blitShader = nullptr;
+		bool m_initialized = false;
+
+		int m_redrawCount = 0;
+		int m_engineUpdateCount = 0;
+	};
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace game
+{
+
+	// Linked GL program handed out by ShaderCache.
+	// The pointer stays valid across hot reloads, only the program id behind it changes.
+	class ShaderProgram
+	{
+	public:
+		void Use() const;
+
+		void SetInt(const std::string& name, int value);
+		void SetBool(const std::string& name, bool value);
+		void SetFloat(const std::string& name, float value);
+		void SetVec2(const std::string& name, const glm::vec2& value);
+		void SetVec3(const std::string& name, const glm::vec3& value);
+		void SetVec4(const std::string& name, const glm::vec4& value);
+		void SetMat4(const std::string& name, const glm::mat4& value);
+
+		unsigned int GetId() const { return m_id; }
+		bool IsValid() const { return m_id != 0; }
+
+	private:
+		friend class ShaderCache;
+
+		int GetLocation(const std::string& name);
+
+		unsigned int m_id = 0;
+		std::unordered_map<std::string, int> m_locations;
+	};
+
+
+	// Compiles vertex/fragment pairs once and stores the linked program binaries on disk,
+	// keyed by the preprocessed source hash and the driver (vendor, renderer, version) string.
+	// Falls back to compiling from source when the driver rejects a binary.
+	// Sources may use #include "file" (relative to the including file).
+	// Development builds poll the source files and hot reload edited shaders.
+	class ShaderCache
+	{
+	public:
+		ShaderCache() = default;
+		~ShaderCache() { Shutdown(); }
+
+		ShaderCache(const ShaderCache&) = delete;
+		ShaderCache& operator=(const ShaderCache&) = delete;
+
+		void Initialize(const std::string& cacheDirectory);
+		void Shutdown();
+
+		// returns nullptr if the shader could not be built.
+		ShaderProgram* Load(const std::string& vertPath, const std::string& fragPath);
+
+		// hot reload polling, does nothing in production builds.
+		void Update(float dt);
+
+		int GetCacheHits() const { return m_cacheHits; }
+		int GetCacheMisses() const { return m_cacheMisses; }
+		int GetReloadCount() const { return m_reloads; }
+		bool IsBinaryCacheSupported() const { return m_binarySupported; }
+
+	private:
+
+		struct Dependency
+		{
+			std::string path;
+			std::filesystem::file_time_type time;
+		};
+
+		struct Entry
+		{
+			std::string vertPath;
+			std::string fragPath;
+			std::unique_ptr<ShaderProgram> program;
+			std::vector<Dependency> dependencies;
+		};
+
+		unsigned int Build(const std::string& vertPath, const std::string& fragPath, std::vector<Dependency>& dependencies);
+
+		bool Preprocess(const std::string& path, std::string& out, std::vector<Dependency>& dependencies, int depth);
+		unsigned int CompileStage(unsigned int type, const std::string& source, const std::string& path);
+		unsigned int LinkFromSource(const std::string& vertSource, const std::string& fragSource, const std::string& name);
+
+		unsigned int LoadBinary(uint64_t key);
+		void SaveBinary(uint64_t key, unsigned int program);
+		std::string GetBinaryPath(uint64_t key) const;
+
+
+		std::string m_cacheDirectory;
+		std::vector<Entry> m_entries;
+
+		uint64_t m_driverHash = 0;
+		bool m_binarySupported = false;
+
+		float m_pollTimer = 0.f;
+		static constexpr float s_pollInterval = 0.5f;
+
+		int m_cacheHits = 0;
+		int m_cacheMisses = 0;
+		int m_reloads = 0;
+		bool m_initialized = false;
+	};
+
+}
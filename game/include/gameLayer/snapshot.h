@@ -0,0 +1,222 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+
+namespace game
+{
+
+	// Appends values to a chunk, fields are written one by one so a struct layout change does not break old files.
+	class SnapshotWriter
+	{
+	public:
+		explicit SnapshotWriter(std::vector<uint8_t>& bytes) : m_bytes(bytes) {}
+
+		template<class T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as bytes");
+			size_t offset = m_bytes.size();
+			m_bytes.resize(offset + sizeof(T));
+			std::memcpy(m_bytes.data() + offset, &value, sizeof(T));
+		}
+
+		// element count first, then the elements
+		template<class T>
+		void WriteArray(const T* data, size_t count)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as bytes");
+			Write(static_cast<uint32_t>(count));
+			size_t offset = m_bytes.size();
+			m_bytes.resize(offset + count * sizeof(T));
+			if (count)
+				std::memcpy(m_bytes.data() + offset, data, count * sizeof(T));
+		}
+
+	private:
+		std::vector<uint8_t>& m_bytes;
+	};
+
+	// Reads a chunk back in the order it was written. Reads past the end fail and leave the value untouched,
+	// so a chunk from an older, shorter layout keeps the defaults for the new fields.
+	class SnapshotReader
+	{
+	public:
+		SnapshotReader() = default;
+		SnapshotReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+		template<class T>
+		bool Read(T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as bytes");
+			if (m_size - m_offset < sizeof(T))
+			{
+				m_failed = true;
+				return false;
+			}
+			std::memcpy(&value, m_data + m_offset, sizeof(T));
+			m_offset += sizeof(T);
+			return true;
+		}
+
+		template<class T>
+		bool ReadArray(std::vector<T>& values)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "snapshot values are copied as bytes");
+			uint32_t count = 0;
+			if (!Read(count) || (m_size - m_offset) / sizeof(T) < count)
+			{
+				m_failed = true;
+				return false;
+			}
+			values.resize(count);
+			if (count)
+				std::memcpy(values.data(), m_data + m_offset, count * sizeof(T));
+			m_offset += count * sizeof(T);
+			return true;
+		}
+
+		bool Failed() const { return m_failed; }
+		size_t GetRemaining() const { return m_size - m_offset; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_offset = 0;
+		bool m_failed = false;
+	};
+
+
+	// Versioned, chunked binary snapshots of the game and engine state.
+	//
+	// File layout (little endian):
+	//   header   magic "LSNP", file version, index offset, chunk count
+	//   chunks   raw chunk payloads, appended over time
+	//   index    one {id, version, offset, size, hash} per chunk, written after the payloads of each save
+	//
+	// Capture runs on the main thread: every AddChunk serializes into its own buffer, a chunk whose revision
+	// did not change since the previous capture shares the previous buffer instead. Save hands the capture to a
+	// worker, which appends only the chunks whose content differs from the file, then a new index, and points
+	// the header at it last, so an interrupted save leaves the previous snapshot readable. The file is rewritten
+	// from scratch once the dead payloads outweigh the live ones.
+	// Loading maps the file and reads the chunks in place.
+	class SnapshotStore
+	{
+	public:
+
+		struct Stats
+		{
+			int saves = 0;				// lifetime, finished
+			int sharedChunks = 0;		// last capture, same revision as the capture before
+			int writtenChunks = 0;		// last save
+			int keptChunks = 0;			// last save, already in the file
+			size_t writtenBytes = 0;	// last save
+			size_t fileBytes = 0;
+			bool compacted = false;		// last save rewrote the whole file
+			bool failed = false;		// last save
+			float captureMs = 0.f;		// main thread, BeginCapture to Save
+			float saveMs = 0.f;			// worker
+		};
+
+		using ChunkFunction = std::function<void(SnapshotWriter&)>;
+
+		SnapshotStore() = default;
+		~SnapshotStore() { Shutdown(); }
+
+		SnapshotStore(const SnapshotStore&) = delete;
+		SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+		void Initialize();
+		// a save that is still queued is finished first
+		void Shutdown();
+
+		void BeginCapture();
+		// version: layout version of the payload, checked by the loader.
+		// revision: changes whenever the data does, 0 always serializes.
+		void AddChunk(uint32_t id, uint32_t version, uint64_t revision, const ChunkFunction& write);
+		// queues the capture, replaces a queued one the worker did not start yet
+		void Save(const std::string& path);
+		bool IsSaving();
+
+		// maps the file, chunks are read in place until Unmap. Unmap once the state is applied,
+		// a mapped file can not be replaced by a save on every platform.
+		bool Map(const std::string& path);
+		void Unmap();
+		bool ReadChunk(uint32_t id, uint32_t& version, SnapshotReader& reader) const;
+
+		Stats GetStats();
+
+	private:
+
+		struct IndexEntry
+		{
+			uint32_t id;
+			uint32_t version;
+			uint64_t offset;
+			uint64_t size;
+			uint64_t hash;
+		};
+
+		struct CapturedChunk
+		{
+			uint32_t id;
+			uint32_t version;
+			uint64_t revision;
+			std::shared_ptr<const std::vector<uint8_t>> bytes;
+		};
+
+		struct Capture
+		{
+			std::string path;
+			std::vector<CapturedChunk> chunks;
+		};
+
+		void WorkerLoop();
+		bool WriteCapture(const Capture& capture, Stats& stats);
+		bool WriteFull(const Capture& capture, const std::vector<uint64_t>& hashes, Stats& stats);
+		bool ReadFileIndex(const std::string& path);
+		static uint64_t Hash(const std::vector<uint8_t>& bytes);
+
+		// main thread
+		std::vector<CapturedChunk> m_chunks;
+		std::unordered_map<uint32_t, CapturedChunk> m_previous;		// by id, the last capture
+		std::chrono::steady_clock::time_point m_captureStart;
+		int m_sharedChunks = 0;
+		float m_captureMs = 0.f;
+
+		const uint8_t* m_mapped = nullptr;
+		size_t m_mappedSize = 0;
+		void* m_mapping = nullptr;		// platform handles of the mapping
+		intptr_t m_mappedFile = -1;
+		std::vector<IndexEntry> m_mappedIndex;
+
+		// worker only, what the file on disk holds
+		std::string m_filePath;
+		std::vector<IndexEntry> m_fileIndex;
+		uint64_t m_fileBytes = 0;		// logical end, after the current index
+
+		// shared with the worker
+		std::thread m_worker;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::unique_ptr<Capture> m_pending;
+		bool m_saving = false;
+		bool m_stopWorker = false;
+		Stats m_stats;
+
+		bool m_initialized = false;
+	};
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "allocators.h"
+#include "shaderCache.h"
+
+#include <cstdint>
+#include <vector>
+
+
+namespace game
+{
+
+	// packed per-instance record, expanded to 4 corners in instanced_quad.vert
+	struct QuadInstance
+	{
+		glm::vec4 rect;			// x, y, w, h
+		uint16_t uv[4];			// u0, v0, u1, v1 as normalized shorts
+		uint8_t color[4];		// rgba8
+		uint8_t texIndex;
+		uint8_t padding[3];
+	};
+	static_assert(sizeof(QuadInstance) == 32, "QuadInstance must stay tightly packed");
+
+
+	// Instanced quad path for large sprite counts.
+	// Uploads one 32 bytes record per sprite instead of 4 vertices of 36 bytes (144 bytes) with Renderer::DrawRect.
+	// Draws into the currently bound framebuffer.
+	class SpriteBatch
+	{
+	public:
+		static constexpr int s_maxTextures = 16;	// matches uTextures[16] in fragment.frag
+
+		SpriteBatch() = default;
+		~SpriteBatch() { Shutdown(); }
+
+		SpriteBatch(const SpriteBatch&) = delete;
+		SpriteBatch& operator=(const SpriteBatch&) = delete;
+
+		void Initialize(ShaderCache& shaderCache, int maxInstances = 1 << 16);
+		void Shutdown();
+
+		void SetCamera(const LittleEngine::Graphics::Camera& camera);
+
+		// uv is {u0, v0, u1, v1}
+		void DrawRect(const glm::vec4& rect, LittleEngine::Graphics::Texture& texture,
+			const LittleEngine::Graphics::Color& color = LittleEngine::Graphics::Colors::White,
+			const glm::vec4& uv = { 0.f, 0.f, 1.f, 1.f });
+
+		// appends prebuilt records (e.g. cached tilemap chunks), their texIndex is replaced by the texture slot.
+		void DrawInstances(const QuadInstance* instances, size_t count, LittleEngine::Graphics::Texture& texture);
+
+		void Flush();
+
+		int GetInstanceCount() const { return m_frameInstances; }
+		int GetDrawCalls() const { return m_frameDrawCalls; }
+		void ResetStats() { m_frameInstances = 0; m_frameDrawCalls = 0; }
+
+	private:
+
+		int GetTextureSlot(LittleEngine::Graphics::Texture& texture);
+
+		ShaderProgram* m_shader = nullptr;
+		unsigned int m_vao = 0;
+		unsigned int m_vbo = 0;
+
+		std::vector<QuadInstance> m_instances;
+		int m_maxInstances = 0;
+
+		LittleEngine::Graphics::Texture* m_textures[s_maxTextures] = {};
+		int m_textureCount = 0;
+
+		glm::mat4 m_view = glm::mat4(1.f);
+		glm::mat4 m_projection = glm::mat4(1.f);
+
+		int m_frameInstances = 0;
+		int m_frameDrawCalls = 0;
+		bool m_initialized = false;
+	};
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace game
+{
+
+	struct TextureHandle
+	{
+		uint32_t index = 0;
+		uint32_t generation = 0;
+
+		bool operator==(const TextureHandle& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const TextureHandle& other) const { return !(*this == other); }
+	};
+
+	// forwarded to Texture::LoadFromFile
+	struct TextureOptions
+	{
+		bool pixelated = false;
+		bool mipmaps = false;
+		bool flip = false;
+	};
+
+
+	// Residency manager for file backed textures under a GPU memory budget.
+	// Textures are registered by path and loaded on first use: Get() marks the texture as drawn this frame
+	// and returns it when resident, otherwise it queues a load and returns a small placeholder.
+	// A worker reads the file and its image header (so the size is known before the upload), Update then
+	// uploads a few ready textures per frame and evicts the least recently drawn ones while over budget.
+	class TextureManager
+	{
+	public:
+
+		struct Settings
+		{
+			size_t budgetBytes = 128ull << 20;
+			int maxUploadsPerFrame = 2;		// Texture::LoadFromFile decodes on the calling thread
+			int protectedFrames = 2;		// textures drawn this recently are never evicted
+		};
+
+		struct Stats
+		{
+			int registered = 0;
+			int resident = 0;
+			int pending = 0;
+			size_t residentBytes = 0;
+			size_t peakBytes = 0;
+			int uploads = 0;
+			int evictions = 0;
+			int placeholderDraws = 0;		// last frame
+			bool overBudget = false;		// everything resident was drawn recently
+		};
+
+		TextureManager() = default;
+		~TextureManager() { Shutdown(); }
+
+		TextureManager(const TextureManager&) = delete;
+		TextureManager& operator=(const TextureManager&) = delete;
+
+		void Initialize();
+		void Shutdown();
+
+		// preload uploads now, for textures needed in the first frame
+		TextureHandle Load(const std::string& path, const TextureOptions& options = {}, bool preload = false);
+		void Unload(TextureHandle handle);
+		bool IsAlive(TextureHandle handle) const;
+		bool IsResident(TextureHandle handle) const;
+
+		// valid until the next Update, use it for this frame's draws only
+		LittleEngine::Graphics::Texture& Get(TextureHandle handle);
+
+		// bytes of the full texture as uploaded, 0 when the image header could not be read
+		size_t GetTextureBytes(TextureHandle handle) const;
+
+		void Update();
+
+		const Stats& GetStats() const { return m_stats; }
+
+		Settings settings;
+
+	private:
+
+		enum class State : uint8_t
+		{
+			Evicted,
+			Queued,
+			Ready,		// file read, waiting for an upload slot
+			Resident,
+			Failed,
+		};
+
+		struct Entry
+		{
+			std::string path;
+			TextureOptions options;
+			LittleEngine::Graphics::Texture texture;
+			State state = State::Evicted;
+			glm::ivec2 size = { 0, 0 };
+			size_t bytes = 0;
+			uint64_t lastUsedFrame = 0;
+			uint32_t generation = 1;
+			bool alive = false;
+		};
+
+		struct Request
+		{
+			uint32_t index;
+			uint32_t generation;
+			std::string path;
+		};
+
+		struct Result
+		{
+			uint32_t index;
+			uint32_t generation;
+			glm::ivec2 size;
+			bool ok;
+		};
+
+		Entry* GetEntry(TextureHandle handle);
+		const Entry* GetEntry(TextureHandle handle) const;
+		void Upload(Entry& entry);
+		void Evict(Entry& entry);
+		void EnforceBudget();
+		void WorkerLoop();
+
+		static glm::ivec2 ReadImageSize(const std::vector<uint8_t>& bytes);
+		static size_t ComputeBytes(glm::ivec2 size, const TextureOptions& options);
+
+		std::vector<std::unique_ptr<Entry>> m_entries;	// stable addresses, callers hold Texture& for a frame
+		std::vector<uint32_t> m_freeEntries;
+		std::vector<uint32_t> m_ready;
+
+		LittleEngine::Graphics::RenderTarget m_placeholder;
+		uint64_t m_frame = 1;
+		size_t m_residentBytes = 0;
+		int m_placeholderDraws = 0;
+
+		std::thread m_worker;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<Request> m_requests;
+		std::vector<Result> m_finished;
+		std::vector<Result> m_collected;
+		bool m_stopWorker = false;
+
+		Stats m_stats;
+		bool m_initialized = false;
+	};
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <LittleEngine/little_engine.h>
+
+#include "lightStore.h"
+#include "shaderCache.h"
+
+#include <vector>
+
+
+namespace game
+{
+
+	// Alternative shadow mode to the LightSystem shadow quads.
+	// For every light a visibility polygon is computed on the CPU from the LightStore obstacle edges
+	// (edges clipped to the light radius and split where they cross, then an angular sweep over the endpoints,
+	// lights in parallel) and drawn as one
+	// additive triangle fan, so overdraw does not grow with the number of occluders.
+	// The polygons stay available until the next Compute for line of sight queries.
+	class VisibilityLights
+	{
+	public:
+		VisibilityLights() = default;
+		~VisibilityLights() { Shutdown(); }
+
+		VisibilityLights(const VisibilityLights&) = delete;
+		VisibilityLights& operator=(const VisibilityLights&) = delete;
+
+		void Initialize(ShaderCache& shaderCache);
+		void Shutdown();
+
+		void Compute(const LightStore& lights);
+
+		// clears target and accumulates every light into it.
+		void Render(const LittleEngine::Graphics::Camera& camera, LittleEngine::Graphics::RenderTarget& target);
+
+		// point lit by the light as of the last Compute (inside its radius and not occluded).
+		bool IsVisible(LightHandle light, glm::vec2 point) const;
+
+		// segment test against the obstacle edges of the last Compute.
+		bool HasLineOfSight(glm::vec2 from, glm::vec2 to) const;
+
+		// fan ring of the light with the given dense index, the first vertex is the light position.
+		const std::vector<glm::vec2>& GetPolygon(size_t denseIndex) const { return m_polygons[denseIndex]; }
+
+		int GetComputedLights() const { return static_cast<int>(m_polygons.size()); }
+		int GetEdgeCount() const { return static_cast<int>(m_edges.size()); }
+		int GetFanVertexCount() const { return m_fanVertices; }
+		float GetComputeMilliseconds() const { return m_computeMs; }
+
+	private:
+
+		struct Edge
+		{
+			glm::vec2 a;
+			glm::vec2 b;
+		};
+
+		void ComputeLight(size_t index, glm::vec2 position, float radius);
+
+		static constexpr int s_boundarySegments = 32;
+
+		std::vector<Edge> m_edges;
+		std::vector<glm::vec4> m_edgeBounds;	// min x, min y, max x, max y
+
+		// per dense light index
+		std::vector<std::vector<glm::vec2>> m_polygons;
+		std::vector<LightHandle> m_handles;
+		std::vector<glm::vec3> m_colors;
+		std::vector<float> m_intensities;
+		std::vector<float> m_radii;
+		const LightStore* m_store = nullptr;
+
+		ShaderProgram* m_shader = nullptr;
+		unsigned int m_vao = 0;
+		unsigned int m_vbo = 0;
+		size_t m_vboCapacity = 0;
+		std::vector<glm::vec2> m_upload;
+
+		int m_fanVertices = 0;
+		float m_computeMs = 0.f;
+		bool m_initialized = false;
+	};
+
+}
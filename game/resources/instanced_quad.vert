@@ -0,0 +1,23 @@
+#version 330 core
+// one record per sprite, the 4 corners are expanded from gl_VertexID (triangle strip)
+layout (location = 0) in vec4 iRect;        // x, y, w, h
+layout (location = 1) in vec4 iUV;          // u0, v0, u1, v1 (normalized shorts)
+layout (location = 2) in vec4 iColor;       // rgba8 (normalized)
+layout (location = 3) in float iTexIndex;   // uint8
+
+out vec2 vTexCoord;
+out vec4 vColor;
+out float vTexIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+    gl_Position = projection * view * vec4(iRect.xy + corner * iRect.zw, 0.0, 1.0);
+    vTexCoord = mix(iUV.xy, iUV.zw, corner);
+    vColor = iColor;
+    vTexIndex = iTexIndex;
+}
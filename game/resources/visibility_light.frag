@@ -0,0 +1,22 @@
+#version 330 core
+// same falloff as light.frag, the fan already excludes the occluded area
+out vec4 FragColor;
+
+in vec2 vWorldPos;
+
+uniform vec2 uLightPos;
+uniform vec3 uLightColor;
+uniform float uLightRadius;
+uniform float uLightIntensity;
+
+void main()
+{
+    float dist = length(vWorldPos - uLightPos);
+    if (dist > uLightRadius)
+        discard;
+
+    float attenuation = 1.0 - (dist / uLightRadius);
+    attenuation = attenuation * attenuation;
+
+    FragColor = vec4(uLightColor * attenuation * uLightIntensity, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// visibility polygon fan in world space
+layout (location = 0) in vec2 aPos;
+
+out vec2 vWorldPos;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vWorldPos = aPos;
+    gl_Position = projection * view * vec4(aPos, 0.0, 1.0);
+}
@@ -0,0 +1,161 @@
+#include "allocators.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+
+namespace game
+{
+
+#pragma region Telemetry
+
+	namespace
+	{
+		struct AtomicStats
+		{
+			std::atomic<uint64_t> allocations = { 0 };
+			std::atomic<uint64_t> liveBytes = { 0 };
+			std::atomic<uint64_t> peakBytes = { 0 };
+			std::atomic<uint64_t> frameAllocations = { 0 };
+			std::atomic<uint64_t> frameBytes = { 0 };
+
+			// values of the last completed frame
+			std::atomic<uint64_t> lastFrameAllocations = { 0 };
+			std::atomic<uint64_t> lastFrameBytes = { 0 };
+		};
+
+		AtomicStats s_stats[static_cast<size_t>(MemoryTag::Count)];
+
+		const char* s_tagNames[] = {
+			"General",
+			"UI",
+			"Sprites",
+			"Lighting",
+			"Capture",
+			"Streaming",
+			"Particles",
+			"Collision",
+			"Navigation",
+		};
+		static_assert(sizeof(s_tagNames) / sizeof(s_tagNames[0]) == static_cast<size_t>(MemoryTag::Count), "missing MemoryTag name");
+	}
+
+	void Memory::RecordAllocation(MemoryTag tag, size_t bytes)
+	{
+		AtomicStats& stats = s_stats[static_cast<size_t>(tag)];
+		stats.allocations.fetch_add(1, std::memory_order_relaxed);
+		stats.frameAllocations.fetch_add(1, std::memory_order_relaxed);
+		stats.frameBytes.fetch_add(bytes, std::memory_order_relaxed);
+
+		uint64_t live = stats.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		uint64_t peak = stats.peakBytes.load(std::memory_order_relaxed);
+		while (live > peak && !stats.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+	}
+
+	void Memory::RecordFree(MemoryTag tag, size_t bytes)
+	{
+		s_stats[static_cast<size_t>(tag)].liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	void Memory::BeginFrame()
+	{
+		for (AtomicStats& stats : s_stats)
+		{
+			stats.lastFrameAllocations = stats.frameAllocations.exchange(0, std::memory_order_relaxed);
+			stats.lastFrameBytes = stats.frameBytes.exchange(0, std::memory_order_relaxed);
+		}
+	}
+
+	Memory::Stats Memory::GetStats(MemoryTag tag)
+	{
+		const AtomicStats& stats = s_stats[static_cast<size_t>(tag)];
+
+		Stats result;
+		result.allocations = stats.allocations.load(std::memory_order_relaxed);
+		result.liveBytes = stats.liveBytes.load(std::memory_order_relaxed);
+		result.peakBytes = stats.peakBytes.load(std::memory_order_relaxed);
+		result.frameAllocations = stats.lastFrameAllocations.load(std::memory_order_relaxed);
+		result.frameBytes = stats.lastFrameBytes.load(std::memory_order_relaxed);
+		return result;
+	}
+
+	const char* Memory::GetTagName(MemoryTag tag)
+	{
+		return s_tagNames[static_cast<size_t>(tag)];
+	}
+
+#pragma endregion
+
+
+#pragma region FrameArena
+
+	void FrameArena::Initialize(size_t capacityPerFrame)
+	{
+		m_capacity = capacityPerFrame;
+		for (Buffer& buffer : m_buffers)
+			buffer.data = static_cast<uint8_t*>(::operator new(capacityPerFrame));
+	}
+
+	void FrameArena::Shutdown()
+	{
+		for (Buffer& buffer : m_buffers)
+		{
+			Reset(buffer);
+			::operator delete(buffer.data);
+			buffer.data = nullptr;
+		}
+		m_capacity = 0;
+	}
+
+	void FrameArena::BeginFrame()
+	{
+		Memory::BeginFrame();
+
+		m_current = 1 - m_current;
+		Reset(m_buffers[m_current]);
+	}
+
+	void* FrameArena::Allocate(size_t size, size_t alignment, MemoryTag tag)
+	{
+		Buffer& buffer = m_buffers[m_current];
+
+		size_t offset = (buffer.used + alignment - 1) & ~(alignment - 1);
+		if (buffer.data && offset + size <= m_capacity)
+		{
+			buffer.used = offset + size;
+			m_peak = std::max(m_peak, buffer.used);
+			buffer.tagBytes[static_cast<size_t>(tag)] += size;
+			Memory::RecordAllocation(tag, size);
+			return buffer.data + offset;
+		}
+
+		// out of space: fall back to the heap for this frame, the peak tells how much to grow.
+		// operator new is aligned for any fundamental type, which covers what the arena hands out.
+		void* block = ::operator new(size);
+		buffer.overflow.push_back(block);
+		buffer.overflowBytes += size;
+		m_peak = std::max(m_peak, buffer.used + buffer.overflowBytes);
+		buffer.tagBytes[static_cast<size_t>(tag)] += size;
+		Memory::RecordAllocation(tag, size);
+		return block;
+	}
+
+	void FrameArena::Reset(Buffer& buffer)
+	{
+		for (size_t i = 0; i < static_cast<size_t>(MemoryTag::Count); i++)
+		{
+			if (buffer.tagBytes[i])
+				Memory::RecordFree(static_cast<MemoryTag>(i), buffer.tagBytes[i]);
+			buffer.tagBytes[i] = 0;
+		}
+
+		for (void* block : buffer.overflow)
+			::operator delete(block);
+		buffer.overflow.clear();
+		buffer.overflowBytes = 0;
+		buffer.used = 0;
+	}
+
+#pragma endregion
+
+}
@@ -0,0 +1,552 @@
+#include "asyncLog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr size_t s_slotPayload = 192;
+
+		enum SlotFlags : uint8_t
+		{
+			FlagBinary = 1 << 0,
+			FlagTruncated = 1 << 1,
+		};
+
+		// only the first slot of a message carries the header, the following ones only payload.
+		struct alignas(64) Slot
+		{
+			std::atomic<size_t> sequence;
+			int64_t time;
+			const char* fmt;
+			uint32_t thread;
+			uint16_t size;		// payload bytes of the whole message
+			uint8_t level;
+			uint8_t flags;
+			uint8_t slotCount;
+			char payload[s_slotPayload];
+		};
+
+		struct State
+		{
+			Log::Settings settings;
+
+			std::unique_ptr<Slot[]> slots;
+			size_t mask = 0;
+			alignas(64) std::atomic<size_t> tail { 0 };	// producers
+			alignas(64) std::atomic<size_t> head { 0 };	// consumer, advanced once the sinks got the message
+
+			std::atomic<bool> running { false };
+			std::atomic<uint64_t> written { 0 };
+			std::atomic<uint64_t> dropped { 0 };
+			std::atomic<uint64_t> truncated { 0 };
+
+			std::thread worker;
+			std::mutex mutex;
+			std::condition_variable condition;
+			bool stopWorker = false;
+
+			// worker only
+			std::ofstream file;
+			size_t fileSize = 0;
+		};
+
+		State s_state;
+		const std::chrono::steady_clock::time_point s_start = std::chrono::steady_clock::now();
+
+		constexpr const char* s_levelNames[] = { "TRACE", "INFO", "WARNING", "ERROR", "CRITICAL" };
+		static_assert(sizeof(s_levelNames) / sizeof(s_levelNames[0]) == static_cast<size_t>(LogLevel::Count), "missing log level name");
+
+
+		bool IsFloatConversion(char c) { return std::strchr("fFeEgGaA", c) != nullptr; }
+		bool IsUnsignedConversion(char c) { return std::strchr("uxXo", c) != nullptr; }
+
+		// printf over the packed arguments, the length modifiers of the format are ignored,
+		// the packed type decides. Returns the length written to out (always null terminated).
+		size_t FormatPacked(const char* fmt, const char* args, size_t argsSize, char* out, size_t outSize)
+		{
+			const char* argsEnd = args + argsSize;
+			size_t n = 0;
+
+			auto append = [&](const char* text, size_t length)
+			{
+				length = std::min(length, outSize - 1 - n);
+				std::memcpy(out + n, text, length);
+				n += length;
+			};
+
+			while (*fmt && n < outSize - 1)
+			{
+				if (*fmt != '%')
+				{
+					out[n++] = *fmt++;
+					continue;
+				}
+				if (fmt[1] == '%')
+				{
+					out[n++] = '%';
+					fmt += 2;
+					continue;
+				}
+
+				const char* start = fmt++;
+				char spec[32] = { '%' };
+				size_t s = 1;
+				while (*fmt && std::strchr("-+ #0", *fmt) && s < 8)
+					spec[s++] = *fmt++;
+				while (*fmt >= '0' && *fmt <= '9' && s < 16)
+					spec[s++] = *fmt++;
+				if (*fmt == '.')
+				{
+					spec[s++] = *fmt++;
+					while (*fmt >= '0' && *fmt <= '9' && s < 24)
+						spec[s++] = *fmt++;
+				}
+				while (*fmt && std::strchr("hlLzjtq", *fmt))
+					fmt++;
+
+				char conversion = *fmt;
+				if (!conversion)
+					break;
+				fmt++;
+
+				if (args >= argsEnd)
+				{
+					// missing argument, keep the specifier as text
+					append(start, fmt - start);
+					continue;
+				}
+
+				char text[512];
+				int length = 0;
+				const char single[] = { conversion, 0 };
+				const char longLong[] = { 'l', 'l', conversion, 0 };
+				Log::detail::ArgType type = static_cast<Log::detail::ArgType>(*args++);
+
+				auto print = [&](const char* suffix, auto value)
+				{
+					std::strcpy(spec + s, suffix);
+					length = std::snprintf(text, sizeof(text), spec, value);
+				};
+
+				switch (type)
+				{
+				case Log::detail::ArgSigned:
+				case Log::detail::ArgUnsigned:
+				{
+					uint64_t bits;
+					std::memcpy(&bits, args, sizeof(bits));
+					args += sizeof(bits);
+
+					if (IsFloatConversion(conversion))
+						print(single, type == Log::detail::ArgSigned ? static_cast<double>(static_cast<int64_t>(bits)) : static_cast<double>(bits));
+					else if (conversion == 'c')
+						print("c", static_cast<int>(bits));
+					else if (IsUnsignedConversion(conversion))
+						print(longLong, static_cast<unsigned long long>(bits));
+					else if (type == Log::detail::ArgSigned)
+						print("lld", static_cast<long long>(bits));
+					else
+						print("llu", static_cast<unsigned long long>(bits));
+					break;
+				}
+				case Log::detail::ArgDouble:
+				{
+					double value;
+					std::memcpy(&value, args, sizeof(value));
+					args += sizeof(value);
+
+					if (IsFloatConversion(conversion))
+						print(single, value);
+					else
+						print("f", value);
+					break;
+				}
+				case Log::detail::ArgPointer:
+				{
+					const void* value;
+					std::memcpy(&value, args, sizeof(value));
+					args += sizeof(value);
+					print("p", value);
+					break;
+				}
+				case Log::detail::ArgString:
+				{
+					uint16_t stringLength;
+					std::memcpy(&stringLength, args, sizeof(stringLength));
+					args += sizeof(stringLength);
+
+					// precision keeps snprintf inside the packed bytes, no terminator needed
+					if (std::strchr(spec, '.'))
+					{
+						print("s", std::string(args, stringLength).c_str());
+					}
+					else
+					{
+						std::strcpy(spec + s, ".*s");
+						length = std::snprintf(text, sizeof(text), spec, static_cast<int>(stringLength), args);
+					}
+					args += stringLength;
+					break;
+				}
+				default:
+					args = argsEnd;
+					break;
+				}
+
+				if (length > 0)
+					append(text, std::min(static_cast<size_t>(length), sizeof(text) - 1));
+			}
+
+			out[n] = 0;
+			return n;
+		}
+
+
+		uint32_t CurrentThreadId()
+		{
+			thread_local uint32_t id = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+			return id;
+		}
+
+		// reserves count consecutive slots, they are free once the last one is since the consumer frees in order.
+		bool Reserve(size_t count, size_t& position)
+		{
+			size_t pos = s_state.tail.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Slot& last = s_state.slots[(pos + count - 1) & s_state.mask];
+				size_t sequence = last.sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + count - 1);
+
+				if (diff == 0)
+				{
+					if (s_state.tail.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+					{
+						position = pos;
+						return true;
+					}
+				}
+				else if (diff < 0)
+				{
+					return false;	// full
+				}
+				else
+				{
+					pos = s_state.tail.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		void FormatLine(std::string& out, LogLevel level, int64_t time, uint32_t thread, const char* message, size_t length)
+		{
+			char prefix[64];
+			int prefixLength = std::snprintf(prefix, sizeof(prefix), "[%10.4f][%08x][%s] ", time / 1e9, thread, s_levelNames[static_cast<int>(level)]);
+			out.append(prefix, prefixLength);
+			out.append(message, length);
+			out.push_back('\n');
+		}
+
+
+		void OpenLogFile()
+		{
+			const Log::Settings& settings = s_state.settings;
+			std::filesystem::path path = std::filesystem::path(settings.directory) / (settings.fileName + ".log");
+
+			s_state.file.open(path, std::ios::binary | std::ios::trunc);
+			s_state.fileSize = 0;
+		}
+
+		void RotateLogFile()
+		{
+			const Log::Settings& settings = s_state.settings;
+			std::filesystem::path directory = settings.directory;
+			std::error_code ec;
+
+			s_state.file.close();
+
+			// game.log -> game.1.log -> ... -> game.<maxFiles>.log, the oldest is dropped
+			for (int i = settings.maxFiles - 1; i >= 1; i--)
+			{
+				std::filesystem::path from = directory / (settings.fileName + "." + std::to_string(i) + ".log");
+				std::filesystem::path to = directory / (settings.fileName + "." + std::to_string(i + 1) + ".log");
+				if (std::filesystem::exists(from, ec))
+					std::filesystem::rename(from, to, ec);
+			}
+			if (settings.maxFiles > 0)
+				std::filesystem::rename(directory / (settings.fileName + ".log"), directory / (settings.fileName + ".1.log"), ec);
+
+			OpenLogFile();
+		}
+
+		void WriteSinks(const std::string& batch)
+		{
+			if (batch.empty())
+				return;
+
+			if (s_state.settings.console)
+			{
+				std::fwrite(batch.data(), 1, batch.size(), stdout);
+				std::fflush(stdout);
+			}
+
+			if (s_state.settings.file && s_state.file.is_open())
+			{
+				if (s_state.fileSize + batch.size() > s_state.settings.maxFileSize && s_state.fileSize > 0)
+					RotateLogFile();
+
+				s_state.file.write(batch.data(), batch.size());
+				s_state.file.flush();
+				s_state.fileSize += batch.size();
+			}
+		}
+
+		// drains what is committed, returns false if there was nothing.
+		bool Drain(std::string& batch, char* message, char* text)
+		{
+			batch.clear();
+			size_t head = s_state.head.load(std::memory_order_relaxed);
+			size_t start = head;
+
+			while (batch.size() < (64 << 10))
+			{
+				Slot& first = s_state.slots[head & s_state.mask];
+				if (first.sequence.load(std::memory_order_acquire) != head + 1)
+					break;
+
+				// the producer publishes the first slot last, the whole chain is ready
+				size_t count = first.slotCount;
+				size_t size = first.size;
+				for (size_t i = 0, copied = 0; i < count; i++)
+				{
+					Slot& slot = s_state.slots[(head + i) & s_state.mask];
+					size_t bytes = std::min(s_slotPayload, size - copied);
+					std::memcpy(message + copied, slot.payload, bytes);
+					copied += bytes;
+				}
+
+				LogLevel level = static_cast<LogLevel>(first.level);
+				if (first.flags & FlagBinary)
+				{
+					size_t length = FormatPacked(first.fmt, message, size, text, Log::detail::s_maxMessageSize);
+					FormatLine(batch, level, first.time, first.thread, text, length);
+				}
+				else
+				{
+					FormatLine(batch, level, first.time, first.thread, message, size);
+				}
+
+				for (size_t i = 0; i < count; i++)
+					s_state.slots[(head + i) & s_state.mask].sequence.store(head + i + s_state.mask + 1, std::memory_order_release);
+				head += count;
+			}
+
+			if (head == start)
+				return false;
+
+			WriteSinks(batch);
+			s_state.head.store(head, std::memory_order_release);
+			return true;
+		}
+
+		void WorkerLoop()
+		{
+			std::string batch;
+			batch.reserve(64 << 10);
+			std::unique_ptr<char[]> message(new char[Log::detail::s_maxMessageSize]);
+			std::unique_ptr<char[]> text(new char[Log::detail::s_maxMessageSize]);
+
+			while (true)
+			{
+				if (Drain(batch, message.get(), text.get()))
+					continue;
+
+				std::unique_lock<std::mutex> lock(s_state.mutex);
+				if (s_state.stopWorker)
+					break;
+				s_state.condition.wait_for(lock, std::chrono::milliseconds(10));
+			}
+
+			// everything committed before Shutdown still goes out
+			while (Drain(batch, message.get(), text.get())) {}
+		}
+
+		void WriteSynchronous(LogLevel level, const char* fmt, const char* args, size_t argsSize)
+		{
+			char text[Log::detail::s_maxMessageSize];
+			size_t length = FormatPacked(fmt, args, argsSize, text, sizeof(text));
+
+			int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_start).count();
+			std::string line;
+			FormatLine(line, level, time, CurrentThreadId(), text, length);
+			std::fwrite(line.data(), 1, line.size(), stdout);
+		}
+	}
+
+
+	namespace Log
+	{
+
+		void Initialize(const Settings& settings)
+		{
+			if (s_state.running)
+				return;
+
+			s_state.settings = settings;
+
+			size_t capacity = 64;
+			while (capacity < settings.capacity)
+				capacity <<= 1;
+
+			if (s_state.mask + 1 != capacity)
+				s_state.slots.reset(new Slot[capacity]);
+			s_state.mask = capacity - 1;
+			for (size_t i = 0; i < capacity; i++)
+				s_state.slots[i].sequence.store(i, std::memory_order_relaxed);
+			s_state.tail = 0;
+			s_state.head = 0;
+
+			if (settings.file)
+			{
+				std::error_code ec;
+				std::filesystem::create_directories(settings.directory, ec);
+				RotateLogFile();	// keep the previous run as game.1.log
+			}
+
+			s_state.stopWorker = false;
+			s_state.worker = std::thread(WorkerLoop);
+			s_state.running = true;
+		}
+
+		void Shutdown()
+		{
+			if (!s_state.running)
+				return;
+
+			// producers from here on write synchronously
+			s_state.running = false;
+
+			{
+				std::lock_guard<std::mutex> lock(s_state.mutex);
+				s_state.stopWorker = true;
+			}
+			s_state.condition.notify_one();
+			if (s_state.worker.joinable())
+				s_state.worker.join();
+
+			// the ring is kept, a thread that passed the running check may still be writing into it
+			s_state.file.close();
+		}
+
+		void Flush()
+		{
+			if (!s_state.running)
+			{
+				std::fflush(stdout);
+				return;
+			}
+
+			size_t target = s_state.tail.load(std::memory_order_acquire);
+			s_state.condition.notify_one();
+			while (s_state.running && s_state.head.load(std::memory_order_acquire) < target)
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+
+		Stats GetStats()
+		{
+			Stats stats;
+			stats.written = s_state.written.load(std::memory_order_relaxed);
+			stats.dropped = s_state.dropped.load(std::memory_order_relaxed);
+			stats.truncated = s_state.truncated.load(std::memory_order_relaxed);
+			return stats;
+		}
+
+		const char* GetLevelName(LogLevel level)
+		{
+			return s_levelNames[static_cast<int>(level)];
+		}
+
+
+		void detail::Submit(LogLevel level, const char* fmt, const char* args, size_t argsSize, bool truncated)
+		{
+			if (!s_state.running)
+			{
+				WriteSynchronous(level, fmt, args, argsSize);
+				return;
+			}
+
+			bool binary = s_state.settings.binary;
+			char text[s_maxMessageSize];
+			const char* payload = args;
+			size_t size = argsSize;
+
+			// text mode formats here, binary mode leaves it to the worker
+			if (!binary)
+			{
+				size = FormatPacked(fmt, args, argsSize, text, sizeof(text));
+				payload = text;
+				truncated |= size == sizeof(text) - 1;
+			}
+
+			size_t count = std::max<size_t>(1, (size + s_slotPayload - 1) / s_slotPayload);
+			size_t position;
+			while (!Reserve(count, position))
+			{
+				if (level != LogLevel::Critical)
+				{
+					s_state.dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				s_state.condition.notify_one();
+				std::this_thread::yield();
+			}
+
+			Slot& first = s_state.slots[position & s_state.mask];
+			first.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_start).count();
+			first.fmt = fmt;
+			first.thread = CurrentThreadId();
+			first.size = static_cast<uint16_t>(size);
+			first.level = static_cast<uint8_t>(level);
+			first.flags = (binary ? FlagBinary : 0) | (truncated ? FlagTruncated : 0);
+			first.slotCount = static_cast<uint8_t>(count);
+
+			for (size_t i = 0, copied = 0; i < count; i++)
+			{
+				Slot& slot = s_state.slots[(position + i) & s_state.mask];
+				size_t bytes = std::min(s_slotPayload, size - copied);
+				std::memcpy(slot.payload, payload + copied, bytes);
+				copied += bytes;
+			}
+
+			// first slot last, the consumer reads the chain once it sees it
+			for (size_t i = count - 1; i > 0; i--)
+				s_state.slots[(position + i) & s_state.mask].sequence.store(position + i + 1, std::memory_order_release);
+			first.sequence.store(position + 1, std::memory_order_release);
+
+			s_state.written.fetch_add(1, std::memory_order_relaxed);
+			if (truncated)
+				s_state.truncated.fetch_add(1, std::memory_order_relaxed);
+
+			// errors should reach the sinks soon, critical ones before we return
+			if (level >= LogLevel::Error)
+				s_state.condition.notify_one();
+			if (level == LogLevel::Critical)
+				Flush();
+		}
+
+	}
+
+}
@@ -0,0 +1,488 @@
+#include "chunkedTilemap.h"
+
+#include "asyncLog.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr uint32_t s_mapMagic = 0x504D544C;	// "LTMP"
+		constexpr uint32_t s_mapVersion = 1;
+		constexpr uint32_t s_maxChunkSize = 1024;	// a loaded chunk holds chunkSize^2 tiles per layer
+
+		struct MapHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t width;
+			uint32_t height;
+			uint32_t chunkSize;
+			uint32_t layerCount;
+		};
+
+		void WriteVarint(std::vector<uint8_t>& out, uint32_t value)
+		{
+			while (value >= 0x80)
+			{
+				out.push_back(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+		{
+			value = 0;
+			for (int shift = 0; shift < 35 && data < end; shift += 7)
+			{
+				uint8_t byte = *data++;
+				value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return true;
+			}
+			return false;
+		}
+	}
+
+
+	void ChunkedTilemap::SetTileSetTexture(LittleEngine::Graphics::Texture& texture, LittleEngine::Graphics::TextureAtlas& atlas)
+	{
+		m_texture = &texture;
+		m_atlas = &atlas;
+	}
+
+	void ChunkedTilemap::SetTileSetAtlasKey(const std::vector<LittleEngine::Graphics::AtlasCoord>& key)
+	{
+		m_tileUVs.clear();
+		for (const LittleEngine::Graphics::AtlasCoord& coord : key)
+			m_tileUVs.push_back(m_atlas ? m_atlas->GetUV(coord.x, coord.y) : glm::vec4(0.f, 0.f, 1.f, 1.f));
+	}
+
+	bool ChunkedTilemap::Open(const std::string& path, const Settings& settings)
+	{
+		Close();
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			GAME_LOG_ERROR("ChunkedTilemap: could not open %s", path);
+			return false;
+		}
+
+		MapHeader header = {};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || header.magic != s_mapMagic || header.version != s_mapVersion || header.chunkSize == 0)
+		{
+			GAME_LOG_ERROR("ChunkedTilemap: invalid map file %s", path);
+			return false;
+		}
+
+		// the index has to fit in the rest of the file, a damaged header must not decide how much is allocated
+		std::streamoff indexStart = file.tellg();
+		file.seekg(0, std::ios::end);
+		uint64_t available = static_cast<uint64_t>(file.tellg() - indexStart);
+		file.seekg(indexStart);
+
+		uint64_t chunks = ((static_cast<uint64_t>(header.width) + header.chunkSize - 1) / header.chunkSize)
+			* ((static_cast<uint64_t>(header.height) + header.chunkSize - 1) / header.chunkSize);
+		if (header.chunkSize > s_maxChunkSize || header.layerCount == 0 || chunks == 0 || chunks > available / sizeof(IndexEntry) / header.layerCount
+			|| header.width > INT32_MAX || header.height > INT32_MAX)
+		{
+			GAME_LOG_ERROR("ChunkedTilemap: invalid map size in %s", path);
+			return false;
+		}
+
+		m_width = header.width;
+		m_height = header.height;
+		m_chunkSize = header.chunkSize;
+		m_layerCount = header.layerCount;
+		m_chunksX = (m_width + m_chunkSize - 1) / m_chunkSize;
+		m_chunksY = (m_height + m_chunkSize - 1) / m_chunkSize;
+
+		m_index.resize(static_cast<size_t>(m_layerCount) * m_chunksX * m_chunksY);
+		file.read(reinterpret_cast<char*>(m_index.data()), m_index.size() * sizeof(IndexEntry));
+		if (!file)
+		{
+			GAME_LOG_ERROR("ChunkedTilemap: truncated chunk index in %s", path);
+			m_index.clear();
+			return false;
+		}
+
+		m_path = path;
+		m_settings = settings;
+		m_open = true;
+
+		m_stopWorker = false;
+		m_worker = std::thread(&ChunkedTilemap::WorkerLoop, this);
+		return true;
+	}
+
+	void ChunkedTilemap::Close()
+	{
+		if (!m_open)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopWorker = true;
+			m_requests.clear();
+		}
+		m_condition.notify_one();
+		if (m_worker.joinable())
+			m_worker.join();
+
+		m_finished.clear();
+		m_inFlight.clear();
+
+		Memory::RecordFree(MemoryTag::Streaming, m_residentBytes);
+		m_resident.clear();
+		m_residentBytes = 0;
+		m_index.clear();
+		m_open = false;
+	}
+
+
+	void ChunkedTilemap::Update(glm::vec2 viewMin, glm::vec2 viewMax)
+	{
+		if (!m_open)
+			return;
+
+		m_frame++;
+
+		std::vector<std::pair<uint64_t, Chunk>> finished;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			finished.swap(m_finished);
+		}
+		for (auto& [key, chunk] : finished)
+		{
+			chunk.lastUsed = m_frame;
+			Memory::RecordAllocation(MemoryTag::Streaming, chunk.bytes);
+			m_residentBytes += chunk.bytes;
+
+			Chunk& resident = m_resident[key];
+			if (resident.bytes)
+			{
+				// loaded twice, the old copy is replaced
+				Memory::RecordFree(MemoryTag::Streaming, resident.bytes);
+				m_residentBytes -= resident.bytes;
+			}
+			resident = std::move(chunk);
+			m_loaded++;
+		}
+
+		glm::ivec4 range = GetChunkRange(viewMin, viewMax, m_settings.loadMargin);
+		glm::vec2 center = (viewMin + viewMax) * 0.5f;
+		float chunkWorld = m_chunkSize * m_settings.tileSize;
+
+		std::vector<std::pair<float, uint64_t>> missing;
+		for (int cy = range.y; cy <= range.w; cy++)
+		{
+			for (int cx = range.x; cx <= range.z; cx++)
+			{
+				uint64_t key = Key(cx, cy);
+				auto it = m_resident.find(key);
+				if (it != m_resident.end())
+				{
+					it->second.lastUsed = m_frame;
+					continue;
+				}
+
+				glm::vec2 chunkCenter = m_settings.origin + (glm::vec2(cx, cy) + 0.5f) * chunkWorld;
+				missing.push_back({ glm::length(chunkCenter - center), key });
+			}
+		}
+		std::sort(missing.begin(), missing.end());
+
+		// requests that left the range are dropped by rebuilding the queue.
+		// chunks the worker finished since the swap above are not requested again.
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_requests.clear();
+			for (const auto& [distance, key] : missing)
+			{
+				if (m_inFlight.count(key) || m_resident.count(key))
+					continue;
+				bool done = false;
+				for (const auto& entry : m_finished)
+					done |= entry.first == key;
+				if (!done)
+					m_requests.push_back(key);
+			}
+		}
+		if (!missing.empty())
+			m_condition.notify_one();
+
+		if (m_residentBytes > m_settings.memoryBudget)
+			Evict(range);
+	}
+
+	void ChunkedTilemap::Draw(SpriteBatch& batch, glm::vec2 viewMin, glm::vec2 viewMax)
+	{
+		if (!m_open || !m_texture)
+			return;
+
+		glm::ivec4 range = GetChunkRange(viewMin, viewMax, 0);
+
+		// layer by layer so upper layers are drawn over every chunk of the lower ones
+		for (uint32_t layer = 0; layer < m_layerCount; layer++)
+		{
+			for (int cy = range.y; cy <= range.w; cy++)
+			{
+				for (int cx = range.x; cx <= range.z; cx++)
+				{
+					auto it = m_resident.find(Key(cx, cy));
+					if (it == m_resident.end())
+						continue;
+
+					const std::vector<QuadInstance>& instances = it->second.instances[layer];
+					if (!instances.empty())
+						batch.DrawInstances(instances.data(), instances.size(), *m_texture);
+				}
+			}
+		}
+	}
+
+	uint32_t ChunkedTilemap::GetTile(int layer, int x, int y) const
+	{
+		if (!m_open || layer < 0 || layer >= static_cast<int>(m_layerCount) || x < 0 || y < 0 || x >= static_cast<int>(m_width) || y >= static_cast<int>(m_height))
+			return s_emptyTile;
+
+		auto it = m_resident.find(Key(x / m_chunkSize, y / m_chunkSize));
+		if (it == m_resident.end())
+			return s_emptyTile;
+
+		size_t tilesPerLayer = static_cast<size_t>(m_chunkSize) * m_chunkSize;
+		return it->second.tiles[layer * tilesPerLayer + (y % m_chunkSize) * m_chunkSize + (x % m_chunkSize)];
+	}
+
+	ChunkedTilemap::Stats ChunkedTilemap::GetStats()
+	{
+		Stats stats;
+		stats.residentChunks = static_cast<int>(m_resident.size());
+		stats.residentBytes = m_residentBytes;
+		stats.loadedChunks = m_loaded;
+		stats.evictedChunks = m_evicted;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		stats.pendingChunks = static_cast<int>(m_requests.size() + m_inFlight.size() + m_finished.size());
+		return stats;
+	}
+
+
+	glm::ivec4 ChunkedTilemap::GetChunkRange(glm::vec2 viewMin, glm::vec2 viewMax, int margin) const
+	{
+		float chunkWorld = m_chunkSize * m_settings.tileSize;
+		glm::vec2 min = (viewMin - m_settings.origin) / chunkWorld;
+		glm::vec2 max = (viewMax - m_settings.origin) / chunkWorld;
+
+		glm::ivec4 range;
+		range.x = std::max(static_cast<int>(std::floor(min.x)) - margin, 0);
+		range.y = std::max(static_cast<int>(std::floor(min.y)) - margin, 0);
+		range.z = std::min(static_cast<int>(std::floor(max.x)) + margin, static_cast<int>(m_chunksX) - 1);
+		range.w = std::min(static_cast<int>(std::floor(max.y)) + margin, static_cast<int>(m_chunksY) - 1);
+		return range;
+	}
+
+	void ChunkedTilemap::WorkerLoop()
+	{
+		std::ifstream file(m_path, std::ios::binary);
+
+		while (true)
+		{
+			uint64_t key;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_stopWorker || !m_requests.empty(); });
+				if (m_stopWorker)
+					return;
+
+				key = m_requests.front();
+				m_requests.pop_front();
+				m_inFlight.insert(key);
+			}
+
+			Chunk chunk;
+			bool ok = LoadChunk(file, key, chunk);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_inFlight.erase(key);
+			if (ok)
+				m_finished.push_back({ key, std::move(chunk) });
+		}
+	}
+
+	bool ChunkedTilemap::LoadChunk(std::ifstream& file, uint64_t key, Chunk& chunk)
+	{
+		int cx = static_cast<int>(key & 0xFFFFFFFF);
+		int cy = static_cast<int>(key >> 32);
+		size_t chunkIndex = static_cast<size_t>(cy) * m_chunksX + cx;
+		size_t chunkCount = static_cast<size_t>(m_chunksX) * m_chunksY;
+		size_t tilesPerLayer = static_cast<size_t>(m_chunkSize) * m_chunkSize;
+
+		chunk.tiles.assign(tilesPerLayer * m_layerCount, s_emptyTile);
+		chunk.instances.resize(m_layerCount);
+
+		std::vector<uint8_t> compressed;
+		for (uint32_t layer = 0; layer < m_layerCount; layer++)
+		{
+			const IndexEntry& entry = m_index[layer * chunkCount + chunkIndex];
+			if (entry.offset == 0)
+				continue;
+
+			compressed.resize(entry.size);
+			file.clear();
+			file.seekg(static_cast<std::streamoff>(entry.offset));
+			file.read(reinterpret_cast<char*>(compressed.data()), compressed.size());
+			if (!file)
+			{
+				GAME_LOG_ERROR("ChunkedTilemap: could not read chunk from %s", m_path);
+				return false;
+			}
+
+			uint32_t* tiles = chunk.tiles.data() + layer * tilesPerLayer;
+			const uint8_t* data = compressed.data();
+			const uint8_t* end = data + compressed.size();
+			size_t written = 0;
+			while (data < end && written < tilesPerLayer)
+			{
+				uint32_t run, tile;
+				if (!ReadVarint(data, end, run) || !ReadVarint(data, end, tile))
+					break;
+				run = static_cast<uint32_t>(std::min<size_t>(run, tilesPerLayer - written));
+				std::fill(tiles + written, tiles + written + run, tile);
+				written += run;
+			}
+
+			// sprite records are built here so drawing a chunk is a single copy
+			std::vector<QuadInstance>& instances = chunk.instances[layer];
+			for (size_t i = 0; i < tilesPerLayer; i++)
+			{
+				uint32_t tile = tiles[i];
+				if (tile == s_emptyTile || tile >= m_tileUVs.size())
+					continue;
+
+				glm::vec2 pos = m_settings.origin + glm::vec2(cx * m_chunkSize + i % m_chunkSize, cy * m_chunkSize + i / m_chunkSize) * m_settings.tileSize;
+				const glm::vec4& uv = m_tileUVs[tile];
+
+				QuadInstance q = {};
+				q.rect = { pos.x, pos.y, m_settings.tileSize, m_settings.tileSize };
+				q.uv[0] = static_cast<uint16_t>(std::clamp(uv.x, 0.f, 1.f) * 65535.f + 0.5f);
+				q.uv[1] = static_cast<uint16_t>(std::clamp(uv.y, 0.f, 1.f) * 65535.f + 0.5f);
+				q.uv[2] = static_cast<uint16_t>(std::clamp(uv.z, 0.f, 1.f) * 65535.f + 0.5f);
+				q.uv[3] = static_cast<uint16_t>(std::clamp(uv.w, 0.f, 1.f) * 65535.f + 0.5f);
+				q.color[0] = q.color[1] = q.color[2] = q.color[3] = 255;
+				instances.push_back(q);
+			}
+			instances.shrink_to_fit();
+			chunk.bytes += instances.capacity() * sizeof(QuadInstance);
+		}
+
+		chunk.bytes += chunk.tiles.capacity() * sizeof(uint32_t);
+		return true;
+	}
+
+	void ChunkedTilemap::Evict(const glm::ivec4& keepRange)
+	{
+		std::vector<std::pair<uint64_t, uint64_t>> candidates;	// lastUsed, key
+		for (const auto& [key, chunk] : m_resident)
+		{
+			int cx = static_cast<int>(key & 0xFFFFFFFF);
+			int cy = static_cast<int>(key >> 32);
+			if (cx < keepRange.x || cx > keepRange.z || cy < keepRange.y || cy > keepRange.w)
+				candidates.push_back({ chunk.lastUsed, key });
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		for (const auto& [lastUsed, key] : candidates)
+		{
+			if (m_residentBytes <= m_settings.memoryBudget)
+				break;
+
+			auto it = m_resident.find(key);
+			m_residentBytes -= it->second.bytes;
+			Memory::RecordFree(MemoryTag::Streaming, it->second.bytes);
+			m_resident.erase(it);
+			m_evicted++;
+		}
+	}
+
+
+	bool ChunkedTilemap::WriteMapFile(const std::string& path, uint32_t width, uint32_t height, uint32_t chunkSize, const std::vector<std::vector<uint32_t>>& layers)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file || chunkSize == 0 || chunkSize > s_maxChunkSize)
+			return false;
+
+		MapHeader header = { s_mapMagic, s_mapVersion, width, height, chunkSize, static_cast<uint32_t>(layers.size()) };
+		uint32_t chunksX = (width + chunkSize - 1) / chunkSize;
+		uint32_t chunksY = (height + chunkSize - 1) / chunkSize;
+
+		std::vector<IndexEntry> index(layers.size() * chunksX * chunksY, IndexEntry{ 0, 0, 0 });
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+
+		uint64_t offset = sizeof(header) + index.size() * sizeof(IndexEntry);
+		std::vector<uint8_t> encoded;
+
+		for (size_t layer = 0; layer < layers.size(); layer++)
+		{
+			const std::vector<uint32_t>& tiles = layers[layer];
+
+			for (uint32_t cy = 0; cy < chunksY; cy++)
+			{
+				for (uint32_t cx = 0; cx < chunksX; cx++)
+				{
+					encoded.clear();
+					bool empty = true;
+					uint32_t current = 0;
+					uint32_t run = 0;
+
+					for (uint32_t ty = 0; ty < chunkSize; ty++)
+					{
+						for (uint32_t tx = 0; tx < chunkSize; tx++)
+						{
+							uint32_t x = cx * chunkSize + tx;
+							uint32_t y = cy * chunkSize + ty;
+							uint32_t tile = (x < width && y < height) ? tiles[static_cast<size_t>(y) * width + x] : s_emptyTile;
+							empty &= tile == s_emptyTile;
+
+							if (run && tile == current)
+							{
+								run++;
+								continue;
+							}
+							if (run)
+							{
+								WriteVarint(encoded, run);
+								WriteVarint(encoded, current);
+							}
+							current = tile;
+							run = 1;
+						}
+					}
+					WriteVarint(encoded, run);
+					WriteVarint(encoded, current);
+
+					if (empty)
+						continue;
+
+					index[layer * chunksX * chunksY + cy * chunksX + cx] = { offset, static_cast<uint32_t>(encoded.size()), 0 };
+					file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+					offset += encoded.size();
+				}
+			}
+		}
+
+		file.seekp(sizeof(header));
+		file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+		return static_cast<bool>(file);
+	}
+
+}
@@ -0,0 +1,1056 @@
+#include "collisionWorld.h"
+#include "asyncLog.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+
+namespace game
+{
+
+	// local vertices and normals are counter clockwise, circles only use radius
+	struct CollisionShape
+	{
+		ShapeType type = ShapeType::Circle;
+		glm::vec2 position = { 0.f, 0.f };
+		float radius = 0.f;
+		const glm::vec2* vertices = nullptr;
+		const glm::vec2* normals = nullptr;
+		int count = 0;
+	};
+
+	namespace
+	{
+		using Shape = CollisionShape;
+
+		constexpr size_t s_narrowphaseGrain = 256;
+		constexpr float s_flipTolerance = 0.0005f;
+
+		float Cross(glm::vec2 a, glm::vec2 b)
+		{
+			return a.x * b.y - a.y * b.x;
+		}
+
+		bool BoundsOverlap(glm::vec4 a, glm::vec4 b)
+		{
+			return a.x <= b.z && b.x <= a.z && a.y <= b.w && b.y <= a.w;
+		}
+
+		// monotone chain, counter clockwise without collinear points
+		std::vector<glm::vec2> ConvexHull(std::vector<glm::vec2> points)
+		{
+			std::sort(points.begin(), points.end(), [](glm::vec2 a, glm::vec2 b)
+			{
+				return a.x < b.x || (a.x == b.x && a.y < b.y);
+			});
+			points.erase(std::unique(points.begin(), points.end()), points.end());
+			if (points.size() < 3)
+				return {};
+
+			std::vector<glm::vec2> hull(points.size() * 2);
+			size_t k = 0;
+			for (size_t i = 0; i < points.size(); i++)
+			{
+				while (k >= 2 && Cross(hull[k - 1] - hull[k - 2], points[i] - hull[k - 2]) <= 0.f)
+					k--;
+				hull[k++] = points[i];
+			}
+			for (size_t i = points.size() - 1, lower = k + 1; i > 0; i--)
+			{
+				while (k >= lower && Cross(hull[k - 1] - hull[k - 2], points[i - 1] - hull[k - 2]) <= 0.f)
+					k--;
+				hull[k++] = points[i - 1];
+			}
+			hull.resize(k - 1);
+			if (hull.size() < 3)
+				return {};
+			return hull;
+		}
+
+		std::vector<glm::vec2> EdgeNormals(const std::vector<glm::vec2>& vertices)
+		{
+			std::vector<glm::vec2> normals(vertices.size());
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				glm::vec2 e = vertices[(i + 1) % vertices.size()] - vertices[i];
+				normals[i] = glm::normalize(glm::vec2(e.y, -e.x));
+			}
+			return normals;
+		}
+
+		void BoxVertices(glm::vec2 half, glm::vec2* vertices, glm::vec2* normals)
+		{
+			vertices[0] = { -half.x, -half.y };
+			vertices[1] = { half.x, -half.y };
+			vertices[2] = { half.x, half.y };
+			vertices[3] = { -half.x, half.y };
+			normals[0] = { 0.f, -1.f };
+			normals[1] = { 1.f, 0.f };
+			normals[2] = { 0.f, 1.f };
+			normals[3] = { -1.f, 0.f };
+		}
+
+		glm::vec4 ShapeBounds(const Shape& s)
+		{
+			if (s.type == ShapeType::Circle)
+				return { s.position.x - s.radius, s.position.y - s.radius, s.position.x + s.radius, s.position.y + s.radius };
+
+			glm::vec2 min = s.vertices[0];
+			glm::vec2 max = s.vertices[0];
+			for (int i = 1; i < s.count; i++)
+			{
+				min = glm::min(min, s.vertices[i]);
+				max = glm::max(max, s.vertices[i]);
+			}
+			return { s.position.x + min.x, s.position.y + min.y, s.position.x + max.x, s.position.y + max.y };
+		}
+
+	#pragma region narrowphase
+
+		bool CollideCircles(const Shape& a, const Shape& b, Contact& c)
+		{
+			glm::vec2 d = b.position - a.position;
+			float radius = a.radius + b.radius;
+			float dist2 = glm::dot(d, d);
+			if (dist2 > radius * radius)
+				return false;
+
+			float dist = std::sqrt(dist2);
+			c.normal = dist > 1e-6f ? d / dist : glm::vec2(0.f, 1.f);
+			c.depth = radius - dist;
+			c.points[0] = a.position + c.normal * (a.radius - c.depth * 0.5f);
+			c.pointCount = 1;
+			return true;
+		}
+
+		bool CollidePolygonCircle(const Shape& a, const Shape& b, Contact& c)
+		{
+			glm::vec2 center = b.position - a.position;
+
+			// face of max separation
+			float separation = -FLT_MAX;
+			int edge = 0;
+			for (int i = 0; i < a.count; i++)
+			{
+				float s = glm::dot(a.normals[i], center - a.vertices[i]);
+				if (s > b.radius)
+					return false;
+				if (s > separation)
+				{
+					separation = s;
+					edge = i;
+				}
+			}
+
+			glm::vec2 v1 = a.vertices[edge];
+			glm::vec2 v2 = a.vertices[(edge + 1) % a.count];
+
+			// center inside the polygon
+			if (separation < 1e-6f)
+			{
+				c.normal = a.normals[edge];
+				c.depth = b.radius - separation;
+				c.points[0] = a.position + center - c.normal * separation;
+				c.pointCount = 1;
+				return true;
+			}
+
+			// face or vertex region
+			glm::vec2 closest;
+			if (glm::dot(center - v1, v2 - v1) <= 0.f)
+				closest = v1;
+			else if (glm::dot(center - v2, v1 - v2) <= 0.f)
+				closest = v2;
+			else
+				closest = center - a.normals[edge] * separation;
+
+			glm::vec2 d = center - closest;
+			float dist2 = glm::dot(d, d);
+			if (dist2 > b.radius * b.radius)
+				return false;
+
+			float dist = std::sqrt(dist2);
+			c.normal = dist > 1e-6f ? d / dist : a.normals[edge];
+			c.depth = b.radius - dist;
+			c.points[0] = a.position + closest;
+			c.pointCount = 1;
+			return true;
+		}
+
+		// the edge of a with the largest separation from b
+		float MaxSeparation(const Shape& a, const Shape& b, int& edge)
+		{
+			glm::vec2 offset = b.position - a.position;
+			float best = -FLT_MAX;
+			for (int i = 0; i < a.count; i++)
+			{
+				float s = FLT_MAX;
+				for (int j = 0; j < b.count; j++)
+					s = std::min(s, glm::dot(a.normals[i], b.vertices[j] + offset - a.vertices[i]));
+				if (s > best)
+				{
+					best = s;
+					edge = i;
+				}
+			}
+			return best;
+		}
+
+		// keeps the part of the segment with dot(normal, p) <= offset
+		int ClipSegment(const glm::vec2 in[2], glm::vec2 out[2], glm::vec2 normal, float offset)
+		{
+			int count = 0;
+			float d0 = glm::dot(normal, in[0]) - offset;
+			float d1 = glm::dot(normal, in[1]) - offset;
+			if (d0 <= 0.f)
+				out[count++] = in[0];
+			if (d1 <= 0.f)
+				out[count++] = in[1];
+			if (d0 * d1 < 0.f)
+				out[count++] = in[0] + (in[1] - in[0]) * (d0 / (d0 - d1));
+			return count;
+		}
+
+		// SAT on the edge normals of both polygons, then the incident edge is clipped against the reference face
+		bool CollidePolygons(const Shape& a, const Shape& b, Contact& c)
+		{
+			int edgeA = 0;
+			float separationA = MaxSeparation(a, b, edgeA);
+			if (separationA > 0.f)
+				return false;
+
+			int edgeB = 0;
+			float separationB = MaxSeparation(b, a, edgeB);
+			if (separationB > 0.f)
+				return false;
+
+			const Shape* ref = &a;
+			const Shape* inc = &b;
+			int edge = edgeA;
+			bool flip = false;
+			if (separationB > separationA + s_flipTolerance)
+			{
+				ref = &b;
+				inc = &a;
+				edge = edgeB;
+				flip = true;
+			}
+
+			glm::vec2 normal = ref->normals[edge];
+			glm::vec2 v1 = ref->position + ref->vertices[edge];
+			glm::vec2 v2 = ref->position + ref->vertices[(edge + 1) % ref->count];
+
+			// the incident edge faces the reference normal the most
+			int incEdge = 0;
+			float minDot = FLT_MAX;
+			for (int i = 0; i < inc->count; i++)
+			{
+				float d = glm::dot(inc->normals[i], normal);
+				if (d < minDot)
+				{
+					minDot = d;
+					incEdge = i;
+				}
+			}
+			glm::vec2 incident[2] = {
+				inc->position + inc->vertices[incEdge],
+				inc->position + inc->vertices[(incEdge + 1) % inc->count] };
+
+			glm::vec2 tangent = glm::normalize(v2 - v1);
+			glm::vec2 clip1[2];
+			glm::vec2 clip2[2];
+			if (ClipSegment(incident, clip1, -tangent, -glm::dot(tangent, v1)) < 2)
+				return false;
+			if (ClipSegment(clip1, clip2, tangent, glm::dot(tangent, v2)) < 2)
+				return false;
+
+			c.pointCount = 0;
+			c.depth = 0.f;
+			for (glm::vec2 p : clip2)
+			{
+				float s = glm::dot(normal, p - v1);
+				if (s <= 0.f)
+				{
+					c.points[c.pointCount++] = p;
+					c.depth = std::max(c.depth, -s);
+				}
+			}
+			if (c.pointCount == 0)
+				return false;
+
+			c.normal = flip ? -normal : normal;
+			return true;
+		}
+
+		// normal points from a to b
+		bool Collide(const Shape& a, const Shape& b, Contact& c)
+		{
+			bool circleA = a.type == ShapeType::Circle;
+			bool circleB = b.type == ShapeType::Circle;
+			if (circleA && circleB)
+				return CollideCircles(a, b, c);
+			if (circleB)
+				return CollidePolygonCircle(a, b, c);
+			if (circleA)
+			{
+				if (!CollidePolygonCircle(b, a, c))
+					return false;
+				c.normal = -c.normal;
+				return true;
+			}
+			return CollidePolygons(a, b, c);
+		}
+
+		// rays starting inside a shape do not hit it
+		bool RaycastShape(const Shape& s, glm::vec2 origin, glm::vec2 dir, float maxDistance, float& t, glm::vec2& normal)
+		{
+			glm::vec2 p = origin - s.position;
+
+			if (s.type == ShapeType::Circle)
+			{
+				float b = glm::dot(p, dir);
+				float c = glm::dot(p, p) - s.radius * s.radius;
+				if (c <= 0.f || b > 0.f)
+					return false;
+				float disc = b * b - c;
+				if (disc < 0.f)
+					return false;
+				t = -b - std::sqrt(disc);
+				if (t > maxDistance)
+					return false;
+				normal = glm::normalize(p + dir * t);
+				return true;
+			}
+
+			float lower = 0.f;
+			float upper = maxDistance;
+			int index = -1;
+			for (int i = 0; i < s.count; i++)
+			{
+				float numerator = glm::dot(s.normals[i], s.vertices[i] - p);
+				float denominator = glm::dot(s.normals[i], dir);
+				if (denominator == 0.f)
+				{
+					if (numerator < 0.f)
+						return false;
+				}
+				else if (denominator < 0.f && numerator < lower * denominator)
+				{
+					lower = numerator / denominator;
+					index = i;
+				}
+				else if (denominator > 0.f && numerator < upper * denominator)
+				{
+					upper = numerator / denominator;
+				}
+
+				if (upper < lower)
+					return false;
+			}
+			if (index < 0)
+				return false;
+
+			t = lower;
+			normal = s.normals[index];
+			return true;
+		}
+
+	#pragma endregion
+
+	}
+
+	#pragma region colliders
+
+	ColliderHandle CollisionWorld::CreateCircle(const ColliderDesc& desc, float radius)
+	{
+		return Create(desc, ShapeType::Circle, radius, { radius, radius }, {});
+	}
+
+	ColliderHandle CollisionWorld::CreateBox(const ColliderDesc& desc, glm::vec2 halfExtents)
+	{
+		std::vector<glm::vec2> vertices(4);
+		glm::vec2 normals[4];
+		BoxVertices(halfExtents, vertices.data(), normals);
+		return Create(desc, ShapeType::Box, 0.f, halfExtents, std::move(vertices));
+	}
+
+	ColliderHandle CollisionWorld::CreatePolygon(const ColliderDesc& desc, const std::vector<glm::vec2>& vertices)
+	{
+		std::vector<glm::vec2> hull = ConvexHull(vertices);
+		if (hull.empty())
+		{
+			GAME_LOG_WARNING("Collision polygon with %d vertices has no area", static_cast<int>(vertices.size()));
+			return {};
+		}
+		return Create(desc, ShapeType::Polygon, 0.f, { 0.f, 0.f }, std::move(hull));
+	}
+
+	ColliderHandle CollisionWorld::CreatePolygon(const LittleEngine::Math::Polygon& polygon, ColliderDesc desc)
+	{
+		if (polygon.vertices.empty())
+			return CreatePolygon(desc, polygon.vertices);
+
+		glm::vec2 center = { 0.f, 0.f };
+		for (glm::vec2 v : polygon.vertices)
+			center += v;
+		center /= static_cast<float>(polygon.vertices.size());
+
+		std::vector<glm::vec2> local;
+		local.reserve(polygon.vertices.size());
+		for (glm::vec2 v : polygon.vertices)
+			local.push_back(v - center);
+
+		desc.position = center;
+		return CreatePolygon(desc, local);
+	}
+
+	ColliderHandle CollisionWorld::Create(const ColliderDesc& desc, ShapeType type, float radius, glm::vec2 halfExtents, std::vector<glm::vec2> vertices)
+	{
+		uint32_t slot = 0;
+		if (!m_freeSlots.empty())
+		{
+			slot = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		else
+		{
+			slot = static_cast<uint32_t>(m_slots.size());
+			m_slots.emplace_back();
+		}
+
+		uint32_t dense = static_cast<uint32_t>(m_positions.size());
+		m_positions.push_back(desc.position);
+		m_bounds.emplace_back();
+		m_types.push_back(type);
+		m_radii.push_back(radius);
+		m_halfExtents.push_back(halfExtents);
+		m_normals.push_back(EdgeNormals(vertices));
+		m_vertices.push_back(std::move(vertices));
+		m_layers.push_back(desc.layers);
+		m_masks.push_back(desc.mask);
+		m_userData.push_back(desc.userData);
+		m_static.push_back(desc.isStatic ? 1 : 0);
+		m_denseToSlot.push_back(slot);
+
+		m_slots[slot].dense = dense;
+		m_slots[slot].alive = true;
+		UpdateBounds(dense);
+
+		return { slot, m_slots[slot].generation };
+	}
+
+	void CollisionWorld::Destroy(ColliderHandle handle)
+	{
+		int found = GetDense(handle);
+		if (found < 0)
+			return;
+
+		uint32_t dense = static_cast<uint32_t>(found);
+		uint32_t last = static_cast<uint32_t>(m_positions.size() - 1);
+
+		auto swapRemove = [&](auto& values)
+		{
+			if (dense != last)
+				values[dense] = std::move(values[last]);
+			values.pop_back();
+		};
+		swapRemove(m_positions);
+		swapRemove(m_bounds);
+		swapRemove(m_types);
+		swapRemove(m_radii);
+		swapRemove(m_halfExtents);
+		swapRemove(m_vertices);
+		swapRemove(m_normals);
+		swapRemove(m_layers);
+		swapRemove(m_masks);
+		swapRemove(m_userData);
+		swapRemove(m_static);
+		swapRemove(m_denseToSlot);
+		if (dense != last)
+			m_slots[m_denseToSlot[dense]].dense = dense;
+
+		// the broadphase is only rebuilt by Step, queries until then must not see the old indices
+		for (CellEntry& entry : m_entries)
+		{
+			if (entry.dense == dense)
+				entry.dense = s_removedEntry;
+			else if (entry.dense == last)
+				entry.dense = dense;
+		}
+
+		Slot& slot = m_slots[handle.index];
+		slot.alive = false;
+		if (++slot.generation == 0)
+			slot.generation = 1;
+		m_freeSlots.push_back(handle.index);
+	}
+
+	bool CollisionWorld::IsAlive(ColliderHandle handle) const
+	{
+		return GetDense(handle) >= 0;
+	}
+
+	glm::vec2 CollisionWorld::GetPosition(ColliderHandle handle) const
+	{
+		int dense = GetDense(handle);
+		return dense >= 0 ? m_positions[dense] : glm::vec2(0.f, 0.f);
+	}
+
+	void CollisionWorld::SetPosition(ColliderHandle handle, glm::vec2 position)
+	{
+		int dense = GetDense(handle);
+		if (dense < 0)
+			return;
+		m_positions[dense] = position;
+		UpdateBounds(dense);
+	}
+
+	void CollisionWorld::Move(ColliderHandle handle, glm::vec2 delta)
+	{
+		int dense = GetDense(handle);
+		if (dense < 0)
+			return;
+		m_positions[dense] += delta;
+		UpdateBounds(dense);
+	}
+
+	uint32_t CollisionWorld::GetUserData(ColliderHandle handle) const
+	{
+		int dense = GetDense(handle);
+		return dense >= 0 ? m_userData[dense] : 0;
+	}
+
+	int CollisionWorld::GetDense(ColliderHandle handle) const
+	{
+		if (handle.index >= m_slots.size())
+			return -1;
+
+		const Slot& slot = m_slots[handle.index];
+		if (!slot.alive || slot.generation != handle.generation)
+			return -1;
+
+		return static_cast<int>(slot.dense);
+	}
+
+	ColliderHandle CollisionWorld::GetHandle(uint32_t dense) const
+	{
+		uint32_t slot = m_denseToSlot[dense];
+		return { slot, m_slots[slot].generation };
+	}
+
+	void CollisionWorld::UpdateBounds(uint32_t dense)
+	{
+		m_bounds[dense] = ShapeBounds(GetShape(dense));
+	}
+
+	CollisionShape CollisionWorld::GetShape(uint32_t dense, glm::vec2 offset) const
+	{
+		Shape s;
+		s.type = m_types[dense];
+		s.position = m_positions[dense] + offset;
+		s.radius = m_radii[dense];
+		s.vertices = m_vertices[dense].data();
+		s.normals = m_normals[dense].data();
+		s.count = static_cast<int>(m_vertices[dense].size());
+		return s;
+	}
+
+	#pragma endregion
+
+	#pragma region tiles
+
+	void CollisionWorld::SetTileGrid(const unsigned int* tiles, int width, int height, glm::vec2 origin, float tileSize,
+		const std::vector<unsigned int>& solidTiles)
+	{
+		m_tileGridSize = { width, height };
+		m_tileOrigin = origin;
+		m_tileSize = tileSize;
+		BoxVertices(glm::vec2(tileSize * 0.5f), m_tileVertices, m_tileNormals);
+
+		m_solid.assign(static_cast<size_t>(width) * height, 0);
+		for (size_t i = 0; i < m_solid.size(); i++)
+			m_solid[i] = std::find(solidTiles.begin(), solidTiles.end(), tiles[i]) != solidTiles.end();
+	}
+
+	void CollisionWorld::ClearTileGrid()
+	{
+		m_solid.clear();
+		m_tileGridSize = { 0, 0 };
+	}
+
+	bool CollisionWorld::IsSolidTile(int x, int y) const
+	{
+		if (x < 0 || y < 0 || x >= m_tileGridSize.x || y >= m_tileGridSize.y)
+			return false;
+		return m_solid[static_cast<size_t>(y) * m_tileGridSize.x + x] != 0;
+	}
+
+	CollisionShape CollisionWorld::GetTileShape(int x, int y) const
+	{
+		Shape s;
+		s.type = ShapeType::Box;
+		s.position = m_tileOrigin + (glm::vec2(x, y) + 0.5f) * m_tileSize;
+		s.vertices = m_tileVertices;
+		s.normals = m_tileNormals;
+		s.count = 4;
+		return s;
+	}
+
+	template<typename Fn>
+	bool CollisionWorld::ForEachSolidTile(glm::vec4 bounds, Fn&& fn) const
+	{
+		if (m_solid.empty())
+			return false;
+
+		int x0 = std::max(static_cast<int>(std::floor((bounds.x - m_tileOrigin.x) / m_tileSize)), 0);
+		int y0 = std::max(static_cast<int>(std::floor((bounds.y - m_tileOrigin.y) / m_tileSize)), 0);
+		int x1 = std::min(static_cast<int>(std::floor((bounds.z - m_tileOrigin.x) / m_tileSize)), m_tileGridSize.x - 1);
+		int y1 = std::min(static_cast<int>(std::floor((bounds.w - m_tileOrigin.y) / m_tileSize)), m_tileGridSize.y - 1);
+
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+				if (m_solid[static_cast<size_t>(y) * m_tileGridSize.x + x] && fn(x, y))
+					return true;
+		return false;
+	}
+
+	void CollisionWorld::CollideTiles(uint32_t dense, std::vector<Contact>& out) const
+	{
+		Shape body = GetShape(dense);
+		ForEachSolidTile(m_bounds[dense], [&](int x, int y)
+		{
+			Contact c;
+			if (Collide(body, GetTileShape(x, y), c))
+			{
+				c.a = GetHandle(dense);
+				c.tile = { x, y };
+				out.push_back(c);
+			}
+			return false;
+		});
+	}
+
+	// grid traversal in tile units, the start tile is skipped
+	bool CollisionWorld::RaycastTiles(const Ray& ray, RayHit& hit) const
+	{
+		if (m_solid.empty())
+			return false;
+
+		glm::vec2 p = (ray.origin - m_tileOrigin) / m_tileSize;
+		glm::vec2 dir = ray.direction;
+		float maxT = ray.maxDistance / m_tileSize;
+
+		int x = static_cast<int>(std::floor(p.x));
+		int y = static_cast<int>(std::floor(p.y));
+		int stepX = dir.x > 0.f ? 1 : (dir.x < 0.f ? -1 : 0);
+		int stepY = dir.y > 0.f ? 1 : (dir.y < 0.f ? -1 : 0);
+		float deltaX = stepX ? std::abs(1.f / dir.x) : FLT_MAX;
+		float deltaY = stepY ? std::abs(1.f / dir.y) : FLT_MAX;
+		float nextX = stepX > 0 ? (x + 1 - p.x) * deltaX : (stepX < 0 ? (p.x - x) * deltaX : FLT_MAX);
+		float nextY = stepY > 0 ? (y + 1 - p.y) * deltaY : (stepY < 0 ? (p.y - y) * deltaY : FLT_MAX);
+
+		while (true)
+		{
+			float t = 0.f;
+			glm::vec2 normal;
+			if (nextX < nextY)
+			{
+				x += stepX;
+				t = nextX;
+				nextX += deltaX;
+				normal = { static_cast<float>(-stepX), 0.f };
+			}
+			else
+			{
+				y += stepY;
+				t = nextY;
+				nextY += deltaY;
+				normal = { 0.f, static_cast<float>(-stepY) };
+			}
+
+			if (t > maxT)
+				return false;
+
+			// left the grid for good
+			if ((x < 0 && stepX <= 0) || (x >= m_tileGridSize.x && stepX >= 0) ||
+				(y < 0 && stepY <= 0) || (y >= m_tileGridSize.y && stepY >= 0))
+				return false;
+
+			if (IsSolidTile(x, y))
+			{
+				hit.hit = true;
+				hit.collider = {};
+				hit.tile = { x, y };
+				hit.distance = t * m_tileSize;
+				hit.point = ray.origin + dir * hit.distance;
+				hit.normal = normal;
+				return true;
+			}
+		}
+	}
+
+	#pragma endregion
+
+	#pragma region broadphase
+
+	template<typename Fn>
+	void CollisionWorld::ForEachInCells(glm::vec4 bounds, Fn&& fn) const
+	{
+		if (m_cells.empty())
+			return;
+
+		int x0 = static_cast<int>(std::floor(bounds.x / m_cellSize));
+		int y0 = static_cast<int>(std::floor(bounds.y / m_cellSize));
+		int x1 = static_cast<int>(std::floor(bounds.z / m_cellSize));
+		int y1 = static_cast<int>(std::floor(bounds.w / m_cellSize));
+
+		for (int y = y0; y <= y1; y++)
+			for (int x = x0; x <= x1; x++)
+			{
+				auto it = m_cells.find(CellKey(x, y));
+				if (it == m_cells.end())
+					continue;
+				for (uint32_t i = it->second.x; i < it->second.y; i++)
+				{
+					if (m_entries[i].dense != s_removedEntry)
+						fn(m_entries[i].dense);
+				}
+			}
+	}
+
+	void CollisionWorld::BuildBroadphase(FrameVector<glm::uvec2>& pairs)
+	{
+		m_entries.clear();
+		for (uint32_t dense = 0; dense < m_bounds.size(); dense++)
+		{
+			glm::vec4 b = m_bounds[dense];
+			int x0 = static_cast<int>(std::floor(b.x / m_cellSize));
+			int y0 = static_cast<int>(std::floor(b.y / m_cellSize));
+			int x1 = static_cast<int>(std::floor(b.z / m_cellSize));
+			int y1 = static_cast<int>(std::floor(b.w / m_cellSize));
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+					m_entries.push_back({ CellKey(x, y), dense });
+		}
+
+		std::sort(m_entries.begin(), m_entries.end(), [](const CellEntry& a, const CellEntry& b)
+		{
+			return a.key < b.key || (a.key == b.key && a.dense < b.dense);
+		});
+
+		m_cells.clear();
+		for (size_t begin = 0; begin < m_entries.size();)
+		{
+			uint64_t key = m_entries[begin].key;
+			size_t end = begin + 1;
+			while (end < m_entries.size() && m_entries[end].key == key)
+				end++;
+			m_cells[key] = { static_cast<uint32_t>(begin), static_cast<uint32_t>(end) };
+
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t a = m_entries[i].dense;
+				for (size_t j = i + 1; j < end; j++)
+				{
+					uint32_t b = m_entries[j].dense;
+					if (m_static[a] && m_static[b])
+						continue;
+					if (!(m_layers[a] & m_masks[b]) || !(m_layers[b] & m_masks[a]))
+						continue;
+
+					glm::vec4 ba = m_bounds[a];
+					glm::vec4 bb = m_bounds[b];
+					if (!BoundsOverlap(ba, bb))
+						continue;
+
+					// a pair sharing several cells is only reported by the cell holding the corner of the overlap
+					int cx = static_cast<int>(std::floor(std::max(ba.x, bb.x) / m_cellSize));
+					int cy = static_cast<int>(std::floor(std::max(ba.y, bb.y) / m_cellSize));
+					if (CellKey(cx, cy) != key)
+						continue;
+
+					pairs.push_back({ a, b });
+				}
+			}
+
+			begin = end;
+		}
+	}
+
+	#pragma endregion
+
+	void CollisionWorld::Step()
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// the pairs only live through the step, about as many as last time
+		FrameVector<glm::uvec2> pairs(ArenaAllocator<glm::uvec2>(m_frameArena, MemoryTag::Collision));
+		pairs.reserve(m_stats.pairs + m_stats.pairs / 4);
+		BuildBroadphase(pairs);
+
+		size_t pairRanges = (pairs.size() + s_narrowphaseGrain - 1) / s_narrowphaseGrain;
+		size_t bodyRanges = m_solid.empty() ? 0 : (m_positions.size() + s_narrowphaseGrain - 1) / s_narrowphaseGrain;
+		if (m_buckets.size() < pairRanges + bodyRanges)
+			m_buckets.resize(pairRanges + bodyRanges);
+
+		Parallel::For(pairRanges + bodyRanges, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t r = begin; r < end; r++)
+			{
+				std::vector<Contact>& bucket = m_buckets[r];
+				bucket.clear();
+
+				if (r < pairRanges)
+				{
+					size_t last = std::min((r + 1) * s_narrowphaseGrain, pairs.size());
+					for (size_t i = r * s_narrowphaseGrain; i < last; i++)
+					{
+						glm::uvec2 pair = pairs[i];
+						Contact c;
+						if (Collide(GetShape(pair.x), GetShape(pair.y), c))
+						{
+							c.a = GetHandle(pair.x);
+							c.b = GetHandle(pair.y);
+							bucket.push_back(c);
+						}
+					}
+				}
+				else
+				{
+					size_t first = (r - pairRanges) * s_narrowphaseGrain;
+					size_t last = std::min(first + s_narrowphaseGrain, m_positions.size());
+					for (size_t dense = first; dense < last; dense++)
+						if (!m_static[dense])
+							CollideTiles(static_cast<uint32_t>(dense), bucket);
+				}
+			}
+		});
+
+		m_contacts.clear();
+		for (size_t r = 0; r < pairRanges + bodyRanges; r++)
+			m_contacts.insert(m_contacts.end(), m_buckets[r].begin(), m_buckets[r].end());
+
+		m_stats.colliders = static_cast<int>(m_positions.size());
+		m_stats.cellEntries = static_cast<int>(m_entries.size());
+		m_stats.pairs = static_cast<int>(pairs.size());
+		m_stats.contacts = static_cast<int>(m_contacts.size());
+		m_stats.stepMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	#pragma region queries
+
+	bool CollisionWorld::Raycast(const Ray& ray, RayHit& hit) const
+	{
+		hit = {};
+		float best = ray.maxDistance;
+
+		// walk the hash cells along the ray until the next cell starts behind the closest hit
+		if (!m_cells.empty())
+		{
+			glm::vec2 dir = ray.direction;
+			int x = static_cast<int>(std::floor(ray.origin.x / m_cellSize));
+			int y = static_cast<int>(std::floor(ray.origin.y / m_cellSize));
+			int stepX = dir.x > 0.f ? 1 : (dir.x < 0.f ? -1 : 0);
+			int stepY = dir.y > 0.f ? 1 : (dir.y < 0.f ? -1 : 0);
+			float deltaX = stepX ? std::abs(m_cellSize / dir.x) : FLT_MAX;
+			float deltaY = stepY ? std::abs(m_cellSize / dir.y) : FLT_MAX;
+			float nextX = stepX > 0 ? ((x + 1) * m_cellSize - ray.origin.x) / dir.x
+				: (stepX < 0 ? (x * m_cellSize - ray.origin.x) / dir.x : FLT_MAX);
+			float nextY = stepY > 0 ? ((y + 1) * m_cellSize - ray.origin.y) / dir.y
+				: (stepY < 0 ? (y * m_cellSize - ray.origin.y) / dir.y : FLT_MAX);
+
+			while (true)
+			{
+				auto it = m_cells.find(CellKey(x, y));
+				if (it != m_cells.end())
+				{
+					for (uint32_t i = it->second.x; i < it->second.y; i++)
+					{
+						uint32_t dense = m_entries[i].dense;
+						if (dense == s_removedEntry || !(m_layers[dense] & ray.mask))
+							continue;
+
+						float t = 0.f;
+						glm::vec2 normal;
+						if (RaycastShape(GetShape(dense), ray.origin, dir, best, t, normal) && (!hit.hit || t < best))
+						{
+							best = t;
+							hit.hit = true;
+							hit.collider = GetHandle(dense);
+							hit.distance = t;
+							hit.normal = normal;
+						}
+					}
+				}
+
+				float next = std::min(nextX, nextY);
+				if (next > best)
+					break;
+				if (nextX < nextY)
+				{
+					x += stepX;
+					nextX += deltaX;
+				}
+				else
+				{
+					y += stepY;
+					nextY += deltaY;
+				}
+			}
+		}
+
+		RayHit tileHit;
+		Ray tileRay = ray;
+		tileRay.maxDistance = best;
+		if (RaycastTiles(tileRay, tileHit) && (!hit.hit || tileHit.distance < hit.distance))
+			hit = tileHit;
+
+		if (hit.hit)
+			hit.point = ray.origin + ray.direction * hit.distance;
+		return hit.hit;
+	}
+
+	void CollisionWorld::RaycastBatch(const Ray* rays, RayHit* hits, size_t count) const
+	{
+		Parallel::For(count, 64, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				Raycast(rays[i], hits[i]);
+		});
+	}
+
+	// conservative advancement in steps of half the shape's smallest extent, refined by bisection
+	bool CollisionWorld::ShapeCast(ColliderHandle handle, glm::vec2 target, RayHit& hit, uint32_t mask) const
+	{
+		hit = {};
+		int found = GetDense(handle);
+		if (found < 0)
+			return false;
+
+		uint32_t self = static_cast<uint32_t>(found);
+		glm::vec2 start = m_positions[self];
+		glm::vec2 delta = target - start;
+		float length = glm::length(delta);
+		if (length < 1e-6f)
+			return false;
+
+		glm::vec4 bounds = m_bounds[self];
+		glm::vec4 swept = {
+			std::min(bounds.x, bounds.x + delta.x), std::min(bounds.y, bounds.y + delta.y),
+			std::max(bounds.z, bounds.z + delta.x), std::max(bounds.w, bounds.w + delta.y) };
+
+		Shape shape = GetShape(self);
+		Contact contact;
+
+		// shapes already overlapping at the start are ignored, so a cast can always leave them
+		thread_local std::vector<uint32_t> candidates;
+		thread_local std::vector<glm::ivec2> startTiles;
+		candidates.clear();
+		startTiles.clear();
+		ForEachInCells(swept, [&](uint32_t dense)
+		{
+			if (dense != self && (m_layers[dense] & mask) && BoundsOverlap(m_bounds[dense], swept))
+				candidates.push_back(dense);
+		});
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+		candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](uint32_t dense)
+		{
+			return BoundsOverlap(bounds, m_bounds[dense]) && Collide(shape, GetShape(dense), contact);
+		}), candidates.end());
+		ForEachSolidTile(bounds, [&](int x, int y)
+		{
+			if (Collide(shape, GetTileShape(x, y), contact))
+				startTiles.push_back({ x, y });
+			return false;
+		});
+
+		uint32_t contactDense = 0;
+		auto overlapAt = [&](float t)
+		{
+			Shape moved = GetShape(self, delta * t);
+			glm::vec4 movedBounds = bounds + glm::vec4(delta, delta) * t;
+			for (uint32_t dense : candidates)
+			{
+				if (BoundsOverlap(movedBounds, m_bounds[dense]) && Collide(moved, GetShape(dense), contact))
+				{
+					contactDense = dense;
+					contact.tile = { -1, -1 };
+					return true;
+				}
+			}
+			return ForEachSolidTile(movedBounds, [&](int x, int y)
+			{
+				if (std::find(startTiles.begin(), startTiles.end(), glm::ivec2(x, y)) != startTiles.end())
+					return false;
+				if (!Collide(moved, GetTileShape(x, y), contact))
+					return false;
+				contact.tile = { x, y };
+				return true;
+			});
+		};
+
+		float extent = std::min(bounds.z - bounds.x, bounds.w - bounds.y) * 0.5f;
+		float step = glm::clamp(extent * 0.5f / length, 1.f / 256.f, 1.f);
+
+		float previous = 0.f;
+		float t = 0.f;
+		bool touching = false;
+		while (!touching && previous < 1.f)
+		{
+			t = std::min(previous + step, 1.f);
+			touching = overlapAt(t);
+			if (!touching)
+				previous = t;
+		}
+		if (!touching)
+			return false;
+
+		// refine between the last free and the first touching position
+		float lo = previous;
+		float hi = t;
+		for (int i = 0; i < 10; i++)
+		{
+			float mid = (lo + hi) * 0.5f;
+			if (overlapAt(mid))
+				hi = mid;
+			else
+				lo = mid;
+		}
+		overlapAt(hi);
+		t = lo;
+
+		hit.hit = true;
+		hit.collider = contact.tile.x < 0 ? GetHandle(contactDense) : ColliderHandle{};
+		hit.tile = contact.tile;
+		hit.distance = t * length;
+		hit.point = contact.points[0];
+		hit.normal = -contact.normal;
+		return true;
+	}
+
+	void CollisionWorld::QueryAabb(glm::vec2 min, glm::vec2 max, std::vector<ColliderHandle>& out, uint32_t mask) const
+	{
+		out.clear();
+		glm::vec4 bounds = { min.x, min.y, max.x, max.y };
+
+		thread_local std::vector<uint32_t> found;
+		found.clear();
+		ForEachInCells(bounds, [&](uint32_t dense)
+		{
+			if ((m_layers[dense] & mask) && BoundsOverlap(m_bounds[dense], bounds))
+				found.push_back(dense);
+		});
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+
+		for (uint32_t dense : found)
+			out.push_back(GetHandle(dense));
+	}
+
+	#pragma endregion
+
+}
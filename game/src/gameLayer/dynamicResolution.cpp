@@ -0,0 +1,163 @@
+#include "dynamicResolution.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+
+namespace game
+{
+
+	void DynamicResolution::Initialize()
+	{
+		glGenQueries(s_queryCount, m_queries);
+		for (bool& pending : m_pending)
+			pending = false;
+
+		m_level = 0;
+		m_frameStart = std::chrono::steady_clock::now();
+		m_initialized = true;
+	}
+
+	void DynamicResolution::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		if (m_queryActive)
+			glEndQuery(GL_TIME_ELAPSED);
+		glDeleteQueries(s_queryCount, m_queries);
+		m_queryActive = false;
+
+		m_initialized = false;
+	}
+
+	void DynamicResolution::BeginFrame()
+	{
+		if (!m_initialized)
+			return;
+
+		m_frameStart = std::chrono::steady_clock::now();
+
+		CollectQueries();
+
+		// the oldest query may still be in flight on a slow GPU, then this frame is not measured
+		if (!m_pending[m_queryIndex])
+		{
+			glBeginQuery(GL_TIME_ELAPSED, m_queries[m_queryIndex]);
+			m_queryActive = true;
+		}
+	}
+
+	void DynamicResolution::EndFrame()
+	{
+		if (!m_initialized)
+			return;
+
+		if (m_queryActive)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			m_pending[m_queryIndex] = true;
+			m_queryIndex = (m_queryIndex + 1) % s_queryCount;
+			m_queryActive = false;
+		}
+
+		float cpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_frameStart).count();
+		m_cpuMs += (cpuMs - m_cpuMs) * s_smoothing;
+	}
+
+	void DynamicResolution::SetEnabled(bool enabled)
+	{
+		m_enabled = enabled;
+		m_slowFrames = 0;
+		m_fastFrames = 0;
+		m_cooldown = settings.cooldownFrames;
+	}
+
+	float DynamicResolution::GetSceneScale() const
+	{
+		if (!m_enabled || settings.levels <= 0)
+			return settings.sceneMaxScale;
+		float t = static_cast<float>(m_level) / settings.levels;
+		return settings.sceneMaxScale + (settings.sceneMinScale - settings.sceneMaxScale) * t;
+	}
+
+	float DynamicResolution::GetLightScale() const
+	{
+		if (!m_enabled || settings.levels <= 0)
+			return settings.lightMaxScale;
+		float t = static_cast<float>(m_level) / settings.levels;
+		return settings.lightMaxScale + (settings.lightMinScale - settings.lightMaxScale) * t;
+	}
+
+	// results arrive a frame or two late, every available one is one frame sample
+	void DynamicResolution::CollectQueries()
+	{
+		for (int i = 0; i < s_queryCount; i++)
+		{
+			int index = (m_queryIndex + i) % s_queryCount;
+			if (!m_pending[index])
+				continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv(m_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;	// later queries are not done either
+
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(m_queries[index], GL_QUERY_RESULT, &nanoseconds);
+			m_pending[index] = false;
+
+			float gpuMs = static_cast<float>(nanoseconds) / 1000000.f;
+			if (!m_hasGpuSample)
+				m_gpuMs = gpuMs;
+			m_gpuMs += (gpuMs - m_gpuMs) * s_smoothing;
+			m_hasGpuSample = true;
+
+			Adjust(gpuMs);
+		}
+	}
+
+	void DynamicResolution::Adjust(float frameMs)
+	{
+		if (!m_enabled)
+			return;
+
+		if (m_cooldown > 0)
+		{
+			m_cooldown--;
+			return;
+		}
+
+		// single spikes are smoothed away, a level only moves on a run of frames
+		float smoothed = m_gpuMs;
+		if (smoothed > settings.targetFrameMs * settings.lowerThreshold && frameMs > settings.targetFrameMs * settings.lowerThreshold)
+		{
+			m_fastFrames = 0;
+			if (++m_slowFrames >= settings.lowerFrames && m_level < settings.levels)
+			{
+				m_level++;
+				m_levelChanges++;
+				m_slowFrames = 0;
+				m_cooldown = settings.cooldownFrames;
+			}
+		}
+		else if (smoothed < settings.targetFrameMs * settings.raiseThreshold)
+		{
+			m_slowFrames = 0;
+			if (++m_fastFrames >= settings.raiseFrames && m_level > 0)
+			{
+				m_level--;
+				m_levelChanges++;
+				m_fastFrames = 0;
+				m_cooldown = settings.cooldownFrames;
+			}
+		}
+		else
+		{
+			m_slowFrames = 0;
+			m_fastFrames = 0;
+		}
+	}
+
+}
@@ -0,0 +1,339 @@
+#include "frameCapture.h"
+
+#include <glad/glad.h>
+
+#include "asyncLog.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+
+
+namespace game
+{
+
+	void FrameCapture::Initialize(const std::string& outputDirectory, int ringSize)
+	{
+		m_outputDirectory = outputDirectory;
+
+		std::error_code ec;
+		std::filesystem::create_directories(m_outputDirectory, ec);
+
+		m_slots.resize(ringSize);
+		for (Slot& slot : m_slots)
+			glGenBuffers(1, &slot.pbo);
+
+		m_stopWorker = false;
+		m_worker = std::thread(&FrameCapture::WorkerLoop, this);
+
+		m_initialized = true;
+	}
+
+	void FrameCapture::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		// flush what is still in flight so no capture is lost on exit.
+		CollectReadbacks(true);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopWorker = true;
+		}
+		m_condition.notify_one();
+		if (m_worker.joinable())
+			m_worker.join();
+
+		for (Slot& slot : m_slots)
+		{
+			if (slot.fence)
+				glDeleteSync(static_cast<GLsync>(slot.fence));
+			glDeleteBuffers(1, &slot.pbo);
+		}
+		m_slots.clear();
+
+		for (std::vector<uint8_t>& buffer : m_freeBuffers)
+			Memory::RecordFree(MemoryTag::Capture, buffer.capacity());
+		m_freeBuffers.clear();
+
+		m_initialized = false;
+	}
+
+	void FrameCapture::RequestScreenshot(LittleEngine::Graphics::RenderTarget* target)
+	{
+		m_screenshotRequested = true;
+		m_screenshotTarget = target;
+	}
+
+	void FrameCapture::StartSequence(int everyNthFrame, float durationSeconds)
+	{
+		m_sequenceActive = true;
+		m_sequenceInterval = everyNthFrame < 1 ? 1 : everyNthFrame;
+		m_sequenceTimeLeft = durationSeconds;
+		m_sequenceIndex = 0;
+		m_sequencePrefix = MakePath("sequence", m_frame);
+	}
+
+	void FrameCapture::StopSequence()
+	{
+		m_sequenceActive = false;
+	}
+
+	void FrameCapture::EndFrame(float dt)
+	{
+		if (!m_initialized)
+			return;
+
+		CollectReadbacks(false);
+
+		if (m_screenshotRequested)
+		{
+			IssueReadback(m_screenshotTarget, MakePath(m_screenshotTarget ? "target" : "screenshot", m_frame));
+			m_screenshotRequested = false;
+			m_screenshotTarget = nullptr;
+		}
+
+		if (m_sequenceActive)
+		{
+			if (m_frame % m_sequenceInterval == 0)
+			{
+				char index[16];
+				std::snprintf(index, sizeof(index), "_%05d", m_sequenceIndex++);
+				IssueReadback(nullptr, m_sequencePrefix + index);
+			}
+
+			m_sequenceTimeLeft -= dt;
+			if (m_sequenceTimeLeft <= 0.f)
+				m_sequenceActive = false;
+		}
+
+		m_frame++;
+	}
+
+	int FrameCapture::GetPendingReadbacks() const
+	{
+		int count = 0;
+		for (const Slot& slot : m_slots)
+			count += slot.pending;
+		return count;
+	}
+
+	int FrameCapture::GetQueuedWrites()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<int>(m_jobs.size());
+	}
+
+
+	std::vector<uint8_t> FrameCapture::AcquireBuffer(size_t size)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = 0; i < m_freeBuffers.size(); i++)
+			{
+				if (m_freeBuffers[i].capacity() >= size)
+				{
+					std::vector<uint8_t> buffer = std::move(m_freeBuffers[i]);
+					m_freeBuffers[i] = std::move(m_freeBuffers.back());
+					m_freeBuffers.pop_back();
+					buffer.resize(size);
+					return buffer;
+				}
+			}
+		}
+
+		std::vector<uint8_t> buffer(size);
+		Memory::RecordAllocation(MemoryTag::Capture, buffer.capacity());
+		return buffer;
+	}
+
+	void FrameCapture::ReleaseBuffer(std::vector<uint8_t>&& buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// enough to cover the ring and the write queue of a sequence
+		if (m_freeBuffers.size() < m_slots.size() + 2)
+		{
+			m_freeBuffers.push_back(std::move(buffer));
+			return;
+		}
+		Memory::RecordFree(MemoryTag::Capture, buffer.capacity());
+	}
+
+	void FrameCapture::IssueReadback(LittleEngine::Graphics::RenderTarget* target, const std::string& path)
+	{
+		Slot& slot = m_slots[m_nextSlot];
+		if (slot.pending)
+		{
+			// ring is full, waiting here would bring the stall back.
+			m_dropped++;
+			return;
+		}
+		m_nextSlot = (m_nextSlot + 1) % static_cast<int>(m_slots.size());
+
+		GLint readFramebuffer = 0, drawFramebuffer = 0;
+		GLint viewport[4];
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		if (target)
+		{
+			target->Bind();
+			slot.size = target->GetSize();
+		}
+		else
+		{
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			slot.size = LittleEngine::GetWindowSize();
+		}
+
+		GLsizeiptr bytes = static_cast<GLsizeiptr>(slot.size.x) * slot.size.y * 4;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, slot.size.x, slot.size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.frame = m_frame;
+		slot.path = path;
+		slot.pending = true;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	void FrameCapture::CollectReadbacks(bool wait)
+	{
+		for (Slot& slot : m_slots)
+		{
+			if (!slot.pending)
+				continue;
+
+			GLsync fence = static_cast<GLsync>(slot.fence);
+			GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+			GLenum status = glClientWaitSync(fence, 0, timeout);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+				continue;
+
+			glDeleteSync(fence);
+			slot.fence = nullptr;
+			slot.pending = false;
+
+			Job job;
+			job.size = slot.size;
+			job.path = slot.path;
+			job.format = format;
+			job.pixels = AcquireBuffer(static_cast<size_t>(slot.size.x) * slot.size.y * 4);
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+			if (data)
+			{
+				std::memcpy(job.pixels.data(), data, job.pixels.size());
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+			if (!data)
+			{
+				ReleaseBuffer(std::move(job.pixels));
+				m_dropped++;
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_jobs.push_back(std::move(job));
+			}
+			m_condition.notify_one();
+		}
+	}
+
+	std::string FrameCapture::MakePath(const std::string& prefix, uint64_t index) const
+	{
+		std::time_t now = std::time(nullptr);
+		char stamp[32];
+		std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+
+		return m_outputDirectory + "/" + prefix + "_" + stamp + "_" + std::to_string(index);
+	}
+
+
+	void FrameCapture::WorkerLoop()
+	{
+		while (true)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_stopWorker || !m_jobs.empty(); });
+
+				// drain the queue before stopping
+				if (m_jobs.empty())
+					return;
+
+				job = std::move(m_jobs.front());
+				m_jobs.pop_front();
+			}
+
+			bool ok = job.format == Format::Tga ? WriteTga(job) : WriteRaw(job);
+			if (ok)
+				m_written++;
+			else
+				GAME_LOG_WARNING("FrameCapture: could not write %s", job.path);
+
+			ReleaseBuffer(std::move(job.pixels));
+		}
+	}
+
+	bool FrameCapture::WriteTga(const Job& job)
+	{
+		std::ofstream file(job.path + ".tga", std::ios::binary);
+		if (!file)
+			return false;
+
+		uint8_t header[18] = {};
+		header[2] = 2;		// uncompressed true color
+		header[12] = job.size.x & 0xFF;
+		header[13] = (job.size.x >> 8) & 0xFF;
+		header[14] = job.size.y & 0xFF;
+		header[15] = (job.size.y >> 8) & 0xFF;
+		header[16] = 24;	// bits per pixel, the backbuffer alpha is dropped: blending leaves it below 255
+		header[17] = 0;		// no alpha bits, bottom-left origin
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+		// tga stores BGR
+		std::vector<uint8_t> row(static_cast<size_t>(job.size.x) * 3);
+		for (int y = 0; y < job.size.y; y++)
+		{
+			const uint8_t* src = job.pixels.data() + static_cast<size_t>(y) * job.size.x * 4;
+			for (int x = 0; x < job.size.x; x++)
+			{
+				row[x * 3 + 0] = src[x * 4 + 2];
+				row[x * 3 + 1] = src[x * 4 + 1];
+				row[x * 3 + 2] = src[x * 4 + 0];
+			}
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	bool FrameCapture::WriteRaw(const Job& job)
+	{
+		std::ofstream file(job.path + "_" + std::to_string(job.size.x) + "x" + std::to_string(job.size.y) + ".rgba", std::ios::binary);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char*>(job.pixels.data()), job.pixels.size());
+		return static_cast<bool>(file);
+	}
+
+}
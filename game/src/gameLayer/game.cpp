@@ -11,7 +11,8 @@
 
 #include <LittleEngine/little_engine.h>
 
-#include <LittleEngine/Utils/logger.h>
+#include "asyncLog.h"
+#include "parallel.h"
 
 // Temporary includes for glad and GLFW for keys
 #include <glad/glad.h>
@@ -23,6 +24,9 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <cassert>
 
 
 
@@ -31,6 +35,46 @@ namespace game
 
 	const unsigned int Game::world[] = { 2, 2, 2, 3, 2, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 3, 3, 2, 3, 2, 2, 2, 2, 2, 2, 3, 3, 2, 2, 2, 2, 2, 3, 3, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
+	namespace
+	{
+		// the generated test world, ground everywhere and sparse decoration on top
+		uint32_t WorldTile(uint32_t x, uint32_t y, int layer)
+		{
+			if (layer == 0)
+				return ((x / 8 + y / 8) % 3 == 0) ? 1 : 2;
+
+			uint32_t hash = (x * 73856093u) ^ (y * 19349663u);
+			hash ^= hash >> 13;
+			hash *= 0x5bd1e995u;
+			hash ^= hash >> 15;
+			return hash % 23 == 0 ? 3 : ChunkedTilemap::s_emptyTile;
+		}
+
+		const std::string s_snapshotPath = "saves/world.snap";
+
+		// snapshot chunk ids, the chunk version is the layout of its payload
+		constexpr uint32_t s_gameChunk = 0x454D4147;		// "GAME"
+		constexpr uint32_t s_lightChunk = 0x5448474C;		// "LGHT"
+		constexpr uint32_t s_obstacleChunk = 0x5453424F;	// "OBST"
+		constexpr uint32_t s_optionsChunk = 0x5354504F;		// "OPTS"
+		constexpr uint32_t s_navChunk = 0x0056414E;			// "NAV" and the region in the last byte
+		constexpr int s_navRegionSize = 32;
+
+		// the region goes in the top byte, so there can be at most 255 of them
+		uint32_t NavChunkId(int region)
+		{
+			assert(region >= 0 && region < 255);
+			return s_navChunk | (static_cast<uint32_t>(region) << 24);
+		}
+
+		// loaded options go through the same range as their slider, NaN becomes min
+		template<typename T>
+		T ClampLoaded(T value, T min, T max)
+		{
+			return value > min ? std::min(value, max) : min;
+		}
+	}
+
 #pragma region Game Initialization/Unintialization
 
 	bool Game::Initialize()
@@ -47,6 +91,16 @@ namespace game
 
 		InitializeLight();
 
+		InitializeWorld();
+
+		InitializeParticles();
+
+		InitializeNavigation();
+
+		LoadSnapshot();
+
+		InitializeCollision();
+
 
 		
 
@@ -54,10 +108,10 @@ namespace game
 
 
 		// TESTING
-		LittleEngine::Utils::Logger::Info("info");
-		LittleEngine::Utils::Logger::Warning("warning");
-		LittleEngine::Utils::Logger::Error("error");
-		//LittleEngine::Utils::Logger::Critical("critical");
+		GAME_LOG_INFO("info");
+		GAME_LOG_WARNING("warning");
+		GAME_LOG_ERROR("error");
+		//GAME_LOG_CRITICAL("critical");
 
 		glm::vec2 a = { 0, 0 };
 		glm::vec2 b = { 1, 0 };
@@ -69,35 +123,57 @@ namespace game
 
 		// triangle in CCW order
 
-		std::cout << "Triangle signed area: " << LittleEngine::Math::TriangleSignedArea(a, b, c) << "\n";
-		std::cout << "Three point orientation: " << LittleEngine::Math::ThreePointOrientation(a, b, c) << "\n";
+		GAME_LOG_INFO("Triangle signed area: %f", LittleEngine::Math::TriangleSignedArea(a, b, c));
+		GAME_LOG_INFO("Three point orientation: %d", LittleEngine::Math::ThreePointOrientation(a, b, c));
 
-		std::cout << "b on AC: " << LittleEngine::Math::PointOnSegment(b, e1) << "\n";
-		std::cout << "a on BC: " << LittleEngine::Math::PointOnSegment(a, e2) << "\n";
-		std::cout << "c on AC: " << LittleEngine::Math::PointOnSegment(c, e1) << "\n";
-		std::cout << "(1, 0.1) on AC: " << LittleEngine::Math::PointOnSegment({ 1, 0.1f }, e1) << "\n";
+		GAME_LOG_INFO("b on AC: %d", LittleEngine::Math::PointOnSegment(b, e1));
+		GAME_LOG_INFO("a on BC: %d", LittleEngine::Math::PointOnSegment(a, e2));
+		GAME_LOG_INFO("c on AC: %d", LittleEngine::Math::PointOnSegment(c, e1));
+		GAME_LOG_INFO("(1, 0.1) on AC: %d", LittleEngine::Math::PointOnSegment({ 1, 0.1f }, e1));
 
 
-		//loading the saved data. Loading an entire structure like this makes savind game data very easy.
-		//platform::readEntireFile(RESOURCES_PATH "gameData.data", &gameData, sizeof(GameData));
-
 		return true;
 	}
 
 
 	void Game::InitializeEngine()
 	{
+		Log::Settings logSettings;
+#ifdef PRODUCTION_BUILD
+		logSettings.console = false;
+#endif
+		Log::Initialize(logSettings);
+
+		m_frameArena.Initialize(1 << 20);
+
+		Parallel::Initialize();
+
+		m_shaderCache.Initialize("shader_cache");
+
 		m_renderer = std::make_unique<LittleEngine::Graphics::Renderer>();
 		m_renderer->Initialize(sceneCamera, LittleEngine::GetWindowSize());
+		m_renderGraph.Initialize(LittleEngine::GetWindowSize());
+		m_dynamicResolution.Initialize();
 
 		m_lightSystem = std::make_unique<LittleEngine::Graphics::LightSystem>();
 		m_lightSystem->Initialize(1000); // initialize light system with a maximum of 1000 shadow quads
+		m_lights.Initialize(m_lightSystem.get());
 
 		m_audioSystem = std::make_unique<LittleEngine::Audio::AudioSystem>();
 		m_audioSystem->Initialize();
 
 		m_uiSystem = std::make_unique<LittleEngine::UI::UISystem>();
 		m_uiSystem->Initialize(LittleEngine::GetWindowSize()); // initialize UI system with the current window size
+
+		m_spriteBatch.Initialize(m_shaderCache);
+
+		m_textures.Initialize();
+
+		m_snapshots.Initialize();
+
+		m_frameCapture.Initialize("captures");
+
+		m_visibility.Initialize(m_shaderCache);
 	}
 
 	void Game::InitializeResources()
@@ -121,6 +197,17 @@ namespace game
 		minecraft_blocks.LoadFromFile(RESOURCES_PATH "minecraft_atlas.png");
 		minecraft_atlas = LittleEngine::Graphics::TextureAtlas(minecraft_blocks, 16, 16);
 
+		// several hundred MB uncompressed, only the ones on screen are kept resident
+		std::vector<std::string> facePaths;
+		for (const auto& file : std::filesystem::directory_iterator(RESOURCES_PATH "Faces"))
+		{
+			if (file.is_regular_file() && file.path().extension() == ".png")
+				facePaths.push_back(file.path().string());
+		}
+		std::sort(facePaths.begin(), facePaths.end());
+		for (const std::string& path : facePaths)
+			faces.push_back(m_textures.Load(path));
+
 		font.LoadFromTTF(RESOURCES_PATH "arial.ttf", 64.f);
 	}
 
@@ -179,29 +266,25 @@ namespace game
 		};
 
 		class ScreenshotCommand : public LittleEngine::Input::Command {
-			LittleEngine::Graphics::Renderer* renderer;
+			FrameCapture& capture;
 		public:
-			ScreenshotCommand(LittleEngine::Graphics::Renderer* r) : renderer(r) {}
+			ScreenshotCommand(FrameCapture& c) : capture(c) {}
 			std::string GetName() const override { return "Screenshot"; }
 
-			void OnPress() override { renderer->SaveScreenshot(); }
+			void OnPress() override { capture.RequestScreenshot(); }
 		};
 
 		class SaveRenderTargetCommand : public LittleEngine::Input::Command {
-			LittleEngine::Graphics::Renderer* renderer;
+			FrameCapture& capture;
 			LittleEngine::Graphics::RenderTarget& target;
 		public:
-			SaveRenderTargetCommand(LittleEngine::Graphics::Renderer* r,
-				LittleEngine::Graphics::RenderTarget& t) : renderer(r), target(t) {
+			SaveRenderTargetCommand(FrameCapture& c,
+				LittleEngine::Graphics::RenderTarget& t) : capture(c), target(t) {
 			}
 
 			std::string GetName() const override { return "SaveRenderTarget"; }
 
-			void OnPress() override {
-				std::cout << "hello before: ";
-				renderer->SaveScreenshot(&target);
-				std::cout << "hello after\n ";
-			}
+			void OnPress() override { capture.RequestScreenshot(&target); }
 		};
 
 
@@ -312,52 +395,56 @@ namespace game
 		LittleEngine::Input::BindKeyToCommand(LittleEngine::Input::KeyCode::Space, std::make_unique<SoundCommand>(sound));
 		LittleEngine::Input::BindMouseButtonToCommand(LittleEngine::Input::MouseButton::Left, std::make_unique<ColorCommand>(m_data.color));
 		//LittleEngine::Input::BindMouseButtonToCommand(LittleEngine::Input::MouseButton::Left, std::make_unique<ZoomCommand>(m_data.zoom));
-		LittleEngine::Input::BindKeyToCommand(LittleEngine::Input::KeyCode::F11, std::make_unique<ScreenshotCommand>(m_renderer.get()));
-		LittleEngine::Input::BindKeyToCommand(LittleEngine::Input::KeyCode::F10, std::make_unique<SaveRenderTargetCommand>(m_renderer.get(), target));
+		LittleEngine::Input::BindKeyToCommand(LittleEngine::Input::KeyCode::F11, std::make_unique<ScreenshotCommand>(m_frameCapture));
+		LittleEngine::Input::BindKeyToCommand(LittleEngine::Input::KeyCode::F10, std::make_unique<SaveRenderTargetCommand>(m_frameCapture, target));
 
 	}
 
 	void Game::InitializeUI()
 	{	
-		LittleEngine::UI::UIContext* hud = m_uiSystem->CreateContext("HUD");
-		LittleEngine::UI::UIContext* menu = m_uiSystem->CreateContext("Menu");
+		m_retainedUI.Initialize(m_uiSystem.get(), m_shaderCache, LittleEngine::GetWindowSize());
+
+		m_retainedUI.CreateContext("HUD");
+		m_retainedUI.CreateContext("Menu");
 
 
 		// add elements
 		glm::ivec2 size = LittleEngine::GetWindowSize();
 
 		LittleEngine::UI::UIElement* label;
-		label = hud->AddElement(std::make_unique<LittleEngine::UI::UILabel>(glm::vec2{5, size.y * 0.95}, "Hello World!", 32.f));
+		label = m_retainedUI.AddElement("HUD", std::make_unique<LittleEngine::UI::UILabel>(glm::vec2{5, size.y * 0.95}, "Hello World!", 32.f));
 		
+		glm::vec2 buttonPos = { size.x / 2 - 50, size.x * 0.6f };
+		glm::vec2 buttonSize = { 100, 50 };
 		std::unique_ptr<LittleEngine::UI::UIButton> button = std::make_unique<LittleEngine::UI::UIButton>(
-			glm::vec2{ size.x / 2 - 50, size.x * 0.6f }, 
-			glm::vec2{100, 50}, "Button");
+			buttonPos, 
+			buttonSize, "Button");
 		
 		button->SetOnClickCallback([&]() {
-			std::cout << "Button clicked!\n";
-			m_uiSystem->ToggleContext("Menu");	// toggle HUD context
+			GAME_LOG_INFO("Button clicked!");
+			m_retainedUI.ToggleContext("Menu");	// toggle HUD context
 		});
-		hud->AddElement(std::move(button));
+		m_retainedUI.AddElement("HUD", std::move(button), glm::vec4(buttonPos, buttonSize));
 		
-		menu->AddElement(std::make_unique<LittleEngine::UI::UILabel>(glm::vec2{ size.x / 2 - 30, size.y * 0.9f }, "Menu", 32.f));
+		m_retainedUI.AddElement("Menu", std::make_unique<LittleEngine::UI::UILabel>(glm::vec2{ size.x / 2 - 30, size.y * 0.9f }, "Menu", 32.f));
 
+		glm::vec2 checkboxPos = { size.x / 2 - 50, size.x * 0.4f };
+		float checkboxSize = 40.f;
 		std::unique_ptr<LittleEngine::UI::UICheckbox> cb = std::make_unique<LittleEngine::UI::UICheckbox>(
-			glm::vec2{ size.x / 2 - 50, size.x * 0.4f }, 
-			40.f, "Checkbox", false);
+			checkboxPos, 
+			checkboxSize, "Checkbox", false);
 
 		cb->SetOnToggleCallback([&](bool state) {
-			std::cout << "Checkbox state: " << (state ? "Checked" : "Unchecked") << "\n";
+			GAME_LOG_INFO("Checkbox state: %s", state ? "Checked" : "Unchecked");
 			});
 		
-		menu->AddElement(std::move(cb));
+		cb_ptr = m_retainedUI.AddElement("Menu", std::move(cb), glm::vec4(checkboxPos, checkboxSize, checkboxSize));
 
-		m_uiSystem->ShowContext("HUD");	// show HUD context by default
+		m_retainedUI.ShowContext("HUD");	// show HUD context by default
 	}
 
 	void Game::InitializeScene()
 	{
-		ResizeFBOs();
-
 		// Creating tilemap
 		//				0		1		2		3
 		tileIDs = { {3, 15}, {2, 15}, {1, 15}, {0, 15} };
@@ -411,7 +498,9 @@ namespace game
 	void Game::InitializeLight()
 	{
 
-		blurShader.Create(RESOURCES_PATH "fullscreen_quad.vert", RESOURCES_PATH "blur.frag", true);
+		blurShader = m_shaderCache.Load(RESOURCES_PATH "fullscreen_quad.vert", RESOURCES_PATH "blur.frag");
+		if (!blurShader)
+			GAME_LOG_ERROR("no blur shader, the light target is not blurred");
 		//lightSceneMergingShader.Create(RESOURCES_PATH "fullscreen_quad.vert", RESOURCES_PATH "merge_light_scene.frag", true);
 
 		std::vector<glm::vec2> vertices = {
@@ -420,7 +509,7 @@ namespace game
 			{ 1.f, 1.f },
 			{ -1.f, 1.f }
 		};
-		obstacles.push_back(m_lightSystem->CreateObstacle(vertices));
+		obstacles.push_back(m_lights.CreateObstacle(vertices));
 
 		vertices = {
 
@@ -428,30 +517,367 @@ namespace game
 			{ -2.f, -3.f },
 			{ -1.f, -2.f }
 		};
-		obstacles.push_back(m_lightSystem->CreateObstacle(vertices));
+		obstacles.push_back(m_lights.CreateObstacle(vertices));
 
 		vertices = {
 			{ -4.f, 3.f },
 			{ -3.f, 4.f },
 			{ -4.f, 5.f }
 		};
-		obstacles.push_back(m_lightSystem->CreateObstacle(vertices));
+		obstacles.push_back(m_lights.CreateObstacle(vertices));
 
-		lightSources.push_back(m_lightSystem->CreateLightSource({ 0.f, 0.f }, { 1.f, 1.f, 1.f }, 1.f, 10.f));
-		lightSources.push_back(m_lightSystem->CreateLightSource({ 3.f, 3.f }, { 0.f, 1.f, 1.f }, 1.f, 4.f));
-		lightSources.push_back(m_lightSystem->CreateLightSource({ -3.f, -3.f }, { 1.f, 0.f, .5f }, 2.f, 15.f));
+		lightSources.push_back(m_lights.CreateLight({ 0.f, 0.f }, { 1.f, 1.f, 1.f }, 1.f, 10.f));
+		lightSources.push_back(m_lights.CreateLight({ 3.f, 3.f }, { 0.f, 1.f, 1.f }, 1.f, 4.f));
+		lightSources.push_back(m_lights.CreateLight({ -3.f, -3.f }, { 1.f, 0.f, .5f }, 2.f, 15.f));
 
 
 	}
 
+	void Game::InitializeWorld()
+	{
+		const std::string path = "maps/world.ltm";
+		const uint32_t size = 1024;
+
+		// generate the test world once, afterwards it is only streamed
+		if (!std::filesystem::exists(path))
+		{
+			std::filesystem::create_directories("maps");
+
+			std::vector<std::vector<uint32_t>> layers(2, std::vector<uint32_t>(size * size, ChunkedTilemap::s_emptyTile));
+			for (uint32_t y = 0; y < size; y++)
+			{
+				for (uint32_t x = 0; x < size; x++)
+				{
+					layers[0][y * size + x] = WorldTile(x, y, 0);
+					layers[1][y * size + x] = WorldTile(x, y, 1);
+				}
+			}
+
+			if (!ChunkedTilemap::WriteMapFile(path, size, size, 32, layers))
+				GAME_LOG_ERROR("could not write %s", path);
+		}
+
+		ChunkedTilemap::Settings settings;
+		settings.origin = { -512.f, -512.f };
+		settings.tileSize = 1.f;
+		settings.memoryBudget = 16 << 20;
+
+		m_world.SetTileSetTexture(minecraft_blocks, minecraft_atlas);
+		m_world.SetTileSetAtlasKey(tileIDs);
+		m_world.Open(path, settings);
+	}
+
+	void Game::InitializeParticles()
+	{
+		m_particles.Initialize(&m_lights, &m_frameArena);
+
+		// torch sparks around the second light, a few of them light up the scene
+		EmitterSettings settings;
+		settings.position = m_lights.GetPosition(lightSources[1]);
+		settings.rate = 60.f;
+		settings.maxParticles = 512;
+		settings.lifetimeMin = 0.4f;
+		settings.lifetimeMax = 1.2f;
+		settings.spread = 1.2f;
+		settings.speedMin = 1.f;
+		settings.speedMax = 3.f;
+		settings.gravity = { 0.f, -4.f };
+		settings.colorStart = { 1.f, 0.8f, 0.3f, 1.f };
+		settings.colorEnd = { 1.f, 0.2f, 0.f, 0.f };
+		settings.sizeStart = 0.12f;
+		settings.sizeEnd = 0.02f;
+		settings.texture = &minecraft_blocks;
+		settings.uv = minecraft_atlas.GetUV(1, 15);
+		settings.emitLight = true;
+		settings.maxLights = 6;
+		settings.lightRadius = 1.5f;
+		sparks = m_particles.CreateEmitter(settings);
+
+		// burst only
+		settings.rate = 0.f;
+		settings.maxParticles = 1 << 16;
+		settings.spread = 6.2832f;
+		settings.speedMin = 2.f;
+		settings.speedMax = 12.f;
+		settings.drag = 2.f;
+		settings.gravity = { 0.f, -2.f };
+		settings.emitLight = false;
+		explosions = m_particles.CreateEmitter(settings);
+
+		// dust for the stress test, the rate comes from the debug window
+		settings.maxParticles = 1 << 18;
+		settings.lifetimeMin = 1.f;
+		settings.lifetimeMax = 3.f;
+		settings.speedMin = 0.5f;
+		settings.speedMax = 4.f;
+		settings.drag = 0.5f;
+		settings.gravity = { 0.f, 0.f };
+		settings.colorStart = { 0.8f, 0.8f, 0.8f, 0.6f };
+		settings.colorEnd = { 0.5f, 0.5f, 0.5f, 0.f };
+		settings.sizeStart = 0.05f;
+		settings.sizeEnd = 0.1f;
+		settings.uv = minecraft_atlas.GetUV(2, 15);
+		particleStress = m_particles.CreateEmitter(settings);
+	}
+
+	void Game::InitializeCollision()
+	{
+		m_collision.SetFrameArena(&m_frameArena);
+
+		// the light obstacles and the small tilemap are the static level
+		const LightStore::ObstacleRange* ranges = m_lights.GetObstacleRanges();
+		const glm::vec2* vertices = m_lights.GetObstacleVertices();
+		for (size_t i = 0; i < m_lights.GetObstacleCount(); i++)
+		{
+			LittleEngine::Math::Polygon obstacle;
+			obstacle.vertices.assign(vertices + ranges[i].first, vertices + ranges[i].first + ranges[i].count);
+
+			ColliderDesc desc;
+			desc.isStatic = true;
+			m_collision.CreatePolygon(obstacle, desc);
+		}
+
+		m_collision.SetTileGrid(world, 10, 10, { 0.f, 0.f }, 1.f, { 0 });
+
+		ColliderDesc desc;
+		desc.position = m_data.rectPos;
+		playerCollider = m_collision.CreateCircle(desc, 0.4f);
+	}
+
+	void Game::InitializeNavigation()
+	{
+		// the streamed world tiles around the origin, decoration blocks and the darker ground is slow
+		const int size = 128;
+		const uint32_t first = 512 - size / 2;
+		std::vector<uint32_t> tiles(size * size);
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				uint32_t decoration = WorldTile(first + x, first + y, 1);
+				tiles[y * size + x] = decoration != ChunkedTilemap::s_emptyTile ? decoration : WorldTile(first + x, first + y, 0);
+			}
+		}
+
+		m_nav.Initialize(size, size, { -size / 2.f, -size / 2.f }, 1.f);
+		m_nav.SetFrameArena(&m_frameArena);
+		m_nav.SetTileCost(3, NavGrid::s_blocked);
+		m_nav.SetTileCost(1, 2);
+		m_nav.SetTiles(tiles.data());
+	}
+
 	void Game::Shutdown()
 	{
+		// the worker finishes it before the store shuts down
+		SaveSnapshot();
+		m_snapshots.Shutdown();
+
+		m_world.Close();
+		m_retainedUI.Shutdown();
+		m_spriteBatch.Shutdown();
+		m_textures.Shutdown();
+		m_frameCapture.Shutdown();
+		m_shaderCache.Shutdown();
+		m_renderGraph.Shutdown();
+		m_dynamicResolution.Shutdown();
+		m_visibility.Shutdown();
+		m_particles.Shutdown();
+		m_nav.Shutdown();
+		m_frameArena.Shutdown();
+		Parallel::Shutdown();
 		m_renderer->Shutdown();
 		m_audioSystem->Shutdown();
 		sound.Shutdown();
 
-		//saved the data.
-		// platform::writeEntireFile(RESOURCES_PATH "gameData.data", &gameData, sizeof(GameData));
+		Log::Shutdown();	// last, everything above may still log
+	}
+
+	// chunks that are missing or have a layout this build does not know keep the state from the initialization
+	void Game::LoadSnapshot()
+	{
+		if (!m_snapshots.Map(s_snapshotPath))
+			return;
+
+		uint32_t version = 0;
+		SnapshotReader reader;
+		if (m_snapshots.ReadChunk(s_gameChunk, version, reader) && version == 1)
+		{
+			reader.Read(m_data.rectPos);
+			reader.Read(m_data.pos2);
+			reader.Read(m_data.zoom);
+			m_data.zoom = ClampLoaded(m_data.zoom, 0.1f, 100.f);
+			reader.Read(m_data.A);
+			reader.Read(m_data.B);
+			reader.Read(m_data.C);
+			reader.Read(m_data.D);
+			reader.Read(m_data.color);
+		}
+
+		if (m_snapshots.ReadChunk(s_lightChunk, version, reader) && version == 1)
+		{
+			uint32_t count = 0;
+			reader.Read(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				glm::vec2 position;
+				glm::vec3 lightColor;
+				float intensity;
+				float radius;
+				if (!reader.Read(position) || !reader.Read(lightColor) || !reader.Read(intensity) || !reader.Read(radius))
+					break;
+				if (i >= lightSources.size())
+					continue;
+
+				m_lights.SetPosition(lightSources[i], position);
+				m_lights.SetColor(lightSources[i], lightColor);
+				m_lights.SetIntensity(lightSources[i], intensity);
+				m_lights.SetRadius(lightSources[i], radius);
+			}
+		}
+
+		// the scene creates the same obstacles every time, the saved shapes replace them in order
+		if (m_snapshots.ReadChunk(s_obstacleChunk, version, reader) && version == 1)
+		{
+			uint32_t count = 0;
+			reader.Read(count);
+			std::vector<glm::vec2> vertices;
+			for (uint32_t i = 0; i < count && i < obstacles.size() && reader.ReadArray(vertices); i++)
+				m_lights.SetObstacleVertices(obstacles[i], vertices);
+		}
+
+		if (m_snapshots.ReadChunk(s_optionsChunk, version, reader) && version == 1)
+		{
+			bool dynamicResolution = m_dynamicResolution.IsEnabled();
+			reader.Read(drawWorld);
+			reader.Read(enableShadows);
+			reader.Read(visibilityPolygons);
+			reader.Read(blurPasses);
+			reader.Read(downscaleFactor);
+			reader.Read(lightIntensity);
+			reader.Read(dynamicResolution);
+			reader.Read(drawFaces);
+			reader.Read(textureBudgetMB);
+			reader.Read(agentCount);
+			reader.Read(autosaveInterval);
+			reader.Read(blurLight);
+			m_dynamicResolution.SetEnabled(dynamicResolution);
+
+			blurPasses = ClampLoaded(blurPasses, 1, 20);
+			downscaleFactor = ClampLoaded(downscaleFactor, 1, 20);
+			lightIntensity = ClampLoaded(lightIntensity, 0.1f, 100.f);
+			textureBudgetMB = ClampLoaded(textureBudgetMB, 16, 1024);
+			agentCount = ClampLoaded(agentCount, 0, 20000);
+			autosaveInterval = ClampLoaded(autosaveInterval, 0.f, 60.f);
+		}
+
+		// regions that were not saved keep the generated tiles
+		glm::ivec2 navSize = m_nav.GetSize();
+		std::vector<uint32_t> tiles(navSize.x * navSize.y);
+		for (int y = 0; y < navSize.y; y++)
+			for (int x = 0; x < navSize.x; x++)
+				tiles[y * navSize.x + x] = m_nav.GetTile(x, y);
+
+		int regionsX = (navSize.x + s_navRegionSize - 1) / s_navRegionSize;
+		int regionsY = (navSize.y + s_navRegionSize - 1) / s_navRegionSize;
+		std::vector<uint32_t> regionTiles;
+		for (int region = 0; region < regionsX * regionsY; region++)
+		{
+			if (!m_snapshots.ReadChunk(NavChunkId(region), version, reader) || version != 1 || !reader.ReadArray(regionTiles))
+				continue;
+
+			glm::ivec2 first = { (region % regionsX) * s_navRegionSize, (region / regionsX) * s_navRegionSize };
+			glm::ivec2 last = glm::min(first + s_navRegionSize, navSize);
+			if (regionTiles.size() != static_cast<size_t>(last.x - first.x) * (last.y - first.y))
+				continue;
+
+			size_t i = 0;
+			for (int y = first.y; y < last.y; y++)
+				for (int x = first.x; x < last.x; x++)
+					tiles[y * navSize.x + x] = regionTiles[i++];
+		}
+		m_nav.SetTiles(tiles.data());
+
+		m_snapshots.Unmap();
+		GAME_LOG_INFO("loaded %s", s_snapshotPath);
+	}
+
+	// only the capture runs here, it is written on the snapshot worker
+	void Game::SaveSnapshot()
+	{
+		m_snapshots.BeginCapture();
+
+		// field by field, so GameData can change without breaking older saves
+		m_snapshots.AddChunk(s_gameChunk, 1, 0, [&](SnapshotWriter& writer)
+		{
+			writer.Write(m_data.rectPos);
+			writer.Write(m_data.pos2);
+			writer.Write(m_data.zoom);
+			writer.Write(m_data.A);
+			writer.Write(m_data.B);
+			writer.Write(m_data.C);
+			writer.Write(m_data.D);
+			writer.Write(m_data.color);
+		});
+
+		// the scene lights, flashes are short lived and not saved
+		m_snapshots.AddChunk(s_lightChunk, 1, 0, [&](SnapshotWriter& writer)
+		{
+			writer.Write(static_cast<uint32_t>(lightSources.size()));
+			for (LightHandle light : lightSources)
+			{
+				writer.Write(m_lights.GetPosition(light));
+				writer.Write(m_lights.GetColor(light));
+				writer.Write(m_lights.GetIntensity(light));
+				writer.Write(m_lights.GetRadius(light));
+			}
+		});
+
+		m_snapshots.AddChunk(s_obstacleChunk, 1, 0, [&](SnapshotWriter& writer)
+		{
+			const LightStore::ObstacleRange* ranges = m_lights.GetObstacleRanges();
+			const glm::vec2* vertices = m_lights.GetObstacleVertices();
+			writer.Write(static_cast<uint32_t>(m_lights.GetObstacleCount()));
+			for (size_t i = 0; i < m_lights.GetObstacleCount(); i++)
+				writer.WriteArray(vertices + ranges[i].first, ranges[i].count);
+		});
+
+		m_snapshots.AddChunk(s_optionsChunk, 1, 0, [&](SnapshotWriter& writer)
+		{
+			writer.Write(drawWorld);
+			writer.Write(enableShadows);
+			writer.Write(visibilityPolygons);
+			writer.Write(blurPasses);
+			writer.Write(downscaleFactor);
+			writer.Write(lightIntensity);
+			writer.Write(m_dynamicResolution.IsEnabled());
+			writer.Write(drawFaces);
+			writer.Write(textureBudgetMB);
+			writer.Write(agentCount);
+			writer.Write(autosaveInterval);
+			writer.Write(blurLight);
+		});
+
+		// the tiles only change with edits, a region whose tiles did not change since the last capture is not copied again
+		glm::ivec2 navSize = m_nav.GetSize();
+		int regionsX = (navSize.x + s_navRegionSize - 1) / s_navRegionSize;
+		int regionsY = (navSize.y + s_navRegionSize - 1) / s_navRegionSize;
+		assert(regionsX * regionsY <= 255);
+		for (int region = 0; region < regionsX * regionsY; region++)
+		{
+			glm::ivec2 first = { (region % regionsX) * s_navRegionSize, (region / regionsX) * s_navRegionSize };
+			glm::ivec2 last = glm::min(first + s_navRegionSize, navSize);
+			m_snapshots.AddChunk(NavChunkId(region), 1, m_nav.GetRevision(first, last), [&](SnapshotWriter& writer)
+			{
+				std::vector<uint32_t> tiles;
+				tiles.reserve(static_cast<size_t>(last.x - first.x) * (last.y - first.y));
+				for (int y = first.y; y < last.y; y++)
+					for (int x = first.x; x < last.x; x++)
+						tiles.push_back(m_nav.GetTile(x, y));
+				writer.WriteArray(tiles.data(), tiles.size());
+			});
+		}
+
+		m_snapshots.Save(s_snapshotPath);
 	}
 
 
@@ -463,6 +889,16 @@ namespace game
 	{
 		delta = dt;
 
+		m_dynamicResolution.BeginFrame();
+
+		// the game frame starts here, Render reads what Update wrote
+		m_frameArena.BeginFrame();
+
+		m_shaderCache.Update(dt);
+
+		m_textures.settings.budgetBytes = static_cast<size_t>(textureBudgetMB) << 20;
+		m_textures.Update();
+
 
 		// check axis input.
 
@@ -474,7 +910,7 @@ namespace game
 		if (length > 1)
 			move /= length;
 
-		m_data.rectPos += move * speed * dt;
+		MovePlayer(move * speed * dt);
 
 		vert = LittleEngine::Input::GetAxis("vertical_alt");
 		hori = LittleEngine::Input::GetAxis("horizontal_alt");
@@ -494,7 +930,23 @@ namespace game
 		if (length > 1)
 			move /= length;
 
-		lightSources[2]->position += move * 10.f * dt;
+		m_lights.Move(lightSources[2], move * 10.f * dt);
+
+		// short-lived lights fade out and give their slot back
+		for (size_t i = 0; i < flashes.size();)
+		{
+			Flash& flash = flashes[i];
+			flash.timeLeft -= dt;
+			if (flash.timeLeft <= 0.f)
+			{
+				m_lights.DestroyLight(flash.light);
+				flashes[i] = flashes.back();
+				flashes.pop_back();
+				continue;
+			}
+			m_lights.SetIntensity(flash.light, flash.intensity * flash.timeLeft / flash.lifetime);
+			i++;
+		}
 
 
 
@@ -504,107 +956,256 @@ namespace game
 
 		m_audioSystem->SetListenerPosition(m_data.rectPos.x, m_data.rectPos.y);
 
+		// visible world rectangle, zoom is in pixels per unit
+		glm::vec2 halfView = glm::vec2(sceneCamera.viewportSize) * 0.5f / sceneCamera.zoom;
+		viewMin = sceneCamera.position - halfView;
+		viewMax = sceneCamera.position + halfView;
 
-		m_uiSystem->Update();
-
-	}
+		if (drawWorld)
+			m_world.Update(viewMin, viewMax);
 
 
-	void Game::Render()
-	{
-#pragma region Game Rendering
+		m_retainedUI.Update();
 
+		m_particles.SetPosition(particleStress, m_data.rectPos);
+		if (EmitterSettings* stress = m_particles.GetSettings(particleStress))
+			stress->rate = static_cast<float>(particleStressRate);
+		m_particles.Update(dt);
 
+		UpdateCollisionBodies(dt);
 
+		m_nav.Update();
+		UpdateAgents(dt);
 
-#pragma region Scene Render
-		// render scene to fbo
-		m_renderer->BeginFrame();
-		m_renderer->SetRenderTarget();
-		m_renderer->SetRenderTarget(&sceneFBO);
-		m_renderer->Clear();
+		// a save still in progress is not queued again, the next interval picks the changes up
+		autosaveTimer += dt;
+		if (autosaveInterval > 0.f && autosaveTimer >= autosaveInterval)
+		{
+			autosaveTimer = 0.f;
+			if (!m_snapshots.IsSaving())
+				SaveSnapshot();
+		}
 
+		// polygons are computed here so gameplay can query them this frame
+		if (visibilityPolygons)
+		{
+			m_visibility.Compute(m_lights);
+			playerLit = m_visibility.IsVisible(lightSources[0], m_data.rectPos);
+		}
 
-		// green block from (-10, -10) to (0 0)
-		m_renderer->DrawRect({ -10, -10, 10 , 10 }, m_data.color);
+	}
 
-		// font block from (0, 0) to (15 15)
-		//m_renderer->DrawRect({ 0, 0, 15 , 15 }, font.GetTexture());
 
+	void Game::MovePlayer(glm::vec2 step)
+	{
+		float distance = glm::length(step);
+		if (playerCollides && distance > 0.f)
+		{
+			RayHit hit;
+			if (m_collision.ShapeCast(playerCollider, m_data.rectPos + step, hit, ~s_bodyLayer))
+			{
+				// stop at the contact and slide along the surface with what is left
+				glm::vec2 travelled = step * (hit.distance / distance);
+				glm::vec2 rest = step - travelled;
+				rest -= hit.normal * glm::dot(rest, hit.normal);
 
-		//m_renderer->DrawRect({ -15, 10, 15 , 15 }, texture2);
+				m_collision.SetPosition(playerCollider, m_data.rectPos + travelled);
+				float restDistance = glm::length(rest);
+				if (restDistance > 0.f && m_collision.ShapeCast(playerCollider, m_data.rectPos + travelled + rest, hit, ~s_bodyLayer))
+					rest *= hit.distance / restDistance;
 
+				step = travelled + rest;
+			}
+		}
 
+		m_data.rectPos += step;
+		m_collision.SetPosition(playerCollider, m_data.rectPos);
+	}
 
-		for (int i = 0; i < rect.size(); i++)
+	void Game::UpdateCollisionBodies(float dt)
+	{
+		// stress bodies bouncing around the origin, the count comes from the debug window
+		const float arena = 40.f;
+		while (static_cast<int>(bodies.size()) < bodyCount)
 		{
-			m_renderer->DrawRect(rect[i], minecraft_blocks, color, rect_uv[i]);
-			//m_renderer->DrawRect(rect[i], textures[i], color);
+			ColliderDesc desc;
+			desc.position = { (rand() % 8000) / 100.f - arena, (rand() % 8000) / 100.f - arena };
+			desc.layers = s_bodyLayer;
+			desc.userData = static_cast<uint32_t>(bodies.size()) + 1;
+
+			float size = 0.1f + (rand() % 100) / 400.f;
+			bodies.push_back(rand() % 2 ? m_collision.CreateCircle(desc, size) : m_collision.CreateBox(desc, { size, size * 0.6f }));
+			bodyVelocities.push_back({ (rand() % 1000) / 100.f - 5.f, (rand() % 1000) / 100.f - 5.f });
 		}
-
-		for (size_t i = 0; i < length; i++)
+		while (static_cast<int>(bodies.size()) > bodyCount)
 		{
-			tilemap.Draw(m_renderer.get());		// each call draws the whole timeMap, only for benchmark purposes
+			m_collision.Destroy(bodies.back());
+			bodies.pop_back();
+			bodyVelocities.pop_back();
 		}
 
-		m_renderer->DrawString("LittleEngine Template", { -.97, 4.97 }, font, LittleEngine::Graphics::Colors::Gray, scale);
-		m_renderer->DrawString("LittleEngine Template", { -1, 5 }, font, LittleEngine::Graphics::Colors::White, scale);
-
-		m_renderer->DrawString("Hello Arial", { 0, 0 }, font, LittleEngine::Graphics::Colors::White, scale);
-		m_renderer->DrawString("Hello Default font", { 0, -3 }, LittleEngine::Graphics::Colors::White, scale);
-
-
+		for (size_t i = 0; i < bodies.size(); i++)
+		{
+			glm::vec2 position = m_collision.GetPosition(bodies[i]) + bodyVelocities[i] * dt;
+			glm::vec2& velocity = bodyVelocities[i];
+			if (std::abs(position.x) > arena && position.x * velocity.x > 0.f)
+				velocity.x = -velocity.x;
+			if (std::abs(position.y) > arena && position.y * velocity.y > 0.f)
+				velocity.y = -velocity.y;
+			m_collision.SetPosition(bodies[i], position);
+		}
 
+		m_collision.Step();
 
-		m_renderer->DrawRect(glm::vec4(m_data.pos2, 3.f, 3.f), target.GetTexture());
-
+		// push apart along the contact normal, equal masses exchange their normal velocity,
+		// anything that is not a stress body (level, tiles, player) does not move
+		for (const Contact& contact : m_collision.GetContacts())
+		{
+			uint32_t a = m_collision.GetUserData(contact.a);
+			uint32_t b = m_collision.GetUserData(contact.b);
+			glm::vec2 n = contact.normal;
 
-		LittleEngine::Math::Edge e1 = { m_data.A, m_data.B };
-		LittleEngine::Math::Edge e2 = { m_data.C, m_data.D };
+			if (a && b)
+			{
+				m_collision.Move(contact.a, -n * contact.depth * 0.5f);
+				m_collision.Move(contact.b, n * contact.depth * 0.5f);
+
+				glm::vec2& va = bodyVelocities[a - 1];
+				glm::vec2& vb = bodyVelocities[b - 1];
+				float approach = glm::dot(vb - va, n);
+				if (approach < 0.f)
+				{
+					va += n * approach;
+					vb -= n * approach;
+				}
+			}
+			else if (a)
+			{
+				m_collision.Move(contact.a, -n * contact.depth);
+				glm::vec2& va = bodyVelocities[a - 1];
+				if (glm::dot(va, n) > 0.f)
+					va -= 2.f * glm::dot(va, n) * n;
+			}
+			else if (b)
+			{
+				m_collision.Move(contact.b, n * contact.depth);
+				glm::vec2& vb = bodyVelocities[b - 1];
+				if (glm::dot(vb, n) < 0.f)
+					vb -= 2.f * glm::dot(vb, n) * n;
+			}
+		}
 
-		LittleEngine::Graphics::Color c;
-		if (LittleEngine::Math::SegmentsIntersect(e1, e2))
+		// line of sight fan around the player, answered in one parallel batch
+		if (sightRays)
 		{
-			c = LittleEngine::Graphics::Colors::Green;
+			const int rayCount = 256;
+			rays.resize(rayCount);
+			rayHits.resize(rayCount);
+			for (int i = 0; i < rayCount; i++)
+			{
+				float angle = i * 6.2832f / rayCount;
+				rays[i].origin = m_data.rectPos;
+				rays[i].direction = { std::cos(angle), std::sin(angle) };
+				rays[i].maxDistance = 15.f;
+			}
+			m_collision.RaycastBatch(rays.data(), rayHits.data(), rays.size());
 		}
-		else
+	}
+
+	void Game::UpdateAgents(float dt)
+	{
+		// agents chase the player, all of them read the same flow field
+		// new agents start on a random walkable tile, none are spawned while every tile is blocked
+		if (static_cast<int>(agents.size()) < agentCount)
 		{
-			c = LittleEngine::Graphics::Colors::Red;
+			glm::ivec2 navSize = m_nav.GetSize();
+			std::vector<glm::ivec2> walkable;
+			for (int y = 0; y < navSize.y; y++)
+				for (int x = 0; x < navSize.x; x++)
+					if (m_nav.IsWalkable({ x, y }))
+						walkable.push_back({ x, y });
+
+			while (!walkable.empty() && static_cast<int>(agents.size()) < agentCount)
+				agents.push_back(m_nav.TileToWorld(walkable[rand() % walkable.size()]));
 		}
-		
-		m_renderer->DrawLine(e1, 0.1f, c);
-		m_renderer->DrawLine(e2, 0.1f, c);
+		if (static_cast<int>(agents.size()) > agentCount)
+			agents.resize(agentCount);
 
+		// a new goal tile is built by the next Update, until then the agents keep the previous field
+		const FlowField* field = m_nav.RequestFlowField(m_data.rectPos);
+		if (field)
+			flowGoal = m_data.rectPos;
+		else
+			field = m_nav.RequestFlowField(flowGoal);
 
-		// draw polygon
-		if (polygon.IsValid())
+		if (field)
 		{
-			if (outlineMode)
-			{
-				m_renderer->DrawPolygonOutline(polygon, 0.1f, LittleEngine::Graphics::Colors::White);
-			}
-			else
+			Parallel::For(agents.size(), 1024, [&](size_t begin, size_t end)
 			{
-				m_renderer->DrawPolygon(polygon, LittleEngine::Graphics::Colors::White);
-			}
+				for (size_t i = begin; i < end; i++)
+					agents[i] += m_nav.GetFlowDirection(*field, agents[i]) * agentSpeed * dt;
+			});
 		}
 
+		if (showPath)
+			m_nav.FindPath(m_data.rectPos, m_data.pos2, navPath);
+		else
+			navPath.clear();
+	}
 
+	void Game::Render()
+	{
+#pragma region Game Rendering
 
 
-		m_renderer->Flush();
 
-#pragma endregion
 
+#pragma region Scene Render
+		m_renderer->BeginFrame();
+		m_spriteBatch.ResetStats();
 
-#pragma region Light Render
+		// the post process chain is declared every frame, the graph culls it and assigns pooled targets
+		// below full scale the merge pass upscales to the window
+		TargetDesc sceneDesc;
+		sceneDesc.format = GL_RGB;
+		sceneDesc.scale = m_dynamicResolution.GetSceneScale();
+		TargetDesc lightDesc;
+		lightDesc.format = GL_RGB16F;
+		lightDesc.scale = m_dynamicResolution.IsEnabled() ? m_dynamicResolution.GetLightScale() : 1.f / downscaleFactor;
 
-		m_lightSystem->RenderLighting(m_renderer.get(), &lightFBO, enableShadows);
+		RenderResource sceneTarget = m_renderGraph.CreateTarget("scene", sceneDesc);
+		RenderResource lightTarget = m_renderGraph.CreateTarget("light", lightDesc);
 
-#pragma endregion
+		m_renderGraph.AddPass("scene", {}, { sceneTarget }, [this, sceneTarget](RenderGraph& graph)
+		{
+			RenderScene(graph.GetTarget(sceneTarget));
+		});
 
-		m_renderer->SetRenderTarget();
-		m_renderer->MergeLightScene(lightFBO.GetTexture(), sceneFBO.GetTexture());
+		m_renderGraph.AddPass("light", {}, { lightTarget }, [this, lightTarget](RenderGraph& graph)
+		{
+			if (visibilityPolygons)
+			{
+				m_visibility.Render(sceneCamera, graph.GetTarget(lightTarget));
+			}
+			else
+			{
+				m_lights.Sync();
+				m_lightSystem->RenderLighting(m_renderer.get(), &graph.GetTarget(lightTarget), enableShadows);
+			}
+		});
+
+		if (blurLight)
+			lightTarget = AddBlurPasses(lightTarget, lightDesc, blurPasses);
+
+		m_renderGraph.AddPass("merge", { sceneTarget, lightTarget }, { m_renderGraph.GetBackbuffer() }, [this, sceneTarget, lightTarget](RenderGraph& graph)
+		{
+			m_renderer->SetRenderTarget();
+			m_renderer->MergeLightScene(graph.GetTarget(lightTarget).GetTexture(), graph.GetTarget(sceneTarget).GetTexture());
+		});
+
+		m_renderGraph.Execute();
+
+#pragma endregion
 
 
 
@@ -613,7 +1214,12 @@ namespace game
 
 		// render UI;
 
-		m_uiSystem->Render(m_renderer.get());
+		m_retainedUI.Render(m_renderer.get());
+
+		// collect finished readbacks and issue the requested ones
+		m_frameCapture.EndFrame(delta);
+
+		m_dynamicResolution.EndFrame();
 
 #pragma endregion
 
@@ -626,17 +1232,93 @@ namespace game
 		ImGui::Begin("Debug");
 		ImGui::Text("FPS: %.2f", LittleEngine::GetFPS());
 		ImGui::Text("QuadCount: %d", m_renderer->GetQuadCount());
+		ImGui::Text("Shader cache hits: %d, misses: %d, reloads: %d", m_shaderCache.GetCacheHits(), m_shaderCache.GetCacheMisses(), m_shaderCache.GetReloadCount());
+		Log::Stats logStats = Log::GetStats();
+		ImGui::Text("Log messages: %llu, dropped: %llu, truncated: %llu", (unsigned long long)logStats.written,
+			(unsigned long long)logStats.dropped, (unsigned long long)logStats.truncated);
+		ImGui::Text("UI redraws: %d, UI hit tests: %d", m_retainedUI.GetRedrawCount(), m_retainedUI.GetEngineUpdateCount());
 		ImGui::Text("camera pos: %.1f, %.1f", sceneCamera.position.x, sceneCamera.position.y);
 		ImGui::SliderFloat("Camera Zoom", &m_data.zoom, 0.1f, 100.f);
 		ImGui::SliderFloat("light intensity", &lightIntensity, 0.1f, 100.f);
+		ImGui::Checkbox("Blur light", &blurLight);
 		ImGui::SliderInt("Blur passes", &blurPasses, 1, 20);
-		if (ImGui::SliderInt("Downscale Factor", &downscaleFactor, 1, 20))
+		bool dynamicResolution = m_dynamicResolution.IsEnabled();
+		if (ImGui::Checkbox("Dynamic resolution", &dynamicResolution))
+			m_dynamicResolution.SetEnabled(dynamicResolution);
+		ImGui::Text("Frame CPU %.2f ms, GPU %.2f ms, level %d, scene scale %.2f, light scale %.2f, changes %d",
+			m_dynamicResolution.GetCpuMilliseconds(), m_dynamicResolution.GetGpuMilliseconds(), m_dynamicResolution.GetLevel(),
+			m_dynamicResolution.GetSceneScale(), m_dynamicResolution.GetLightScale(), m_dynamicResolution.GetLevelChanges());
+		if (!dynamicResolution)
+			ImGui::SliderInt("Downscale Factor", &downscaleFactor, 1, 20);
+		const RenderGraph::Stats& graphStats = m_renderGraph.GetStats();
+		ImGui::Text("Render graph: %d passes (%d culled), %d targets on %d pooled (%zu KB, %zu KB unaliased), created %d",
+			graphStats.passes, graphStats.culledPasses, graphStats.transientTargets, graphStats.pooledTargets,
+			graphStats.pooledBytes / 1024, graphStats.unaliasedBytes / 1024, graphStats.createdTargets);
+		ImGui::Checkbox("Enable Shadows", &enableShadows);
+		ImGui::Checkbox("Visibility polygon lights", &visibilityPolygons);
+		if (visibilityPolygons)
 		{
-			// resize the render targets
-			ResizeFBOs();
+			ImGui::Text("Visibility: %d lights, %d edges, %d fan vertices, %.3f ms", m_visibility.GetComputedLights(),
+				m_visibility.GetEdgeCount(), m_visibility.GetFanVertexCount(), m_visibility.GetComputeMilliseconds());
+			ImGui::Text("Player lit by light 0: %s", playerLit ? "yes" : "no");
 		}
-		ImGui::Checkbox("Enable Shadows", &enableShadows);
+		ImGui::SliderInt("Flash count", &flashCount, 1, 200);
+		if (ImGui::Button("Spawn flashes"))
+		{
+			for (int i = 0; i < flashCount; i++)
+			{
+				glm::vec2 p = m_data.rectPos + glm::vec2((rand() % 2000) / 100.f - 10.f, (rand() % 2000) / 100.f - 10.f);
+				float lifetime = 0.2f + (rand() % 100) / 100.f;
+				flashes.push_back({ m_lights.CreateLight(p, { 1.f, 0.7f, 0.3f }, 2.f, 3.f), lifetime, lifetime, 2.f });
+			}
+		}
+		ImGui::Text("Lights: %d (engine pool %d)", (int)m_lights.GetLightCount(), (int)m_lights.GetEngineLightPoolSize());
 		ImGui::Checkbox("Outline Mode", &outlineMode);
+		ImGui::Checkbox("Instanced sprites", &instancedSprites);
+		ImGui::Checkbox("Faces gallery (instanced sprites)", &drawFaces);
+		ImGui::SliderInt("Texture budget (MB)", &textureBudgetMB, 16, 1024);
+		const TextureManager::Stats& textureStats = m_textures.GetStats();
+		ImGui::Text("Textures: %d resident / %d, %.1f MB (peak %.1f MB)%s, pending %d, uploads %d, evictions %d, placeholders %d",
+			textureStats.resident, textureStats.registered, textureStats.residentBytes / 1048576.0, textureStats.peakBytes / 1048576.0,
+			textureStats.overBudget ? " over budget" : "", textureStats.pending, textureStats.uploads, textureStats.evictions,
+			textureStats.placeholderDraws);
+		ImGui::SliderInt("Sprite stress count", &spriteStressCount, 0, 200000);
+		ImGui::Text("Instanced quads: %d, draw calls: %d", m_spriteBatch.GetInstanceCount(), m_spriteBatch.GetDrawCalls());
+		ImGui::SliderInt("Particle stress rate", &particleStressRate, 0, 200000);
+		ImGui::SliderInt("Explosion size", &explosionSize, 10, 20000);
+		if (ImGui::Button("Explosion"))
+		{
+			m_particles.SetPosition(explosions, m_data.rectPos);
+			m_particles.Burst(explosions, explosionSize);
+		}
+		ImGui::Text("Particles: %d in %d emitters, update %.3f ms", m_particles.GetAliveCount(), m_particles.GetEmitterCount(),
+			m_particles.GetUpdateMilliseconds());
+		ImGui::Checkbox("Player collides", &playerCollides);
+		ImGui::Checkbox("Sight rays", &sightRays);
+		ImGui::SliderInt("Collision bodies", &bodyCount, 0, 10000);
+		const CollisionWorld::Stats& collisionStats = m_collision.GetStats();
+		ImGui::Text("Colliders: %d, cell entries: %d, pairs: %d, contacts: %d, step %.3f ms", collisionStats.colliders,
+			collisionStats.cellEntries, collisionStats.pairs, collisionStats.contacts, collisionStats.stepMs);
+		ImGui::SliderInt("Flow field agents", &agentCount, 0, 20000);
+		ImGui::SliderFloat("Agent speed", &agentSpeed, 0.5f, 10.f);
+		ImGui::Checkbox("Path to the second point", &showPath);
+		if (ImGui::Button("Toggle the tile at the second point"))
+		{
+			glm::ivec2 tile = m_nav.WorldToTile(m_data.pos2);
+			m_nav.SetTile(tile.x, tile.y, m_nav.IsWalkable(tile) ? 3 : 2);
+		}
+		if (ImGui::Button("Save snapshot"))
+			SaveSnapshot();
+		ImGui::SliderFloat("Autosave interval (s, 0 = off)", &autosaveInterval, 0.f, 60.f);
+		SnapshotStore::Stats snapshotStats = m_snapshots.GetStats();
+		ImGui::Text("Snapshots: %d saved%s, last: capture %.3f ms (%d chunks shared), save %.3f ms, %d chunks written (%zu B), %d kept%s, file %zu B",
+			snapshotStats.saves, snapshotStats.failed ? ", last failed" : "", snapshotStats.captureMs, snapshotStats.sharedChunks,
+			snapshotStats.saveMs, snapshotStats.writtenChunks, snapshotStats.writtenBytes, snapshotStats.keptChunks,
+			snapshotStats.compacted ? ", compacted" : "", snapshotStats.fileBytes);
+		const NavGrid::Stats& navStats = m_nav.GetStats();
+		ImGui::Text("Nav: %d clusters, %d entrances, %d rebuilt, %d flow fields (%d built), update %.3f ms, last path expanded %d nodes",
+			navStats.clusters, navStats.entrances, navStats.rebuiltClusters, navStats.flowFields, navStats.builtFields,
+			navStats.updateMs, navStats.expandedNodes);
 		//ImGui::SliderFloat("Camera x", &m_data.rectPos.x, -50.f, 50.f);
 		//ImGui::SliderFloat("Camera y", &m_data.rectPos.y, -50.f, 50.f);
 		//ImGui::SliderFloat("Red", &color.x, 0.f, 1.f);
@@ -674,6 +1356,23 @@ namespace game
 		//{
 		//	sound.SetVolume(volume);
 		//}
+		// capture
+		ImGui::SliderInt("Capture every nth frame", &captureInterval, 1, 60);
+		ImGui::SliderFloat("Capture duration", &captureDuration, 0.5f, 60.f);
+		if (ImGui::Checkbox("Capture raw", &captureRaw))
+		{
+			m_frameCapture.format = captureRaw ? FrameCapture::Format::Raw : FrameCapture::Format::Tga;
+		}
+		if (ImGui::Button(m_frameCapture.IsRecording() ? "Stop capture" : "Start capture"))
+		{
+			if (m_frameCapture.IsRecording())
+				m_frameCapture.StopSequence();
+			else
+				m_frameCapture.StartSequence(captureInterval, captureDuration);
+		}
+		ImGui::Text("Captures written: %d, pending: %d, queued: %d, dropped: %d", m_frameCapture.GetWrittenCount(),
+			m_frameCapture.GetPendingReadbacks(), m_frameCapture.GetQueuedWrites(), m_frameCapture.GetDroppedCount());
+
 		ImGui::SliderFloat("scale", &scale, 0.1f, 5.f);
 		ImGui::SliderFloat("speed", &speed, 0.f, 100.f);
 		ImGui::SliderFloat("camera follow speed", &cameraFollowSpeed, 0.f, 30.f);
@@ -681,6 +1380,10 @@ namespace game
 		ImGui::SliderFloat("min camera dist", &minDist, 0.f, 1.f);
 
 		ImGui::SliderInt("Tilemap Count", &length, 0, 200);
+		ImGui::Checkbox("Draw streamed world", &drawWorld);
+		ChunkedTilemap::Stats worldStats = m_world.GetStats();
+		ImGui::Text("World chunks resident: %d (%zu B), pending: %d, loaded: %d, evicted: %d", worldStats.residentChunks,
+			worldStats.residentBytes, worldStats.pendingChunks, worldStats.loadedChunks, worldStats.evictedChunks);
 
 		if (ImGui::Checkbox("wireframe", &w))
 		{
@@ -696,11 +1399,14 @@ namespace game
 		}
 
 		// fps graph
-		if (fpsHistory.size() >= historySize)
+		if (fpsHistory.empty())
 		{
-			fpsHistory.erase(fpsHistory.begin());
+			fpsHistory.assign(historySize, 0.f);
+			distHistory.assign(historySize, 0.f);
 		}
-		fpsHistory.push_back(LittleEngine::GetFPS());
+		fpsHistory[historyOffset] = LittleEngine::GetFPS();
+		distHistory[historyOffset] = sceneCamera.position.x - m_data.rectPos.x;
+		historyOffset = (historyOffset + 1) % historySize;
 
 		float maxfps = 0;
 		for (float f : fpsHistory)
@@ -709,17 +1415,11 @@ namespace game
 				maxfps = f;
 		}
 
-		// Plot the FPS graph
-		ImGui::PlotLines("FPS Graph", fpsHistory.data(), fpsHistory.size(), 0,
+		// Plot the FPS graph, the offset makes ImGui read the ring in order
+		ImGui::PlotLines("FPS Graph", fpsHistory.data(), historySize, historyOffset,
 			nullptr, 0.0f, maxfps * 1.5f, ImVec2(0, 80));
 
 		// camera distance
-		if (distHistory.size() >= historySize)
-		{
-			distHistory.erase(distHistory.begin());
-		}
-		distHistory.push_back(sceneCamera.position.x - m_data.rectPos.x);
-
 		float maxx = 0;
 		for (float f : distHistory)
 		{
@@ -730,9 +1430,20 @@ namespace game
 		}
 
 		// Plot the FPS graph
-		ImGui::PlotLines("Delta x Graph", distHistory.data(), distHistory.size(), 0,
+		ImGui::PlotLines("Delta x Graph", distHistory.data(), historySize, historyOffset,
 			nullptr, -maxx, maxx * 1.2f, ImVec2(0, 80));
 
+		// memory
+		ImGui::Text("Frame arena: %zu / %zu bytes (peak %zu, overflow %zu)", m_frameArena.GetUsed(), m_frameArena.GetCapacity(),
+			m_frameArena.GetPeak(), m_frameArena.GetOverflowBytes());
+		for (int i = 0; i < static_cast<int>(MemoryTag::Count); i++)
+		{
+			Memory::Stats stats = Memory::GetStats(static_cast<MemoryTag>(i));
+			ImGui::Text("%-10s live %8llu B  peak %8llu B  allocs %6llu  frame %4llu (%llu B)", Memory::GetTagName(static_cast<MemoryTag>(i)),
+				(unsigned long long)stats.liveBytes, (unsigned long long)stats.peakBytes, (unsigned long long)stats.allocations,
+				(unsigned long long)stats.frameAllocations, (unsigned long long)stats.frameBytes);
+		}
+
 
 		ImGui::End();
 
@@ -748,85 +1459,217 @@ namespace game
 
 #pragma region Callbacks
 
-	void Game::OnWindowSizeChange(int w, int h)
+	void Game::RenderScene(LittleEngine::Graphics::RenderTarget& sceneTarget)
 	{
-		m_renderer->UpdateWindowSize(w, h);
-		m_uiSystem->UpdateWindowSize(w, h);
-		
-		LittleEngine::Input::UpdateWindowSize(w, h);
+		m_renderer->SetRenderTarget();
+		m_renderer->SetRenderTarget(&sceneTarget);
+		m_renderer->Clear();
 
-		// update the camera
-		sceneCamera.viewportSize = glm::ivec2(w, h);
+		// streamed world goes first, it is the background
+		if (drawWorld)
+		{
+			sceneTarget.Bind();
+			m_spriteBatch.SetCamera(sceneCamera);
+			m_world.Draw(m_spriteBatch, viewMin, viewMax);
+			m_spriteBatch.Flush();
+			m_renderer->shader.Use(); // restore default shader
+		}
 
-		ResizeFBOs();
-	}
 
+		// green block from (-10, -10) to (0 0)
+		m_renderer->DrawRect({ -10, -10, 10 , 10 }, m_data.color);
 
-#pragma endregion
+		// font block from (0, 0) to (15 15)
+		//m_renderer->DrawRect({ 0, 0, 15 , 15 }, font.GetTexture());
 
-	void Game::ResizeFBOs()
-	{
-		// resize the render targets
-		sceneFBO.Cleanup();
-		lightFBO.Cleanup();
 
-		sceneFBO.Create(LittleEngine::GetWindowSize().x, LittleEngine::GetWindowSize().y, GL_RGB);
-		lightFBO.Create(LittleEngine::GetWindowSize().x / downscaleFactor, LittleEngine::GetWindowSize().y / downscaleFactor, GL_RGB16F);
+		//m_renderer->DrawRect({ -15, 10, 15 , 15 }, texture2);
 
-	}
-	void Game::BlurLightTexture(LittleEngine::Graphics::RenderTarget& lightFBO, int passes, LittleEngine::Graphics::Shader& shader)
-	{
-		bool horizontal = true;
-		bool firstIteration = true;
 
-		// 1. Create two ping-pong FBOs
-		LittleEngine::Graphics::RenderTarget pingpongFBO[2];
-		glm::ivec2 size = lightFBO.GetSize();
 
-		for (int i = 0; i < 2; ++i)
-			pingpongFBO[i].Create(size.x, size.y); // should use RGB16F if possible
+		if (instancedSprites)
+		{
+			// keep draw order: everything queued before goes first
+			m_renderer->Flush();
+			sceneTarget.Bind();
+
+			m_spriteBatch.SetCamera(sceneCamera);
+			for (int i = 0; i < rect.size(); i++)
+			{
+				m_spriteBatch.DrawRect(rect[i], minecraft_blocks, color, rect_uv[i]);
+			}
+			for (int i = 0; i < spriteStressCount; i++)
+			{
+				glm::vec4 r = { (i % 1000) * 0.1f - 50.f, (i / 1000) * 0.1f - 50.f, 0.08f, 0.08f };
+				m_spriteBatch.DrawRect(r, minecraft_blocks, color, rect_uv[i % rect_uv.size()]);
+			}
+
+			// faces gallery to the right of the scene, only what is on screen is requested
+			if (drawFaces)
+			{
+				for (size_t i = 0; i < faces.size(); i++)
+				{
+					glm::vec4 r = { 20.f + (i % 20) * 3.5f, -(float)(i / 20) * 4.5f, 3.f, 4.f };
+					if (r.x > viewMax.x || r.x + r.z < viewMin.x || r.y > viewMax.y || r.y + r.w < viewMin.y)
+						continue;
+					m_spriteBatch.DrawRect(r, m_textures.Get(faces[i]));
+				}
+			}
+			m_spriteBatch.Flush();
+
+			m_renderer->shader.Use(); // restore default shader
+		}
+		else
+		{
+			for (int i = 0; i < rect.size(); i++)
+			{
+				m_renderer->DrawRect(rect[i], minecraft_blocks, color, rect_uv[i]);
+				//m_renderer->DrawRect(rect[i], textures[i], color);
+			}
+			for (int i = 0; i < spriteStressCount; i++)
+			{
+				glm::vec4 r = { (i % 1000) * 0.1f - 50.f, (i / 1000) * 0.1f - 50.f, 0.08f, 0.08f };
+				m_renderer->DrawRect(r, minecraft_blocks, color, rect_uv[i % rect_uv.size()]);
+			}
+		}
+
+		// particles
+		m_renderer->Flush();
+		sceneTarget.Bind();
+		m_spriteBatch.SetCamera(sceneCamera);
+		m_particles.Render(m_spriteBatch);
 
-		// 2. Blur Passes
-		shader.Use();
+		// collision stress bodies, drawn as their bounding squares
+		for (ColliderHandle body : bodies)
+		{
+			glm::vec2 p = m_collision.GetPosition(body);
+			m_spriteBatch.DrawRect({ p.x - 0.2f, p.y - 0.2f, 0.4f, 0.4f }, minecraft_blocks, LittleEngine::Graphics::Colors::White, rect_uv[0]);
+		}
+
+		for (glm::vec2 agent : agents)
+			m_spriteBatch.DrawRect({ agent.x - 0.15f, agent.y - 0.15f, 0.3f, 0.3f }, minecraft_blocks, LittleEngine::Graphics::Colors::Red, rect_uv[0]);
+		m_spriteBatch.Flush();
+		m_renderer->shader.Use(); // restore default shader
+
+		for (size_t i = 1; i < navPath.size(); i++)
+		{
+			LittleEngine::Math::Edge e = { navPath[i - 1], navPath[i] };
+			m_renderer->DrawLine(e, 0.05f, LittleEngine::Graphics::Colors::Green);
+		}
+
+		if (sightRays)
+		{
+			for (size_t i = 0; i < rays.size(); i++)
+			{
+				float distance = rayHits[i].hit ? rayHits[i].distance : rays[i].maxDistance;
+				LittleEngine::Math::Edge e = { rays[i].origin, rays[i].origin + rays[i].direction * distance };
+				m_renderer->DrawLine(e, 0.02f, rayHits[i].hit ? LittleEngine::Graphics::Colors::Red : LittleEngine::Graphics::Colors::Gray);
+			}
+		}
+
+		for (size_t i = 0; i < length; i++)
+		{
+			tilemap.Draw(m_renderer.get());		// each call draws the whole timeMap, only for benchmark purposes
+		}
+
+		m_renderer->DrawString("LittleEngine Template", { -.97, 4.97 }, font, LittleEngine::Graphics::Colors::Gray, scale);
+		m_renderer->DrawString("LittleEngine Template", { -1, 5 }, font, LittleEngine::Graphics::Colors::White, scale);
+
+		m_renderer->DrawString("Hello Arial", { 0, 0 }, font, LittleEngine::Graphics::Colors::White, scale);
+		m_renderer->DrawString("Hello Default font", { 0, -3 }, LittleEngine::Graphics::Colors::White, scale);
 
-		shader.SetInt("image", 0);
 
-		for (int i = 0; i < passes * 2; ++i) {
-			pingpongFBO[horizontal].Bind();
-			shader.SetBool("horizontal", horizontal);
-			shader.SetFloat("texelSize", horizontal ? (1.f / size.x) : (1.f / size.y));
 
-			if (firstIteration)
-				lightFBO.GetTexture().Bind(0);
-			else
-				pingpongFBO[!horizontal].GetTexture().Bind(0);
 
+		m_renderer->DrawRect(glm::vec4(m_data.pos2, 3.f, 3.f), target.GetTexture());
+
+
+		LittleEngine::Math::Edge e1 = { m_data.A, m_data.B };
+		LittleEngine::Math::Edge e2 = { m_data.C, m_data.D };
+
+		LittleEngine::Graphics::Color c;
+		if (LittleEngine::Math::SegmentsIntersect(e1, e2))
+		{
+			c = LittleEngine::Graphics::Colors::Green;
+		}
+		else
+		{
+			c = LittleEngine::Graphics::Colors::Red;
+		}
+		
+		m_renderer->DrawLine(e1, 0.1f, c);
+		m_renderer->DrawLine(e2, 0.1f, c);
 
-			m_renderer->FlushFullscreenQuad();
 
-			horizontal = !horizontal;
-			if (firstIteration)
-				firstIteration = false;
+		// draw polygon
+		if (polygon.IsValid())
+		{
+			if (outlineMode)
+			{
+				m_renderer->DrawPolygonOutline(polygon, 0.1f, LittleEngine::Graphics::Colors::White);
+			}
+			else
+			{
+				m_renderer->DrawPolygon(polygon, LittleEngine::Graphics::Colors::White);
+			}
 		}
 
-		// 3. Final pass: write blurred result back into lightFBO
-		lightFBO.Bind();  // bind original light FBO as target
-		shader.SetBool("horizontal", false); // doesn't matter, we just draw the final result
-		shader.SetFloat("texelSize", 1.f/ size.y); // doesn't matter, we just draw the final result
-		pingpongFBO[!horizontal].GetTexture().Bind(0); // final blurred texture
 
-		shader.SetInt("image", 0);
 
-		m_renderer->FlushFullscreenQuad();
 
-		// 4. Cleanup temporary FBOs
-		for (int i = 0; i < 2; ++i)
-			pingpongFBO[i].Cleanup();
+		m_renderer->Flush();
+	}
 
-		lightFBO.Unbind(); // unbind the light FBO to restore default framebuffer
+	// separable blur, every direction writes a new target so the graph can alias the ping-pong pair
+	RenderResource Game::AddBlurPasses(RenderResource source, const TargetDesc& desc, int passes)
+	{
+		if (!blurShader)
+			return source;
 
-		m_renderer->shader.Use(); // restore default shader
+		for (int i = 0; i < passes * 2; i++)
+		{
+			bool horizontal = (i % 2) == 0;
+			RenderResource blurred = m_renderGraph.CreateTarget(horizontal ? "blur horizontal" : "blur vertical", desc);
+
+			m_renderGraph.AddPass("blur", { source }, { blurred }, [this, source, blurred, horizontal](RenderGraph& graph)
+			{
+				LittleEngine::Graphics::RenderTarget& output = graph.GetTarget(blurred);
+				glm::ivec2 size = graph.GetSize(blurred);
+
+				output.Bind();
+				blurShader->Use();
+				blurShader->SetInt("image", 0);
+				blurShader->SetBool("horizontal", horizontal);
+				blurShader->SetFloat("texelSize", horizontal ? (1.f / size.x) : (1.f / size.y));
+				graph.GetTarget(source).GetTexture().Bind(0);
+
+				m_renderer->FlushFullscreenQuad();
+
+				output.Unbind();
+				m_renderer->shader.Use(); // restore default shader
+			});
+
+			source = blurred;
+		}
+		return source;
 	}
 
+	void Game::OnWindowSizeChange(int w, int h)
+	{
+		m_renderer->UpdateWindowSize(w, h);
+		m_uiSystem->UpdateWindowSize(w, h);
+		m_retainedUI.UpdateWindowSize(w, h);
+		
+		LittleEngine::Input::UpdateWindowSize(w, h);
+
+		// update the camera
+		sceneCamera.viewportSize = glm::ivec2(w, h);
+
+		m_renderGraph.Resize({ w, h });
+	}
+
+
+#pragma endregion
+
 }
 
@@ -0,0 +1,312 @@
+#include "lightStore.h"
+
+#include <algorithm>
+
+
+namespace game
+{
+
+	void LightStore::Initialize(LittleEngine::Graphics::LightSystem* lightSystem)
+	{
+		m_lightSystem = lightSystem;
+	}
+
+
+#pragma region Lights
+
+	LightHandle LightStore::CreateLight(glm::vec2 position, glm::vec3 color, float intensity, float radius)
+	{
+		uint32_t slot = AllocateSlot(m_lightSlots, m_freeLightSlots);
+		uint32_t dense = static_cast<uint32_t>(m_positions.size());
+
+		m_positions.push_back(position);
+		m_colors.push_back(color);
+		m_intensities.push_back(intensity);
+		m_radii.push_back(radius);
+		m_lightDenseToSlot.push_back(slot);
+
+		m_lightSlots[slot].dense = dense;
+		m_lightSlots[slot].alive = true;
+
+		return { slot, m_lightSlots[slot].generation };
+	}
+
+	void LightStore::DestroyLight(LightHandle handle)
+	{
+		int dense = GetLightDense(handle);
+		if (dense < 0)
+			return;
+
+		// swap-remove keeps the arrays dense
+		size_t last = m_positions.size() - 1;
+		m_positions[dense] = m_positions[last];
+		m_colors[dense] = m_colors[last];
+		m_intensities[dense] = m_intensities[last];
+		m_radii[dense] = m_radii[last];
+		m_lightDenseToSlot[dense] = m_lightDenseToSlot[last];
+		m_lightSlots[m_lightDenseToSlot[dense]].dense = dense;
+
+		m_positions.pop_back();
+		m_colors.pop_back();
+		m_intensities.pop_back();
+		m_radii.pop_back();
+		m_lightDenseToSlot.pop_back();
+
+		Slot& slot = m_lightSlots[handle.index];
+		slot.alive = false;
+		if (++slot.generation == 0)
+			slot.generation = 1;
+		m_freeLightSlots.push_back(handle.index);
+	}
+
+	bool LightStore::IsAlive(LightHandle handle) const
+	{
+		return GetLightDense(handle) >= 0;
+	}
+
+	glm::vec2 LightStore::GetPosition(LightHandle handle) const
+	{
+		int dense = GetLightDense(handle);
+		return dense >= 0 ? m_positions[dense] : glm::vec2(0.f);
+	}
+
+	glm::vec3 LightStore::GetColor(LightHandle handle) const
+	{
+		int dense = GetLightDense(handle);
+		return dense >= 0 ? m_colors[dense] : glm::vec3(0.f);
+	}
+
+	float LightStore::GetIntensity(LightHandle handle) const
+	{
+		int dense = GetLightDense(handle);
+		return dense >= 0 ? m_intensities[dense] : 0.f;
+	}
+
+	float LightStore::GetRadius(LightHandle handle) const
+	{
+		int dense = GetLightDense(handle);
+		return dense >= 0 ? m_radii[dense] : 0.f;
+	}
+
+	void LightStore::SetPosition(LightHandle handle, glm::vec2 position)
+	{
+		int dense = GetLightDense(handle);
+		if (dense >= 0)
+			m_positions[dense] = position;
+	}
+
+	void LightStore::Move(LightHandle handle, glm::vec2 delta)
+	{
+		int dense = GetLightDense(handle);
+		if (dense >= 0)
+			m_positions[dense] += delta;
+	}
+
+	void LightStore::SetColor(LightHandle handle, glm::vec3 color)
+	{
+		int dense = GetLightDense(handle);
+		if (dense >= 0)
+			m_colors[dense] = color;
+	}
+
+	void LightStore::SetIntensity(LightHandle handle, float intensity)
+	{
+		int dense = GetLightDense(handle);
+		if (dense >= 0)
+			m_intensities[dense] = intensity;
+	}
+
+	void LightStore::SetRadius(LightHandle handle, float radius)
+	{
+		int dense = GetLightDense(handle);
+		if (dense >= 0)
+			m_radii[dense] = radius;
+	}
+
+	LightHandle LightStore::GetLightHandle(size_t denseIndex) const
+	{
+		uint32_t slot = m_lightDenseToSlot[denseIndex];
+		return { slot, m_lightSlots[slot].generation };
+	}
+
+#pragma endregion
+
+
+#pragma region Obstacles
+
+	ObstacleHandle LightStore::CreateObstacle(const std::vector<glm::vec2>& vertices)
+	{
+		uint32_t slot = AllocateSlot(m_obstacleSlots, m_freeObstacleSlots);
+		uint32_t dense = static_cast<uint32_t>(m_obstacleRanges.size());
+
+		m_obstacleRanges.push_back({ static_cast<uint32_t>(m_obstacleVertices.size()), static_cast<uint32_t>(vertices.size()) });
+		m_obstacleVertices.insert(m_obstacleVertices.end(), vertices.begin(), vertices.end());
+		m_obstacleDirty.push_back(1);
+		m_obstacleDenseToSlot.push_back(slot);
+
+		m_obstacleSlots[slot].dense = dense;
+		m_obstacleSlots[slot].alive = true;
+
+		return { slot, m_obstacleSlots[slot].generation };
+	}
+
+	void LightStore::DestroyObstacle(ObstacleHandle handle)
+	{
+		int dense = GetObstacleDense(handle);
+		if (dense < 0)
+			return;
+
+		// the vertices become garbage until the next compaction
+		m_deadObstacleVertices += m_obstacleRanges[dense].count;
+
+		size_t last = m_obstacleRanges.size() - 1;
+		m_obstacleRanges[dense] = m_obstacleRanges[last];
+		m_obstacleDenseToSlot[dense] = m_obstacleDenseToSlot[last];
+		m_obstacleDirty[dense] = 1;		// now mirrored by another engine polygon
+		m_obstacleSlots[m_obstacleDenseToSlot[dense]].dense = dense;
+
+		m_obstacleRanges.pop_back();
+		m_obstacleDenseToSlot.pop_back();
+		m_obstacleDirty.pop_back();
+
+		Slot& slot = m_obstacleSlots[handle.index];
+		slot.alive = false;
+		if (++slot.generation == 0)
+			slot.generation = 1;
+		m_freeObstacleSlots.push_back(handle.index);
+	}
+
+	bool LightStore::IsAlive(ObstacleHandle handle) const
+	{
+		return GetObstacleDense(handle) >= 0;
+	}
+
+	void LightStore::SetObstacleVertices(ObstacleHandle handle, const std::vector<glm::vec2>& vertices)
+	{
+		int dense = GetObstacleDense(handle);
+		if (dense < 0)
+			return;
+
+		ObstacleRange& range = m_obstacleRanges[dense];
+		if (range.count == vertices.size())
+		{
+			std::copy(vertices.begin(), vertices.end(), m_obstacleVertices.begin() + range.first);
+		}
+		else
+		{
+			m_deadObstacleVertices += range.count;
+			range.first = static_cast<uint32_t>(m_obstacleVertices.size());
+			range.count = static_cast<uint32_t>(vertices.size());
+			m_obstacleVertices.insert(m_obstacleVertices.end(), vertices.begin(), vertices.end());
+		}
+		m_obstacleDirty[dense] = 1;
+	}
+
+#pragma endregion
+
+
+	void LightStore::Sync()
+	{
+		// lights: linear copy into the pool
+		size_t lightCount = m_positions.size();
+		while (m_engineLights.size() < lightCount)
+		{
+			size_t i = m_engineLights.size();
+			m_engineLights.push_back(m_lightSystem->CreateLightSource(m_positions[i], m_colors[i], m_intensities[i], m_radii[i]));
+		}
+
+		for (size_t i = 0; i < lightCount; i++)
+		{
+			LittleEngine::Graphics::LightSource* light = m_engineLights[i];
+			light->position = m_positions[i];
+			light->color = m_colors[i];
+			light->intensity = m_intensities[i];
+			light->radius = m_radii[i];
+		}
+		// surplus lights would still cost a lighting pass and their shadow quads, give them back
+		while (m_engineLights.size() > lightCount)
+		{
+			m_lightSystem->RemoveLightSource(m_engineLights.back());
+			m_engineLights.pop_back();
+		}
+
+		// obstacles: only changed ones are copied
+		if (m_deadObstacleVertices > m_obstacleVertices.size() / 2)
+			CompactObstacleVertices();
+
+		size_t obstacleCount = m_obstacleRanges.size();
+		for (size_t i = 0; i < obstacleCount; i++)
+		{
+			if (!m_obstacleDirty[i])
+				continue;
+
+			const ObstacleRange& range = m_obstacleRanges[i];
+			const glm::vec2* begin = m_obstacleVertices.data() + range.first;
+
+			if (i < m_enginePolygons.size())
+				m_enginePolygons[i]->vertices.assign(begin, begin + range.count);
+			else
+				m_enginePolygons.push_back(m_lightSystem->CreateObstacle(std::vector<glm::vec2>(begin, begin + range.count)));
+
+			m_obstacleDirty[i] = 0;
+		}
+		while (m_enginePolygons.size() > obstacleCount)
+		{
+			m_lightSystem->RemoveObstacle(m_enginePolygons.back());
+			m_enginePolygons.pop_back();
+		}
+	}
+
+
+	uint32_t LightStore::AllocateSlot(std::vector<Slot>& slots, std::vector<uint32_t>& freeSlots)
+	{
+		if (!freeSlots.empty())
+		{
+			uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			return slot;
+		}
+
+		slots.push_back({});
+		return static_cast<uint32_t>(slots.size() - 1);
+	}
+
+	int LightStore::GetLightDense(LightHandle handle) const
+	{
+		if (handle.index >= m_lightSlots.size())
+			return -1;
+
+		const Slot& slot = m_lightSlots[handle.index];
+		if (!slot.alive || slot.generation != handle.generation)
+			return -1;
+		return static_cast<int>(slot.dense);
+	}
+
+	int LightStore::GetObstacleDense(ObstacleHandle handle) const
+	{
+		if (handle.index >= m_obstacleSlots.size())
+			return -1;
+
+		const Slot& slot = m_obstacleSlots[handle.index];
+		if (!slot.alive || slot.generation != handle.generation)
+			return -1;
+		return static_cast<int>(slot.dense);
+	}
+
+	void LightStore::CompactObstacleVertices()
+	{
+		std::vector<glm::vec2> vertices;
+		vertices.reserve(m_obstacleVertices.size() - m_deadObstacleVertices);
+
+		for (ObstacleRange& range : m_obstacleRanges)
+		{
+			uint32_t first = static_cast<uint32_t>(vertices.size());
+			vertices.insert(vertices.end(), m_obstacleVertices.begin() + range.first, m_obstacleVertices.begin() + range.first + range.count);
+			range.first = first;
+		}
+
+		m_obstacleVertices = std::move(vertices);
+		m_deadObstacleVertices = 0;
+	}
+
+}
@@ -0,0 +1,737 @@
+#include "navGrid.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr float s_infinity = std::numeric_limits<float>::infinity();
+		constexpr uint16_t s_noParent = 0xFFFF;
+		constexpr float s_diagonal = 1.41421356f;
+
+		// orthogonal first, their index is the bit in Entrance::exits
+		const glm::ivec2 s_directions[8] = {
+			{ 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 },
+			{ 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 },
+		};
+
+		using OpenList = std::priority_queue<std::pair<float, uint32_t>, std::vector<std::pair<float, uint32_t>>,
+			std::greater<std::pair<float, uint32_t>>>;
+		using FrameOpenList = std::priority_queue<std::pair<float, uint32_t>, FrameVector<std::pair<float, uint32_t>>,
+			std::greater<std::pair<float, uint32_t>>>;
+
+		uint32_t LocalIndex(glm::ivec2 min, glm::ivec2 max, glm::ivec2 tile)
+		{
+			return static_cast<uint32_t>((tile.y - min.y) * (max.x - min.x) + tile.x - min.x);
+		}
+
+		// admissible, every step costs at least its length
+		float Octile(glm::ivec2 a, glm::ivec2 b)
+		{
+			glm::ivec2 d = glm::abs(a - b);
+			return static_cast<float>(std::max(d.x, d.y)) + (s_diagonal - 1.f) * static_cast<float>(std::min(d.x, d.y));
+		}
+	}
+
+	void NavGrid::Initialize(int width, int height, glm::vec2 origin, float tileSize)
+	{
+		Shutdown();
+
+		m_width = std::max(width, 1);
+		m_height = std::max(height, 1);
+		m_origin = origin;
+		m_tileSize = tileSize;
+
+		m_tiles.assign(static_cast<size_t>(m_width) * m_height, 0);
+		m_costs.assign(m_tiles.size(), LookupCost(0));
+
+		// local tile indices of a cluster are 16 bit
+		m_clusterSize = std::clamp(settings.clusterSize, 2, 255);
+		m_clustersX = (m_width + m_clusterSize - 1) / m_clusterSize;
+		m_clustersY = (m_height + m_clusterSize - 1) / m_clusterSize;
+		m_clusters.resize(static_cast<size_t>(m_clustersX) * m_clustersY);
+		for (int cy = 0; cy < m_clustersY; cy++)
+		{
+			for (int cx = 0; cx < m_clustersX; cx++)
+			{
+				Cluster& cluster = m_clusters[cy * m_clustersX + cx];
+				cluster.min = { cx * m_clusterSize, cy * m_clusterSize };
+				cluster.max = glm::min(cluster.min + m_clusterSize, glm::ivec2(m_width, m_height));
+				cluster.revision = m_revision;
+				cluster.dirty = true;
+			}
+		}
+		m_clustersDirty = true;
+
+		m_stats = {};
+		m_stats.clusters = static_cast<int>(m_clusters.size());
+		m_initialized = true;
+	}
+
+	void NavGrid::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		m_tiles.clear();
+		m_costs.clear();
+		m_clusters.clear();
+		m_fields.clear();
+		m_buildList.clear();
+		m_clustersDirty = false;
+
+		m_initialized = false;
+	}
+
+	#pragma region tiles
+
+	void NavGrid::SetTileCost(uint32_t tile, uint8_t cost)
+	{
+		m_tileCosts[tile] = cost;
+
+		for (size_t i = 0; i < m_tiles.size(); i++)
+		{
+			if (m_tiles[i] == tile && m_costs[i] != cost)
+			{
+				m_costs[i] = cost;
+				MarkDirty(Tile(static_cast<uint32_t>(i)));
+			}
+		}
+	}
+
+	void NavGrid::SetTiles(const uint32_t* tiles)
+	{
+		if (!m_initialized)
+			return;
+
+		m_tiles.assign(tiles, tiles + m_tiles.size());
+		m_revision++;
+		for (size_t i = 0; i < m_tiles.size(); i++)
+			m_costs[i] = LookupCost(m_tiles[i]);
+
+		for (Cluster& cluster : m_clusters)
+		{
+			cluster.revision = m_revision;
+			cluster.dirty = true;
+		}
+		m_clustersDirty = true;
+		for (auto& [goal, entry] : m_fields)
+			entry->dirty = true;
+	}
+
+	void NavGrid::SetTile(int x, int y, uint32_t tile)
+	{
+		if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+			return;
+
+		uint32_t index = Index({ x, y });
+		if (m_tiles[index] != tile)
+		{
+			m_revision++;
+			m_clusters[ClusterOf({ x, y })].revision = m_revision;
+		}
+		m_tiles[index] = tile;
+
+		uint8_t cost = LookupCost(tile);
+		if (m_costs[index] == cost)
+			return;
+
+		m_costs[index] = cost;
+		MarkDirty({ x, y });
+	}
+
+	uint64_t NavGrid::GetRevision(glm::ivec2 min, glm::ivec2 max) const
+	{
+		if (!m_initialized)
+			return m_revision;
+
+		min = glm::clamp(min, glm::ivec2(0), glm::ivec2(m_width, m_height) - 1);
+		max = glm::clamp(max, glm::ivec2(1), glm::ivec2(m_width, m_height));
+		uint64_t revision = 0;
+		for (int cy = min.y / m_clusterSize; cy <= (max.y - 1) / m_clusterSize; cy++)
+			for (int cx = min.x / m_clusterSize; cx <= (max.x - 1) / m_clusterSize; cx++)
+				revision = std::max(revision, m_clusters[cy * m_clustersX + cx].revision);
+		return revision;
+	}
+
+	uint32_t NavGrid::GetTile(int x, int y) const
+	{
+		if (x < 0 || y < 0 || x >= m_width || y >= m_height)
+			return 0;
+		return m_tiles[Index({ x, y })];
+	}
+
+	bool NavGrid::IsWalkable(glm::ivec2 tile) const
+	{
+		if (tile.x < 0 || tile.y < 0 || tile.x >= m_width || tile.y >= m_height || m_costs.empty())
+			return false;
+		return m_costs[Index(tile)] != s_blocked;
+	}
+
+	glm::ivec2 NavGrid::WorldToTile(glm::vec2 position) const
+	{
+		return glm::ivec2(glm::floor((position - m_origin) / m_tileSize));
+	}
+
+	glm::vec2 NavGrid::TileToWorld(glm::ivec2 tile) const
+	{
+		return m_origin + (glm::vec2(tile) + 0.5f) * m_tileSize;
+	}
+
+	glm::ivec2 NavGrid::GetDirection(int index)
+	{
+		return s_directions[index];
+	}
+
+	uint8_t NavGrid::LookupCost(uint32_t tile) const
+	{
+		auto it = m_tileCosts.find(tile);
+		return it != m_tileCosts.end() ? it->second : 1;
+	}
+
+	// the target is inside [min, max) and walkable, diagonal steps need both orthogonal tiles free
+	bool NavGrid::CanStep(glm::ivec2 from, glm::ivec2 direction, glm::ivec2 min, glm::ivec2 max) const
+	{
+		glm::ivec2 to = from + direction;
+		if (to.x < min.x || to.y < min.y || to.x >= max.x || to.y >= max.y)
+			return false;
+		if (m_costs[Index(to)] == s_blocked)
+			return false;
+		if (direction.x != 0 && direction.y != 0)
+			return m_costs[Index({ to.x, from.y })] != s_blocked && m_costs[Index({ from.x, to.y })] != s_blocked;
+		return true;
+	}
+
+	int NavGrid::ClusterOf(glm::ivec2 tile) const
+	{
+		return (tile.y / m_clusterSize) * m_clustersX + tile.x / m_clusterSize;
+	}
+
+	int NavGrid::FindEntrance(const Cluster& cluster, uint32_t tile) const
+	{
+		for (size_t i = 0; i < cluster.entrances.size(); i++)
+		{
+			if (cluster.entrances[i].tile == tile)
+				return static_cast<int>(i);
+		}
+		return -1;
+	}
+
+	#pragma endregion
+
+	#pragma region clusters
+
+	// the neighbours across a border place their entrances from the same tiles, so they are rebuilt too
+	void NavGrid::MarkDirty(glm::ivec2 tile)
+	{
+		if (!m_initialized)
+			return;
+
+		Cluster& cluster = m_clusters[ClusterOf(tile)];
+		cluster.dirty = true;
+		for (int d = 0; d < 4; d++)
+		{
+			glm::ivec2 neighbour = tile + s_directions[d];
+			if (neighbour.x < 0 || neighbour.y < 0 || neighbour.x >= m_width || neighbour.y >= m_height)
+				continue;
+			if (neighbour.x < cluster.min.x || neighbour.y < cluster.min.y || neighbour.x >= cluster.max.x || neighbour.y >= cluster.max.y)
+				m_clusters[ClusterOf(neighbour)].dirty = true;
+		}
+		m_clustersDirty = true;
+
+		// a field is one search over the whole grid, any edit invalidates it
+		for (auto& [goal, entry] : m_fields)
+			entry->dirty = true;
+	}
+
+	void NavGrid::RebuildClusters()
+	{
+		if (!m_clustersDirty)
+			return;
+
+		std::vector<Cluster*> dirty;
+		for (Cluster& cluster : m_clusters)
+		{
+			if (cluster.dirty)
+				dirty.push_back(&cluster);
+		}
+
+		Parallel::For(dirty.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				RebuildCluster(*dirty[i]);
+				dirty[i]->dirty = false;
+			}
+		});
+
+		m_stats.rebuiltClusters += static_cast<int>(dirty.size());
+		m_stats.entrances = 0;
+		for (const Cluster& cluster : m_clusters)
+			m_stats.entrances += static_cast<int>(cluster.entrances.size());
+		m_clustersDirty = false;
+	}
+
+	void NavGrid::RebuildCluster(Cluster& cluster) const
+	{
+		cluster.entrances.clear();
+		for (int d = 0; d < 4; d++)
+			AddBorderEntrances(cluster, d);
+
+		// shortest paths between every pair of entrances inside the cluster
+		size_t count = cluster.entrances.size();
+		size_t area = LocalIndex(cluster.min, cluster.max, cluster.max - 1) + 1;
+		cluster.costs.assign(count * count, s_infinity);
+		cluster.parents.resize(count * area);
+
+		ClusterSearch search;
+		for (size_t i = 0; i < count; i++)
+		{
+			SearchCluster(cluster, Tile(cluster.entrances[i].tile), false, search);
+			for (size_t j = 0; j < count; j++)
+				cluster.costs[i * count + j] = search.cost[LocalIndex(cluster.min, cluster.max, Tile(cluster.entrances[j].tile))];
+			std::copy(search.parents.begin(), search.parents.end(), cluster.parents.begin() + i * area);
+		}
+	}
+
+	// one entrance in the middle of every walkable run along the border, long runs get one at each end
+	void NavGrid::AddBorderEntrances(Cluster& cluster, int direction) const
+	{
+		glm::ivec2 step = s_directions[direction];
+		glm::ivec2 first;
+		glm::ivec2 along;
+		int length;
+		if (step.x != 0)
+		{
+			first = { step.x > 0 ? cluster.max.x - 1 : cluster.min.x, cluster.min.y };
+			along = { 0, 1 };
+			length = cluster.max.y - cluster.min.y;
+		}
+		else
+		{
+			first = { cluster.min.x, step.y > 0 ? cluster.max.y - 1 : cluster.min.y };
+			along = { 1, 0 };
+			length = cluster.max.x - cluster.min.x;
+		}
+
+		glm::ivec2 outside = first + step;
+		if (outside.x < 0 || outside.y < 0 || outside.x >= m_width || outside.y >= m_height)
+			return;
+
+		auto add = [&](int position)
+		{
+			uint32_t tile = Index(first + along * position);
+			int existing = FindEntrance(cluster, tile);
+			if (existing >= 0)
+				cluster.entrances[existing].exits |= 1 << direction;
+			else
+				cluster.entrances.push_back({ tile, static_cast<uint8_t>(1 << direction) });
+		};
+
+		int runStart = -1;
+		for (int i = 0; i <= length; i++)
+		{
+			bool open = i < length && m_costs[Index(first + along * i)] != s_blocked && m_costs[Index(outside + along * i)] != s_blocked;
+			if (open && runStart < 0)
+				runStart = i;
+			if (open || runStart < 0)
+				continue;
+
+			int runLength = i - runStart;
+			if (runLength < 6)
+			{
+				add(runStart + (runLength - 1) / 2);
+			}
+			else
+			{
+				add(runStart);
+				add(i - 1);
+			}
+			runStart = -1;
+		}
+	}
+
+	void NavGrid::SearchCluster(const Cluster& cluster, glm::ivec2 start, bool reverse, ClusterSearch& out) const
+	{
+		size_t area = LocalIndex(cluster.min, cluster.max, cluster.max - 1) + 1;
+		out.cost.assign(area, s_infinity);
+		out.parents.assign(area, s_noParent);
+
+		glm::ivec2 size = cluster.max - cluster.min;
+		OpenList open;
+		uint32_t startLocal = LocalIndex(cluster.min, cluster.max, start);
+		out.cost[startLocal] = 0.f;
+		open.push({ 0.f, startLocal });
+
+		while (!open.empty())
+		{
+			auto [cost, local] = open.top();
+			open.pop();
+			if (cost > out.cost[local])
+				continue;
+
+			glm::ivec2 tile = cluster.min + glm::ivec2(static_cast<int>(local) % size.x, static_cast<int>(local) / size.x);
+			for (int d = 0; d < 8; d++)
+			{
+				// reverse walks the steps backwards, entering tile instead of leaving it
+				if (!CanStep(tile, s_directions[d], cluster.min, cluster.max))
+					continue;
+
+				glm::ivec2 next = tile + s_directions[d];
+				float stepCost = m_costs[Index(reverse ? tile : next)] * (d < 4 ? 1.f : s_diagonal);
+				uint32_t nextLocal = LocalIndex(cluster.min, cluster.max, next);
+				if (cost + stepCost < out.cost[nextLocal])
+				{
+					out.cost[nextLocal] = cost + stepCost;
+					out.parents[nextLocal] = static_cast<uint16_t>(local);
+					open.push({ cost + stepCost, nextLocal });
+				}
+			}
+		}
+	}
+
+	// parents is a tree rooted at from (forward) or at to (reverse), the tiles after from are appended
+	void NavGrid::AppendClusterPath(const Cluster& cluster, const uint16_t* parents, glm::ivec2 from, glm::ivec2 to, bool reverse,
+		FrameVector<uint32_t>& tiles) const
+	{
+		int width = cluster.max.x - cluster.min.x;
+		auto parentOf = [&](glm::ivec2 tile, glm::ivec2& parent)
+		{
+			uint16_t local = parents[LocalIndex(cluster.min, cluster.max, tile)];
+			if (local == s_noParent)
+				return false;
+			parent = cluster.min + glm::ivec2(local % width, local / width);
+			return true;
+		};
+
+		if (reverse)
+		{
+			for (glm::ivec2 tile = from; tile != to;)
+			{
+				if (!parentOf(tile, tile))
+					break;
+				tiles.push_back(Index(tile));
+			}
+			return;
+		}
+
+		size_t begin = tiles.size();
+		for (glm::ivec2 tile = to; tile != from;)
+		{
+			tiles.push_back(Index(tile));
+			if (!parentOf(tile, tile))
+				break;
+		}
+		std::reverse(tiles.begin() + begin, tiles.end());
+	}
+
+	#pragma endregion
+
+	#pragma region queries
+
+	bool NavGrid::FindPath(glm::vec2 from, glm::vec2 to, std::vector<glm::vec2>& path)
+	{
+		path.clear();
+		if (!m_initialized)
+			return false;
+
+		m_stats.pathQueries++;
+		m_stats.expandedNodes = 0;
+
+		glm::ivec2 start = WorldToTile(from);
+		glm::ivec2 goal = WorldToTile(to);
+		if (!IsWalkable(start) || !IsWalkable(goal))
+			return false;
+		if (start == goal)
+		{
+			path.push_back(to);
+			return true;
+		}
+
+		RebuildClusters();
+
+		// start and goal join the abstract graph through a search inside their own cluster
+		int startCluster = ClusterOf(start);
+		int goalCluster = ClusterOf(goal);
+		ClusterSearch startTree;
+		ClusterSearch goalTree;
+		SearchCluster(m_clusters[startCluster], start, false, startTree);
+		SearchCluster(m_clusters[goalCluster], goal, true, goalTree);
+
+		struct Record
+		{
+			float cost;
+			uint32_t parent;
+			EdgeKind kind;
+			bool closed;
+		};
+
+		// the abstract search and the expansion only live through this call, they come from the frame arena
+		ArenaAllocator<uint32_t> scratch(m_frameArena, MemoryTag::Navigation);
+		std::unordered_map<uint32_t, Record, std::hash<uint32_t>, std::equal_to<uint32_t>, ArenaAllocator<std::pair<const uint32_t, Record>>>
+			records(64, std::hash<uint32_t>(), std::equal_to<uint32_t>(), scratch);
+		FrameOpenList open{ std::greater<std::pair<float, uint32_t>>(), FrameVector<std::pair<float, uint32_t>>(scratch) };
+
+		uint32_t startIndex = Index(start);
+		uint32_t goalIndex = Index(goal);
+		records[startIndex] = { 0.f, startIndex, EdgeKind::Start, false };
+		open.push({ Octile(start, goal), startIndex });
+
+		auto relax = [&](uint32_t tile, float cost, uint32_t parent, EdgeKind kind)
+		{
+			auto it = records.find(tile);
+			if (it != records.end() && (it->second.closed || it->second.cost <= cost))
+				return;
+			records[tile] = { cost, parent, kind, false };
+			open.push({ cost + Octile(Tile(tile), goal), tile });
+		};
+
+		bool found = false;
+		while (!open.empty())
+		{
+			uint32_t index = open.top().second;
+			open.pop();
+
+			Record& record = records[index];
+			if (record.closed)
+				continue;
+			record.closed = true;
+			m_stats.expandedNodes++;
+
+			if (index == goalIndex)
+			{
+				found = true;
+				break;
+			}
+
+			float cost = record.cost;
+			glm::ivec2 tile = Tile(index);
+			int clusterIndex = ClusterOf(tile);
+			const Cluster& cluster = m_clusters[clusterIndex];
+
+			if (index == startIndex)
+			{
+				for (const Entrance& entrance : cluster.entrances)
+				{
+					float toEntrance = startTree.cost[LocalIndex(cluster.min, cluster.max, Tile(entrance.tile))];
+					if (entrance.tile != startIndex && toEntrance < s_infinity)
+						relax(entrance.tile, toEntrance, index, EdgeKind::Start);
+				}
+			}
+
+			int entrance = FindEntrance(cluster, index);
+			if (entrance >= 0)
+			{
+				size_t count = cluster.entrances.size();
+				for (size_t j = 0; j < count; j++)
+				{
+					float inside = cluster.costs[entrance * count + j];
+					if (static_cast<int>(j) != entrance && inside < s_infinity)
+						relax(cluster.entrances[j].tile, cost + inside, index, EdgeKind::Inside);
+				}
+
+				for (int d = 0; d < 4; d++)
+				{
+					if (!(cluster.entrances[entrance].exits & (1 << d)))
+						continue;
+					uint32_t neighbour = Index(tile + s_directions[d]);
+					relax(neighbour, cost + m_costs[neighbour], index, EdgeKind::Across);
+				}
+			}
+
+			if (clusterIndex == goalCluster)
+			{
+				float toGoal = goalTree.cost[LocalIndex(cluster.min, cluster.max, tile)];
+				if (toGoal < s_infinity)
+					relax(goalIndex, cost + toGoal, index, EdgeKind::Goal);
+			}
+		}
+
+		if (!found)
+			return false;
+
+		// abstract path back to front, then every hop is expanded into tiles
+		FrameVector<uint32_t> hops(scratch);
+		for (uint32_t index = goalIndex; index != startIndex; index = records[index].parent)
+			hops.push_back(index);
+		std::reverse(hops.begin(), hops.end());
+
+		FrameVector<uint32_t> tiles(scratch);
+		tiles.push_back(startIndex);
+		uint32_t previous = startIndex;
+		for (uint32_t hop : hops)
+		{
+			const Cluster& cluster = m_clusters[ClusterOf(Tile(previous))];
+			switch (records[hop].kind)
+			{
+			case EdgeKind::Start:
+				AppendClusterPath(cluster, startTree.parents.data(), Tile(previous), Tile(hop), false, tiles);
+				break;
+			case EdgeKind::Inside:
+			{
+				size_t area = LocalIndex(cluster.min, cluster.max, cluster.max - 1) + 1;
+				const uint16_t* parents = cluster.parents.data() + FindEntrance(cluster, previous) * area;
+				AppendClusterPath(cluster, parents, Tile(previous), Tile(hop), false, tiles);
+				break;
+			}
+			case EdgeKind::Across:
+				tiles.push_back(hop);
+				break;
+			case EdgeKind::Goal:
+				AppendClusterPath(cluster, goalTree.parents.data(), Tile(previous), Tile(hop), true, tiles);
+				break;
+			}
+			previous = hop;
+		}
+
+		path.reserve(tiles.size() - 1);
+		for (size_t i = 1; i < tiles.size(); i++)
+			path.push_back(TileToWorld(Tile(tiles[i])));
+		path.back() = to;
+		return true;
+	}
+
+	const FlowField* NavGrid::RequestFlowField(glm::vec2 goal)
+	{
+		glm::ivec2 tile = WorldToTile(goal);
+		if (!m_initialized || !IsWalkable(tile))
+			return nullptr;
+
+		std::unique_ptr<FieldEntry>& entry = m_fields[Index(tile)];
+		if (!entry)
+		{
+			entry = std::make_unique<FieldEntry>();
+			entry->field.goal = tile;
+		}
+		entry->lastRequested = m_updateCount;
+		return entry->built ? &entry->field : nullptr;
+	}
+
+	glm::vec2 NavGrid::GetFlowDirection(const FlowField& field, glm::vec2 position) const
+	{
+		glm::ivec2 tile = WorldToTile(position);
+		if (tile.x < 0 || tile.y < 0 || tile.x >= m_width || tile.y >= m_height || field.direction.empty())
+			return { 0.f, 0.f };
+
+		int8_t direction = field.direction[Index(tile)];
+		if (direction < 0)
+			return { 0.f, 0.f };
+
+		glm::vec2 toNext = TileToWorld(tile + s_directions[direction]) - position;
+		float distance = glm::length(toNext);
+		return distance > 0.f ? toNext / distance : glm::vec2(s_directions[direction]);
+	}
+
+	// one Dijkstra from the goal with the steps walked backwards, then every tile points at its cheapest neighbour
+	void NavGrid::BuildFlowField(FlowField& field) const
+	{
+		size_t count = m_costs.size();
+		field.cost.assign(count, s_infinity);
+		field.direction.assign(count, -1);
+
+		glm::ivec2 min = { 0, 0 };
+		glm::ivec2 max = { m_width, m_height };
+		OpenList open;
+		uint32_t goal = Index(field.goal);
+		field.cost[goal] = 0.f;
+		open.push({ 0.f, goal });
+
+		while (!open.empty())
+		{
+			auto [cost, index] = open.top();
+			open.pop();
+			if (cost > field.cost[index])
+				continue;
+
+			glm::ivec2 tile = Tile(index);
+			float enter = m_costs[index];
+			for (int d = 0; d < 8; d++)
+			{
+				if (!CanStep(tile, s_directions[d], min, max))
+					continue;
+
+				uint32_t next = Index(tile + s_directions[d]);
+				float total = cost + enter * (d < 4 ? 1.f : s_diagonal);
+				if (total < field.cost[next])
+				{
+					field.cost[next] = total;
+					open.push({ total, next });
+				}
+			}
+		}
+
+		for (uint32_t index = 0; index < count; index++)
+		{
+			if (index == goal || field.cost[index] == s_infinity)
+				continue;
+
+			// the step itself counts, the neighbour with the lowest cost can be behind an expensive tile or a diagonal
+			float best = s_infinity;
+			glm::ivec2 tile = Tile(index);
+			for (int d = 0; d < 8; d++)
+			{
+				if (!CanStep(tile, s_directions[d], min, max))
+					continue;
+				uint32_t next = Index(tile + s_directions[d]);
+				float cost = field.cost[next] + m_costs[next] * (d < 4 ? 1.f : s_diagonal);
+				if (cost < best)
+				{
+					best = cost;
+					field.direction[index] = static_cast<int8_t>(d);
+				}
+			}
+		}
+	}
+
+	#pragma endregion
+
+	void NavGrid::Update()
+	{
+		if (!m_initialized)
+			return;
+
+		auto start = std::chrono::steady_clock::now();
+
+		RebuildClusters();
+
+		m_buildList.clear();
+		for (auto it = m_fields.begin(); it != m_fields.end();)
+		{
+			FieldEntry& entry = *it->second;
+			if (m_updateCount - entry.lastRequested > static_cast<uint64_t>(settings.maxIdleUpdates))
+			{
+				it = m_fields.erase(it);
+				continue;
+			}
+			if (entry.dirty)
+				m_buildList.push_back(&entry);
+			++it;
+		}
+
+		// every field is an independent search, they are spread over the workers
+		Parallel::For(m_buildList.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				BuildFlowField(m_buildList[i]->field);
+				m_buildList[i]->built = true;
+				m_buildList[i]->dirty = false;
+			}
+		});
+
+		m_stats.flowFields = static_cast<int>(m_fields.size());
+		m_stats.builtFields = static_cast<int>(m_buildList.size());
+		m_stats.updateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		m_updateCount++;
+	}
+
+}
@@ -0,0 +1,145 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace game
+{
+
+	namespace
+	{
+		struct State
+		{
+			std::vector<std::thread> workers;
+
+			std::mutex mutex;
+			std::condition_variable wake;
+			std::condition_variable done;
+			uint64_t generation = 0;
+			int busy = 0;
+			bool stop = false;
+
+			// current loop
+			const std::function<void(size_t, size_t)>* fn = nullptr;
+			size_t count = 0;
+			size_t grain = 1;
+			std::atomic<size_t> next { 0 };
+
+			std::mutex callerMutex;		// one loop at a time
+		};
+
+		State s_state;
+		thread_local bool t_insideLoop = false;
+
+		void RunRanges()
+		{
+			size_t count = s_state.count;
+			size_t grain = s_state.grain;
+
+			size_t begin;
+			while ((begin = s_state.next.fetch_add(grain, std::memory_order_relaxed)) < count)
+				(*s_state.fn)(begin, std::min(begin + grain, count));
+		}
+
+		void WorkerLoop()
+		{
+			t_insideLoop = true;
+			uint64_t seen = 0;
+
+			std::unique_lock<std::mutex> lock(s_state.mutex);
+			while (true)
+			{
+				s_state.wake.wait(lock, [&]() { return s_state.stop || s_state.generation != seen; });
+				if (s_state.stop)
+					return;
+				seen = s_state.generation;
+
+				lock.unlock();
+				RunRanges();
+				lock.lock();
+
+				if (--s_state.busy == 0)
+					s_state.done.notify_one();
+			}
+		}
+	}
+
+
+	namespace Parallel
+	{
+
+		void Initialize(int workerCount)
+		{
+			if (!s_state.workers.empty())
+				return;
+
+			if (workerCount < 0)
+				workerCount = std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0);
+
+			s_state.stop = false;
+			for (int i = 0; i < workerCount; i++)
+				s_state.workers.emplace_back(WorkerLoop);
+		}
+
+		void Shutdown()
+		{
+			{
+				std::lock_guard<std::mutex> lock(s_state.mutex);
+				s_state.stop = true;
+			}
+			s_state.wake.notify_all();
+
+			for (std::thread& worker : s_state.workers)
+				worker.join();
+			s_state.workers.clear();
+		}
+
+		int GetWorkerCount()
+		{
+			return static_cast<int>(s_state.workers.size());
+		}
+
+		void For(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+		{
+			if (count == 0)
+				return;
+			grain = std::max<size_t>(grain, 1);
+
+			if (count <= grain || s_state.workers.empty() || t_insideLoop)
+			{
+				for (size_t begin = 0; begin < count; begin += grain)
+					fn(begin, std::min(begin + grain, count));
+				return;
+			}
+
+			std::lock_guard<std::mutex> caller(s_state.callerMutex);
+
+			{
+				std::lock_guard<std::mutex> lock(s_state.mutex);
+				s_state.fn = &fn;
+				s_state.count = count;
+				s_state.grain = grain;
+				s_state.next.store(0, std::memory_order_relaxed);
+				s_state.busy = static_cast<int>(s_state.workers.size());
+				s_state.generation++;
+			}
+			s_state.wake.notify_all();
+
+			t_insideLoop = true;
+			RunRanges();
+			t_insideLoop = false;
+
+			// workers still hold a pointer to fn until they checked in
+			std::unique_lock<std::mutex> lock(s_state.mutex);
+			s_state.done.wait(lock, []() { return s_state.busy == 0; });
+			s_state.fn = nullptr;
+		}
+
+	}
+
+}
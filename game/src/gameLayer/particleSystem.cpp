@@ -0,0 +1,409 @@
+#include "particleSystem.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define GAME_PARTICLES_SSE 1
+	#include <emmintrin.h>
+#else
+	#define GAME_PARTICLES_SSE 0
+#endif
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr int s_rangeSize = 4096;	// particles per parallel work item, multiple of 4
+
+		uint16_t PackUnorm16(float v)
+		{
+			return static_cast<uint16_t>(std::clamp(v, 0.f, 1.f) * 65535.f + 0.5f);
+		}
+	}
+
+
+	void ParticleSystem::Initialize(LightStore* lights, FrameArena* frameArena)
+	{
+		m_lights = lights;
+		m_frameArena = frameArena;
+		m_initialized = true;
+	}
+
+	void ParticleSystem::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		for (std::unique_ptr<Emitter>& emitter : m_emitters)
+		{
+			if (emitter->alive)
+				Release(*emitter);
+		}
+		m_emitters.clear();
+		m_freeEmitters.clear();
+		m_aliveCount = 0;
+		m_initialized = false;
+	}
+
+
+	EmitterHandle ParticleSystem::CreateEmitter(const EmitterSettings& settings)
+	{
+		uint32_t index;
+		if (!m_freeEmitters.empty())
+		{
+			index = m_freeEmitters.back();
+			m_freeEmitters.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(m_emitters.size());
+			m_emitters.push_back(std::make_unique<Emitter>());
+		}
+
+		Emitter& emitter = *m_emitters[index];
+		emitter.settings = settings;
+		emitter.alive = true;
+		emitter.spawnAccumulator = 0.f;
+		emitter.pendingBurst = 0;
+		Allocate(emitter);
+
+		return { index, emitter.generation };
+	}
+
+	void ParticleSystem::DestroyEmitter(EmitterHandle handle)
+	{
+		if (!IsAlive(handle))
+			return;
+
+		Emitter& emitter = *m_emitters[handle.index];
+		Release(emitter);
+		emitter.alive = false;
+		if (++emitter.generation == 0)
+			emitter.generation = 1;
+		m_freeEmitters.push_back(handle.index);
+	}
+
+	bool ParticleSystem::IsAlive(EmitterHandle handle) const
+	{
+		return handle.index < m_emitters.size() && m_emitters[handle.index]->alive && m_emitters[handle.index]->generation == handle.generation;
+	}
+
+	EmitterSettings* ParticleSystem::GetSettings(EmitterHandle handle)
+	{
+		return IsAlive(handle) ? &m_emitters[handle.index]->settings : nullptr;
+	}
+
+	void ParticleSystem::SetPosition(EmitterHandle handle, glm::vec2 position)
+	{
+		if (IsAlive(handle))
+			m_emitters[handle.index]->settings.position = position;
+	}
+
+	void ParticleSystem::Burst(EmitterHandle handle, int count)
+	{
+		if (IsAlive(handle))
+			m_emitters[handle.index]->pendingBurst += count;
+	}
+
+	int ParticleSystem::GetEmitterCount() const
+	{
+		return static_cast<int>(m_emitters.size() - m_freeEmitters.size());
+	}
+
+
+	void ParticleSystem::Update(float dt)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// the work list lives in the frame arena, reserved for the worst case as the arena does not reuse freed space
+		size_t maxRanges = 0;
+		for (std::unique_ptr<Emitter>& pointer : m_emitters)
+		{
+			if (pointer->alive)
+				maxRanges += (pointer->capacity + s_rangeSize - 1) / s_rangeSize;
+		}
+		FrameVector<Range> ranges(ArenaAllocator<Range>(m_frameArena, MemoryTag::Particles));
+		ranges.reserve(maxRanges);
+
+		// serial part: remove the particles that died last frame and spawn the new ones
+		m_aliveCount = 0;
+		for (std::unique_ptr<Emitter>& pointer : m_emitters)
+		{
+			Emitter& emitter = *pointer;
+			if (!emitter.alive)
+				continue;
+
+			RemoveDead(emitter);
+
+			emitter.spawnAccumulator += emitter.settings.rate * dt;
+			int spawn = static_cast<int>(emitter.spawnAccumulator);
+			emitter.spawnAccumulator -= spawn;
+			Spawn(emitter, spawn + emitter.pendingBurst);
+			emitter.pendingBurst = 0;
+
+			for (int begin = 0; begin < emitter.count; begin += s_rangeSize)
+				ranges.push_back({ &emitter, begin, std::min(begin + s_rangeSize, emitter.count) });
+			m_aliveCount += emitter.count;
+		}
+
+		Parallel::For(ranges.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				Integrate(*ranges[i].emitter, ranges[i].begin, ranges[i].end, dt);
+		});
+
+		if (m_lights)
+		{
+			for (std::unique_ptr<Emitter>& emitter : m_emitters)
+			{
+				if (emitter->alive && emitter->settings.emitLight)
+					UpdateLights(*emitter);
+			}
+		}
+
+		m_updateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void ParticleSystem::Render(SpriteBatch& batch)
+	{
+		for (std::unique_ptr<Emitter>& emitter : m_emitters)
+		{
+			if (emitter->alive && emitter->count > 0 && emitter->settings.texture)
+				batch.DrawInstances(emitter->instances.data(), emitter->count, *emitter->settings.texture);
+		}
+	}
+
+
+	void ParticleSystem::Allocate(Emitter& emitter)
+	{
+		int capacity = (std::max(emitter.settings.maxParticles, 0) + 3) & ~3;
+
+		emitter.posX.assign(capacity, 0.f);
+		emitter.posY.assign(capacity, 0.f);
+		emitter.velX.assign(capacity, 0.f);
+		emitter.velY.assign(capacity, 0.f);
+		emitter.age.assign(capacity, 1.f);
+		emitter.ageRate.assign(capacity, 0.f);
+		emitter.instances.assign(capacity, QuadInstance{});
+		emitter.count = 0;
+		emitter.capacity = capacity;
+
+		Memory::RecordAllocation(MemoryTag::Particles, capacity * (6 * sizeof(float) + sizeof(QuadInstance)));
+	}
+
+	void ParticleSystem::Release(Emitter& emitter)
+	{
+		Memory::RecordFree(MemoryTag::Particles, emitter.capacity * (6 * sizeof(float) + sizeof(QuadInstance)));
+
+		if (m_lights)
+		{
+			for (LightHandle light : emitter.lights)
+				m_lights->DestroyLight(light);
+		}
+		emitter.lights.clear();
+
+		emitter.posX = {};
+		emitter.posY = {};
+		emitter.velX = {};
+		emitter.velY = {};
+		emitter.age = {};
+		emitter.ageRate = {};
+		emitter.instances = {};
+		emitter.count = 0;
+		emitter.capacity = 0;
+	}
+
+	void ParticleSystem::RemoveDead(Emitter& emitter)
+	{
+		// swap-remove keeps the pool dense
+		int i = 0;
+		while (i < emitter.count)
+		{
+			if (emitter.age[i] < 1.f)
+			{
+				i++;
+				continue;
+			}
+
+			int last = --emitter.count;
+			emitter.posX[i] = emitter.posX[last];
+			emitter.posY[i] = emitter.posY[last];
+			emitter.velX[i] = emitter.velX[last];
+			emitter.velY[i] = emitter.velY[last];
+			emitter.age[i] = emitter.age[last];
+			emitter.ageRate[i] = emitter.ageRate[last];
+		}
+	}
+
+	void ParticleSystem::Spawn(Emitter& emitter, int count)
+	{
+		const EmitterSettings& s = emitter.settings;
+		count = std::min(count, emitter.capacity - emitter.count);
+
+		for (int k = 0; k < count; k++)
+		{
+			int i = emitter.count++;
+			float angle = s.direction + (Random() - 0.5f) * s.spread;
+			float speed = s.speedMin + (s.speedMax - s.speedMin) * Random();
+			float lifetime = std::max(s.lifetimeMin + (s.lifetimeMax - s.lifetimeMin) * Random(), 0.001f);
+
+			emitter.posX[i] = s.position.x;
+			emitter.posY[i] = s.position.y;
+			emitter.velX[i] = std::cos(angle) * speed;
+			emitter.velY[i] = std::sin(angle) * speed;
+			emitter.age[i] = 0.f;
+			emitter.ageRate[i] = 1.f / lifetime;
+		}
+	}
+
+	void ParticleSystem::Integrate(Emitter& emitter, int begin, int end, float dt)
+	{
+		const EmitterSettings& s = emitter.settings;
+
+		float damp = std::max(1.f - s.drag * dt, 0.f);
+		glm::vec2 gravity = s.gravity * dt;
+		glm::vec4 colorDelta = s.colorEnd - s.colorStart;
+		float sizeDelta = s.sizeEnd - s.sizeStart;
+
+		uint16_t uv[4] = { PackUnorm16(s.uv.x), PackUnorm16(s.uv.y), PackUnorm16(s.uv.z), PackUnorm16(s.uv.w) };
+
+		float* posX = emitter.posX.data();
+		float* posY = emitter.posY.data();
+		float* velX = emitter.velX.data();
+		float* velY = emitter.velY.data();
+		float* age = emitter.age.data();
+		const float* ageRate = emitter.ageRate.data();
+		QuadInstance* instances = emitter.instances.data();
+
+		auto writeInstance = [&](int i, float x, float y, float size, const float* color)
+		{
+			QuadInstance& q = instances[i];
+			float half = size * 0.5f;
+			q.rect = { x - half, y - half, size, size };
+			q.uv[0] = uv[0];
+			q.uv[1] = uv[1];
+			q.uv[2] = uv[2];
+			q.uv[3] = uv[3];
+			q.color[0] = static_cast<uint8_t>(color[0]);
+			q.color[1] = static_cast<uint8_t>(color[1]);
+			q.color[2] = static_cast<uint8_t>(color[2]);
+			q.color[3] = static_cast<uint8_t>(color[3]);
+			q.texIndex = 0;
+		};
+
+		int i = begin;
+
+#if GAME_PARTICLES_SSE
+		// the pools are padded to a multiple of 4, the tail slots are integrated but never drawn
+		int end4 = std::min((end + 3) & ~3, emitter.capacity);
+
+		const __m128 vdt = _mm_set1_ps(dt);
+		const __m128 vdamp = _mm_set1_ps(damp);
+		const __m128 vgx = _mm_set1_ps(gravity.x);
+		const __m128 vgy = _mm_set1_ps(gravity.y);
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 scale = _mm_set1_ps(255.f);
+		const __m128 sizeStart = _mm_set1_ps(s.sizeStart);
+		const __m128 sizeSlope = _mm_set1_ps(sizeDelta);
+		const __m128 colorStart[4] = { _mm_set1_ps(s.colorStart.x), _mm_set1_ps(s.colorStart.y), _mm_set1_ps(s.colorStart.z), _mm_set1_ps(s.colorStart.w) };
+		const __m128 colorSlope[4] = { _mm_set1_ps(colorDelta.x), _mm_set1_ps(colorDelta.y), _mm_set1_ps(colorDelta.z), _mm_set1_ps(colorDelta.w) };
+
+		for (; i + 4 <= end4; i += 4)
+		{
+			__m128 vx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(velX + i), vdamp), vgx);
+			__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(velY + i), vdamp), vgy);
+			__m128 px = _mm_add_ps(_mm_loadu_ps(posX + i), _mm_mul_ps(vx, vdt));
+			__m128 py = _mm_add_ps(_mm_loadu_ps(posY + i), _mm_mul_ps(vy, vdt));
+			__m128 a = _mm_add_ps(_mm_loadu_ps(age + i), _mm_mul_ps(_mm_loadu_ps(ageRate + i), vdt));
+
+			_mm_storeu_ps(velX + i, vx);
+			_mm_storeu_ps(velY + i, vy);
+			_mm_storeu_ps(posX + i, px);
+			_mm_storeu_ps(posY + i, py);
+			_mm_storeu_ps(age + i, a);
+
+			// over lifetime, particles that just died get size 0
+			__m128 t = _mm_min_ps(a, one);
+			__m128 size = _mm_and_ps(_mm_add_ps(sizeStart, _mm_mul_ps(sizeSlope, t)), _mm_cmplt_ps(a, one));
+
+			alignas(16) float color[4][4];
+			for (int c = 0; c < 4; c++)
+			{
+				__m128 value = _mm_add_ps(colorStart[c], _mm_mul_ps(colorSlope[c], t));
+				value = _mm_min_ps(_mm_max_ps(value, zero), one);
+				_mm_store_ps(color[c], _mm_add_ps(_mm_mul_ps(value, scale), _mm_set1_ps(0.5f)));
+			}
+
+			alignas(16) float x[4], y[4], w[4];
+			_mm_store_ps(x, px);
+			_mm_store_ps(y, py);
+			_mm_store_ps(w, size);
+			for (int k = 0; k < 4; k++)
+			{
+				float rgba[4] = { color[0][k], color[1][k], color[2][k], color[3][k] };
+				writeInstance(i + k, x[k], y[k], w[k], rgba);
+			}
+		}
+#endif
+
+		for (; i < end; i++)
+		{
+			velX[i] = velX[i] * damp + gravity.x;
+			velY[i] = velY[i] * damp + gravity.y;
+			posX[i] += velX[i] * dt;
+			posY[i] += velY[i] * dt;
+			age[i] += ageRate[i] * dt;
+
+			float t = std::min(age[i], 1.f);
+			float size = age[i] < 1.f ? s.sizeStart + sizeDelta * t : 0.f;
+			glm::vec4 c = s.colorStart + colorDelta * t;
+			float rgba[4];
+			for (int k = 0; k < 4; k++)
+				rgba[k] = std::clamp(c[k], 0.f, 1.f) * 255.f + 0.5f;
+			writeInstance(i, posX[i], posY[i], size, rgba);
+		}
+	}
+
+	void ParticleSystem::UpdateLights(Emitter& emitter)
+	{
+		const EmitterSettings& s = emitter.settings;
+		int wanted = std::min(s.maxLights, emitter.count);
+
+		// unused lights are destroyed, a dark light would still be rendered
+		while (static_cast<int>(emitter.lights.size()) > wanted)
+		{
+			m_lights->DestroyLight(emitter.lights.back());
+			emitter.lights.pop_back();
+		}
+		while (static_cast<int>(emitter.lights.size()) < wanted)
+			emitter.lights.push_back(m_lights->CreateLight(s.position, s.lightColor, 0.f, s.lightRadius));
+
+		for (int k = 0; k < wanted; k++)
+		{
+			LightHandle light = emitter.lights[k];
+			// spread over the pool instead of the first few particles
+			int i = static_cast<int>(static_cast<int64_t>(k) * emitter.count / wanted);
+			float fade = 1.f - std::min(emitter.age[i], 1.f);
+			m_lights->SetPosition(light, { emitter.posX[i], emitter.posY[i] });
+			m_lights->SetColor(light, s.lightColor);
+			m_lights->SetIntensity(light, s.lightIntensity * fade);
+			m_lights->SetRadius(light, s.lightRadius);
+		}
+	}
+
+	float ParticleSystem::Random()
+	{
+		// xorshift32
+		m_random ^= m_random << 13;
+		m_random ^= m_random >> 17;
+		m_random ^= m_random << 5;
+		return (m_random >> 8) * (1.f / 16777216.f);
+	}
+
+}
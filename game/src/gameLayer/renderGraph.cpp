@@ -0,0 +1,263 @@
+#include "renderGraph.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+
+namespace game
+{
+
+	void RenderGraph::Initialize(glm::ivec2 windowSize)
+	{
+		m_windowSize = glm::max(windowSize, glm::ivec2(1));
+
+		m_resources.clear();
+		m_resources.emplace_back();
+		m_resources[0].name = "backbuffer";
+
+		m_initialized = true;
+	}
+
+	void RenderGraph::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		ReleasePool();
+		m_resources.clear();
+		m_passes.clear();
+		m_reads.clear();
+		m_writes.clear();
+
+		m_initialized = false;
+	}
+
+	void RenderGraph::Resize(glm::ivec2 windowSize)
+	{
+		windowSize = glm::max(windowSize, glm::ivec2(1));
+		if (windowSize == m_windowSize)
+			return;
+
+		m_windowSize = windowSize;
+		ReleasePool();
+	}
+
+	RenderResource RenderGraph::CreateTarget(const std::string& name, const TargetDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.desc = desc;
+		resource.size = glm::max(glm::ivec2(glm::vec2(m_windowSize) * desc.scale), glm::ivec2(1));
+
+		m_resources.push_back(std::move(resource));
+		return { static_cast<uint32_t>(m_resources.size() - 1) };
+	}
+
+	void RenderGraph::AddPass(const std::string& name, std::initializer_list<RenderResource> reads,
+		std::initializer_list<RenderResource> writes, PassFunction execute)
+	{
+		Pass pass;
+		pass.name = name;
+		pass.firstRead = static_cast<uint32_t>(m_reads.size());
+		pass.readCount = static_cast<uint32_t>(reads.size());
+		pass.firstWrite = static_cast<uint32_t>(m_writes.size());
+		pass.writeCount = static_cast<uint32_t>(writes.size());
+		pass.execute = std::move(execute);
+
+		m_reads.insert(m_reads.end(), reads.begin(), reads.end());
+		m_writes.insert(m_writes.end(), writes.begin(), writes.end());
+		m_passes.push_back(std::move(pass));
+	}
+
+	void RenderGraph::Execute()
+	{
+		if (!m_initialized)
+			return;
+
+		Cull();
+		Allocate();
+
+		for (Pass& pass : m_passes)
+		{
+			if (pass.alive)
+				pass.execute(*this);
+		}
+
+		TrimPool();
+
+		m_stats.passes = 0;
+		for (const Pass& pass : m_passes)
+			m_stats.passes += pass.alive;
+		m_stats.culledPasses = static_cast<int>(m_passes.size()) - m_stats.passes;
+
+		// keep the capacity, the same graph is declared again next frame
+		m_resources.resize(1);
+		m_passes.clear();
+		m_reads.clear();
+		m_writes.clear();
+	}
+
+	LittleEngine::Graphics::RenderTarget& RenderGraph::GetTarget(RenderResource resource)
+	{
+		return *m_pool[m_resources[resource.index].physical].target;
+	}
+
+	glm::ivec2 RenderGraph::GetSize(RenderResource resource) const
+	{
+		if (resource.index == 0)
+			return m_windowSize;
+		return m_resources[resource.index].size;
+	}
+
+	// walks the passes backwards, a pass lives if it writes the backbuffer or something a live pass reads
+	void RenderGraph::Cull()
+	{
+		m_needed.assign(m_resources.size(), 0);
+		m_needed[0] = 1;
+
+		for (size_t p = m_passes.size(); p-- > 0;)
+		{
+			Pass& pass = m_passes[p];
+			pass.alive = false;
+			for (uint32_t i = 0; i < pass.writeCount; i++)
+				if (m_needed[m_writes[pass.firstWrite + i].index])
+					pass.alive = true;
+
+			if (!pass.alive)
+				continue;
+
+			for (uint32_t i = 0; i < pass.readCount; i++)
+				m_needed[m_reads[pass.firstRead + i].index] = 1;
+		}
+	}
+
+	void RenderGraph::Allocate()
+	{
+		for (Resource& resource : m_resources)
+		{
+			resource.firstPass = -1;
+			resource.lastPass = -1;
+			resource.physical = -1;
+		}
+
+		auto touch = [&](RenderResource handle, int pass)
+		{
+			Resource& resource = m_resources[handle.index];
+			if (resource.firstPass < 0)
+				resource.firstPass = pass;
+			resource.lastPass = pass;
+		};
+
+		for (int p = 0; p < static_cast<int>(m_passes.size()); p++)
+		{
+			const Pass& pass = m_passes[p];
+			if (!pass.alive)
+				continue;
+			for (uint32_t i = 0; i < pass.readCount; i++)
+				touch(m_reads[pass.firstRead + i], p);
+			for (uint32_t i = 0; i < pass.writeCount; i++)
+				touch(m_writes[pass.firstWrite + i], p);
+		}
+
+		for (PhysicalTarget& physical : m_pool)
+			physical.busyUntil = -1;
+
+		// resources in order of their first use, each takes a compatible target that is free by then
+		m_stats.transientTargets = 0;
+		m_stats.unaliasedBytes = 0;
+		for (int p = 0; p < static_cast<int>(m_passes.size()); p++)
+		{
+			for (size_t r = 1; r < m_resources.size(); r++)
+			{
+				Resource& resource = m_resources[r];
+				if (resource.firstPass != p)
+					continue;
+
+				resource.physical = AcquirePhysical(resource.desc.format, resource.size, resource.firstPass, resource.lastPass);
+				m_stats.transientTargets++;
+				m_stats.unaliasedBytes += EstimateBytes(resource.desc.format, resource.size);
+			}
+		}
+	}
+
+	int RenderGraph::AcquirePhysical(int format, glm::ivec2 size, int firstPass, int lastPass)
+	{
+		for (size_t i = 0; i < m_pool.size(); i++)
+		{
+			PhysicalTarget& physical = m_pool[i];
+			if (physical.format == format && physical.size == size && physical.busyUntil < firstPass)
+			{
+				physical.busyUntil = lastPass;
+				physical.idleFrames = 0;
+				return static_cast<int>(i);
+			}
+		}
+
+		PhysicalTarget physical;
+		physical.target = std::make_unique<LittleEngine::Graphics::RenderTarget>();
+		if (format)
+			physical.target->Create(size.x, size.y, format);
+		else
+			physical.target->Create(size.x, size.y);
+		physical.format = format;
+		physical.size = size;
+		physical.busyUntil = lastPass;
+
+		m_pool.push_back(std::move(physical));
+		m_stats.createdTargets++;
+		return static_cast<int>(m_pool.size() - 1);
+	}
+
+	// targets nobody asked for in a while go, e.g. the old light size after a downscale change
+	void RenderGraph::TrimPool()
+	{
+		for (size_t i = 0; i < m_pool.size();)
+		{
+			PhysicalTarget& physical = m_pool[i];
+			if (physical.busyUntil < 0 && ++physical.idleFrames > s_maxIdleFrames)
+			{
+				physical.target->Cleanup();
+				m_pool[i] = std::move(m_pool.back());
+				m_pool.pop_back();
+				continue;
+			}
+			i++;
+		}
+
+		m_stats.pooledTargets = static_cast<int>(m_pool.size());
+		m_stats.pooledBytes = 0;
+		for (const PhysicalTarget& physical : m_pool)
+			m_stats.pooledBytes += EstimateBytes(physical.format, physical.size);
+	}
+
+	void RenderGraph::ReleasePool()
+	{
+		for (PhysicalTarget& physical : m_pool)
+			physical.target->Cleanup();
+		m_pool.clear();
+
+		m_stats.pooledTargets = 0;
+		m_stats.pooledBytes = 0;
+	}
+
+	size_t RenderGraph::EstimateBytes(int format, glm::ivec2 size)
+	{
+		size_t texel = 4;
+		switch (format)
+		{
+		case GL_RGB16F:
+		case GL_RGBA16F:
+			texel = 8;
+			break;
+		case GL_RGB32F:
+		case GL_RGBA32F:
+			texel = 16;
+			break;
+		default:
+			break;
+		}
+		return texel * static_cast<size_t>(size.x) * static_cast<size_t>(size.y);
+	}
+
+}
@@ -0,0 +1,316 @@
+#include "retainedUI.h"
+#include "asyncLog.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+
+namespace game
+{
+
+	namespace
+	{
+		// input commands are owned by the engine, the flag lives in RetainedUI.
+		class PointerEventCommand : public LittleEngine::Input::Command {
+			bool& flag;
+		public:
+			PointerEventCommand(bool& f) : flag(f) {}
+			std::string GetName() const override { return "UIPointerEvent"; }
+
+			void OnPress() override { flag = true; }
+			void OnRelease() override { flag = true; }
+			void OnHold() override {}
+		};
+	}
+
+
+	void RetainedUI::Initialize(LittleEngine::UI::UISystem* uiSystem, ShaderCache& shaderCache, glm::ivec2 windowSize)
+	{
+		m_uiSystem = uiSystem;
+		m_windowSize = windowSize;
+
+		m_blitShader = shaderCache.Load(RESOURCES_PATH "fullscreen_quad.vert", RESOURCES_PATH "fullscreen_image_blit.frag");
+		if (!m_blitShader)
+			GAME_LOG_ERROR("no blit shader, the UI is drawn every frame without caching");
+
+		LittleEngine::Input::BindMouseButtonToCommand(LittleEngine::Input::MouseButton::Left, std::make_unique<PointerEventCommand>(m_pointerEvent));
+
+		m_initialized = true;
+	}
+
+	void RetainedUI::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		for (Context& context : m_contexts)
+		{
+			if (context.target)
+				context.target->Cleanup();
+			context.target.reset();
+		}
+		m_contexts.clear();
+		m_contextIndex.clear();
+		m_hitBoxes.clear();
+		m_cells.clear();
+
+		m_initialized = false;
+	}
+
+	LittleEngine::UI::UIContext* RetainedUI::CreateContext(const std::string& name)
+	{
+		if (Context* existing = FindContext(name))
+			return existing->context;
+
+		Context context;
+		context.name = name;
+		context.context = m_uiSystem->CreateContext(name);
+
+		m_contextIndex[name] = static_cast<uint32_t>(m_contexts.size());
+		m_contexts.push_back(std::move(context));
+
+		return m_contexts.back().context;
+	}
+
+	LittleEngine::UI::UIElement* RetainedUI::AddElementInternal(const std::string& contextName, std::unique_ptr<LittleEngine::UI::UIElement> element, glm::vec4 hitRect)
+	{
+		Context* context = FindContext(contextName);
+		if (!context)
+			return nullptr;
+
+		if (hitRect.z > 0.f && hitRect.w > 0.f)
+		{
+			m_hitBoxes.push_back({ hitRect, m_contextIndex[contextName] });
+			m_gridDirty = true;
+		}
+
+		context->dirty = true;
+		return context->context->AddElement(std::move(element));
+	}
+
+	void RetainedUI::ShowContext(const std::string& name)
+	{
+		if (Context* context = FindContext(name))
+			SetVisible(*context, true);
+	}
+
+	void RetainedUI::HideContext(const std::string& name)
+	{
+		if (Context* context = FindContext(name))
+			SetVisible(*context, false);
+	}
+
+	void RetainedUI::ToggleContext(const std::string& name)
+	{
+		if (Context* context = FindContext(name))
+			SetVisible(*context, !context->visible);
+	}
+
+	void RetainedUI::Invalidate(const std::string& name)
+	{
+		if (Context* context = FindContext(name))
+			context->dirty = true;
+	}
+
+	void RetainedUI::InvalidateAll()
+	{
+		for (Context& context : m_contexts)
+			context.dirty = true;
+	}
+
+	void RetainedUI::UpdateWindowSize(int w, int h)
+	{
+		m_windowSize = { w, h };
+		m_gridDirty = true;
+		InvalidateAll();	// targets are recreated lazily at the next redraw
+	}
+
+
+	void RetainedUI::Update()
+	{
+		if (m_gridDirty)
+			RebuildGrid();
+
+		glm::ivec2 mouse = LittleEngine::Input::GetMousePosition();
+		int hovered = m_hovered;
+		if (mouse != m_lastMouse)
+		{
+			hovered = QueryHitBox(mouse);
+			m_lastMouse = mouse;
+		}
+
+		bool hoverChanged = hovered != m_hovered;
+		if (hoverChanged)
+		{
+			if (m_hovered >= 0)
+				m_contexts[m_hitBoxes[m_hovered].context].dirty = true;
+			if (hovered >= 0)
+				m_contexts[m_hitBoxes[hovered].context].dirty = true;
+		}
+		if (m_pointerEvent && hovered >= 0)
+			m_contexts[m_hitBoxes[hovered].context].dirty = true;
+
+		// the engine only has to hit test when something could have changed.
+		bool pointerEvent = m_pointerEvent;
+		m_hovered = hovered;
+		m_pointerEvent = false;
+
+		if (hoverChanged || pointerEvent)
+		{
+			m_uiSystem->Update();
+			m_engineUpdateCount++;
+		}
+	}
+
+	void RetainedUI::Render(LittleEngine::Graphics::Renderer* renderer)
+	{
+		if (!m_blitShader)
+		{
+			m_uiSystem->Render(renderer);
+			renderer->Flush();
+			return;
+		}
+
+		for (Context& context : m_contexts)
+		{
+			if (context.visible && context.dirty)
+				RedrawContext(renderer, context);
+		}
+
+		// targets hold premultiplied colors, composite them in creation order.
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+		m_blitShader->Use();
+		m_blitShader->SetInt("uTexture", 0);
+
+		for (Context& context : m_contexts)
+		{
+			if (!context.visible || !context.target)
+				continue;
+
+			context.target->GetTexture().Bind(0);
+			renderer->FlushFullscreenQuad();
+		}
+
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		renderer->shader.Use(); // restore default shader
+	}
+
+
+	RetainedUI::Context* RetainedUI::FindContext(const std::string& name)
+	{
+		auto it = m_contextIndex.find(name);
+		if (it == m_contextIndex.end())
+			return nullptr;
+		return &m_contexts[it->second];
+	}
+
+	void RetainedUI::SetVisible(Context& context, bool visible)
+	{
+		if (context.visible == visible)
+			return;
+
+		m_uiSystem->ToggleContext(context.name);
+		context.visible = visible;
+		context.dirty = true;
+
+		// hit boxes of hidden contexts must not be hovered anymore.
+		m_gridDirty = true;
+		m_lastMouse = { -1, -1 };
+	}
+
+	void RetainedUI::RebuildGrid()
+	{
+		m_gridSize = { (m_windowSize.x + s_cellSize - 1) / s_cellSize, (m_windowSize.y + s_cellSize - 1) / s_cellSize };
+		m_gridSize = glm::max(m_gridSize, glm::ivec2(1, 1));
+
+		m_cells.assign(static_cast<size_t>(m_gridSize.x) * m_gridSize.y, {});
+
+		for (uint32_t i = 0; i < m_hitBoxes.size(); i++)
+		{
+			const HitBox& box = m_hitBoxes[i];
+			if (!m_contexts[box.context].visible)
+				continue;
+
+			int x0 = std::clamp(static_cast<int>(box.rect.x) / s_cellSize, 0, m_gridSize.x - 1);
+			int y0 = std::clamp(static_cast<int>(box.rect.y) / s_cellSize, 0, m_gridSize.y - 1);
+			int x1 = std::clamp(static_cast<int>(box.rect.x + box.rect.z) / s_cellSize, 0, m_gridSize.x - 1);
+			int y1 = std::clamp(static_cast<int>(box.rect.y + box.rect.w) / s_cellSize, 0, m_gridSize.y - 1);
+
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++)
+					m_cells[y * m_gridSize.x + x].push_back(i);
+		}
+
+		m_gridDirty = false;
+	}
+
+	int RetainedUI::QueryHitBox(glm::vec2 point) const
+	{
+		int x = static_cast<int>(point.x) / s_cellSize;
+		int y = static_cast<int>(point.y) / s_cellSize;
+		if (point.x < 0 || point.y < 0 || x >= m_gridSize.x || y >= m_gridSize.y)
+			return -1;
+
+		const std::vector<uint32_t>& cell = m_cells[y * m_gridSize.x + x];
+
+		// last added element is drawn on top
+		for (auto it = cell.rbegin(); it != cell.rend(); ++it)
+		{
+			const glm::vec4& r = m_hitBoxes[*it].rect;
+			if (point.x >= r.x && point.x <= r.x + r.z && point.y >= r.y && point.y <= r.y + r.w)
+				return static_cast<int>(*it);
+		}
+		return -1;
+	}
+
+	void RetainedUI::RedrawContext(LittleEngine::Graphics::Renderer* renderer, Context& context)
+	{
+		if (!context.target || context.target->GetSize() != m_windowSize)
+		{
+			if (!context.target)
+				context.target = std::make_unique<LittleEngine::Graphics::RenderTarget>();
+			else
+				context.target->Cleanup();
+			context.target->Create(m_windowSize.x, m_windowSize.y, GL_RGBA);
+		}
+
+		// UISystem renders every visible context, hide the others for the duration of the redraw.
+		for (Context& other : m_contexts)
+		{
+			if (&other != &context && other.visible)
+				m_uiSystem->ToggleContext(other.name);
+		}
+
+		GLfloat clearColor[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+		context.target->Bind();
+		glClearColor(0.f, 0.f, 0.f, 0.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+		// color is weighted by alpha once and alpha accumulates as coverage, so the target holds premultiplied colors
+		glEnable(GL_BLEND);
+		glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+		renderer->SetRenderTarget(context.target.get());
+		m_uiSystem->Render(renderer);
+		renderer->Flush();
+		renderer->SetRenderTarget();
+
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+		for (Context& other : m_contexts)
+		{
+			if (&other != &context && other.visible)
+				m_uiSystem->ToggleContext(other.name);
+		}
+
+		context.dirty = false;
+		m_redrawCount++;
+	}
+
+}
@@ -0,0 +1,414 @@
+#include "shaderCache.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "asyncLog.h"
+
+#include <cstdio>
+#include <fstream>
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr uint32_t s_binaryMagic = 0x4353454C;	// "LESC"
+		constexpr uint32_t s_binaryVersion = 1;
+
+		struct BinaryHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t driverHash;
+			uint32_t format;
+			uint32_t size;
+		};
+
+		uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		uint64_t Fnv1a(const std::string& s, uint64_t hash = 14695981039346656037ull)
+		{
+			return Fnv1a(s.data(), s.size(), hash);
+		}
+
+		std::string GetGLString(GLenum name)
+		{
+			const GLubyte* s = glGetString(name);
+			return s ? reinterpret_cast<const char*>(s) : "";
+		}
+	}
+
+
+#pragma region ShaderProgram
+
+	void ShaderProgram::Use() const
+	{
+		glUseProgram(m_id);
+	}
+
+	void ShaderProgram::SetInt(const std::string& name, int value)
+	{
+		glUniform1i(GetLocation(name), value);
+	}
+
+	void ShaderProgram::SetBool(const std::string& name, bool value)
+	{
+		glUniform1i(GetLocation(name), value ? 1 : 0);
+	}
+
+	void ShaderProgram::SetFloat(const std::string& name, float value)
+	{
+		glUniform1f(GetLocation(name), value);
+	}
+
+	void ShaderProgram::SetVec2(const std::string& name, const glm::vec2& value)
+	{
+		glUniform2f(GetLocation(name), value.x, value.y);
+	}
+
+	void ShaderProgram::SetVec3(const std::string& name, const glm::vec3& value)
+	{
+		glUniform3f(GetLocation(name), value.x, value.y, value.z);
+	}
+
+	void ShaderProgram::SetVec4(const std::string& name, const glm::vec4& value)
+	{
+		glUniform4f(GetLocation(name), value.x, value.y, value.z, value.w);
+	}
+
+	void ShaderProgram::SetMat4(const std::string& name, const glm::mat4& value)
+	{
+		glUniformMatrix4fv(GetLocation(name), 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	int ShaderProgram::GetLocation(const std::string& name)
+	{
+		auto it = m_locations.find(name);
+		if (it != m_locations.end())
+			return it->second;
+
+		int location = glGetUniformLocation(m_id, name.c_str());
+		m_locations[name] = location;
+		return location;
+	}
+
+#pragma endregion
+
+
+#pragma region ShaderCache
+
+	void ShaderCache::Initialize(const std::string& cacheDirectory)
+	{
+		m_cacheDirectory = cacheDirectory;
+
+		std::error_code ec;
+		std::filesystem::create_directories(m_cacheDirectory, ec);
+
+		std::string driver = GetGLString(GL_VENDOR) + "|" + GetGLString(GL_RENDERER) + "|" + GetGLString(GL_VERSION);
+		m_driverHash = Fnv1a(driver);
+
+		// program binaries are core in 4.1 only, the loader leaves the pointers null otherwise.
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		m_binarySupported = formats > 0 && glProgramBinary != nullptr && glGetProgramBinary != nullptr;
+
+		if (!m_binarySupported)
+			GAME_LOG_WARNING("ShaderCache: program binaries not supported by the driver, compiling from source");
+
+		m_initialized = true;
+	}
+
+	void ShaderCache::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		for (Entry& entry : m_entries)
+		{
+			if (entry.program && entry.program->m_id)
+				glDeleteProgram(entry.program->m_id);
+		}
+		m_entries.clear();
+
+		m_initialized = false;
+	}
+
+	ShaderProgram* ShaderCache::Load(const std::string& vertPath, const std::string& fragPath)
+	{
+		for (Entry& entry : m_entries)
+		{
+			if (entry.vertPath == vertPath && entry.fragPath == fragPath)
+				return entry.program.get();
+		}
+
+		Entry entry;
+		entry.vertPath = vertPath;
+		entry.fragPath = fragPath;
+		entry.program = std::make_unique<ShaderProgram>();
+		entry.program->m_id = Build(vertPath, fragPath, entry.dependencies);
+
+		if (!entry.program->m_id)
+			return nullptr;
+
+		m_entries.push_back(std::move(entry));
+		return m_entries.back().program.get();
+	}
+
+	void ShaderCache::Update(float dt)
+	{
+#ifdef DEVELOPMENT_BUILD
+		m_pollTimer += dt;
+		if (m_pollTimer < s_pollInterval)
+			return;
+		m_pollTimer = 0.f;
+
+		for (Entry& entry : m_entries)
+		{
+			bool changed = false;
+			for (const Dependency& dependency : entry.dependencies)
+			{
+				std::error_code ec;
+				std::filesystem::file_time_type time = std::filesystem::last_write_time(dependency.path, ec);
+				if (!ec && time != dependency.time)
+				{
+					changed = true;
+					break;
+				}
+			}
+
+			if (!changed)
+				continue;
+
+			std::vector<Dependency> dependencies;
+			unsigned int program = Build(entry.vertPath, entry.fragPath, dependencies);
+
+			// keep the old program on errors, the file may still be half written.
+			if (!dependencies.empty())
+				entry.dependencies = std::move(dependencies);
+			if (!program)
+				continue;
+
+			glDeleteProgram(entry.program->m_id);
+			entry.program->m_id = program;
+			entry.program->m_locations.clear();
+			m_reloads++;
+
+			GAME_LOG_INFO("ShaderCache: reloaded %s + %s", entry.vertPath, entry.fragPath);
+		}
+#else
+		(void)dt;
+#endif
+	}
+
+
+	unsigned int ShaderCache::Build(const std::string& vertPath, const std::string& fragPath, std::vector<Dependency>& dependencies)
+	{
+		std::string vertSource, fragSource;
+		if (!Preprocess(vertPath, vertSource, dependencies, 0) || !Preprocess(fragPath, fragSource, dependencies, 0))
+			return 0;
+
+		uint64_t key = Fnv1a(fragSource, Fnv1a(vertSource, m_driverHash));
+
+		if (m_binarySupported)
+		{
+			if (unsigned int program = LoadBinary(key))
+			{
+				m_cacheHits++;
+				return program;
+			}
+		}
+
+		m_cacheMisses++;
+		unsigned int program = LinkFromSource(vertSource, fragSource, vertPath + " + " + fragPath);
+		if (program && m_binarySupported)
+			SaveBinary(key, program);
+
+		return program;
+	}
+
+	bool ShaderCache::Preprocess(const std::string& path, std::string& out, std::vector<Dependency>& dependencies, int depth)
+	{
+		if (depth > 16)
+		{
+			GAME_LOG_ERROR("ShaderCache: include depth exceeded in %s", path);
+			return false;
+		}
+
+		std::ifstream file(path);
+		if (!file)
+		{
+			GAME_LOG_ERROR("ShaderCache: could not open %s", path);
+			return false;
+		}
+
+		std::error_code ec;
+		dependencies.push_back({ path, std::filesystem::last_write_time(path, ec) });
+
+		std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+		std::string line;
+		while (std::getline(file, line))
+		{
+			size_t start = line.find_first_not_of(" \t");
+			if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+			{
+				size_t open = line.find('"', start);
+				size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+				if (close == std::string::npos)
+				{
+					GAME_LOG_ERROR("ShaderCache: malformed include in %s: %s", path, line);
+					return false;
+				}
+
+				std::string include = (directory / line.substr(open + 1, close - open - 1)).string();
+				if (!Preprocess(include, out, dependencies, depth + 1))
+					return false;
+				continue;
+			}
+
+			out += line;
+			out += '\n';
+		}
+		return true;
+	}
+
+	unsigned int ShaderCache::CompileStage(unsigned int type, const std::string& source, const std::string& path)
+	{
+		unsigned int shader = glCreateShader(type);
+		const char* src = source.c_str();
+		glShaderSource(shader, 1, &src, nullptr);
+		glCompileShader(shader);
+
+		GLint success = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			char log[1024];
+			glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+			GAME_LOG_ERROR("ShaderCache: compilation failed for %s\n%s", path, log);
+			glDeleteShader(shader);
+			return 0;
+		}
+		return shader;
+	}
+
+	unsigned int ShaderCache::LinkFromSource(const std::string& vertSource, const std::string& fragSource, const std::string& name)
+	{
+		unsigned int vert = CompileStage(GL_VERTEX_SHADER, vertSource, name);
+		unsigned int frag = CompileStage(GL_FRAGMENT_SHADER, fragSource, name);
+		if (!vert || !frag)
+		{
+			glDeleteShader(vert);
+			glDeleteShader(frag);
+			return 0;
+		}
+
+		unsigned int program = glCreateProgram();
+		if (m_binarySupported)
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+		glAttachShader(program, vert);
+		glAttachShader(program, frag);
+		glLinkProgram(program);
+
+		glDetachShader(program, vert);
+		glDetachShader(program, frag);
+		glDeleteShader(vert);
+		glDeleteShader(frag);
+
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			char log[1024];
+			glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+			GAME_LOG_ERROR("ShaderCache: link failed for %s\n%s", name, log);
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	unsigned int ShaderCache::LoadBinary(uint64_t key)
+	{
+		std::string path = GetBinaryPath(key);
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return 0;
+
+		BinaryHeader header = {};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || header.magic != s_binaryMagic || header.version != s_binaryVersion || header.driverHash != m_driverHash)
+			return 0;
+
+		// the size comes from disk, a truncated or damaged file must not decide how much is allocated
+		std::error_code ec;
+		uintmax_t fileSize = std::filesystem::file_size(path, ec);
+		if (ec || header.size == 0 || header.size > fileSize - sizeof(header))
+		{
+			GAME_LOG_WARNING("ShaderCache: removing damaged binary %s", path);
+			file.close();
+			std::filesystem::remove(path, ec);
+			return 0;
+		}
+
+		std::vector<char> binary(header.size);
+		file.read(binary.data(), binary.size());
+		if (!file)
+			return 0;
+
+		unsigned int program = glCreateProgram();
+		glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+		// drivers are allowed to reject binaries at any time (driver update, different settings...)
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	void ShaderCache::SaveBinary(uint64_t key, unsigned int program)
+	{
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+		BinaryHeader header = { s_binaryMagic, s_binaryVersion, m_driverHash, format, static_cast<uint32_t>(length) };
+
+		std::ofstream file(GetBinaryPath(key), std::ios::binary);
+		if (!file)
+			return;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(binary.data(), binary.size());
+	}
+
+	std::string ShaderCache::GetBinaryPath(uint64_t key) const
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return m_cacheDirectory + "/" + name;
+	}
+
+#pragma endregion
+
+}
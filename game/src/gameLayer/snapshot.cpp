@@ -0,0 +1,471 @@
+#include "snapshot.h"
+
+#include "asyncLog.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr uint32_t s_snapshotMagic = 0x504E534C;	// "LSNP"
+		constexpr uint32_t s_snapshotVersion = 1;
+
+		// small files are not worth a rewrite
+		constexpr uint64_t s_minCompactBytes = 1 << 20;
+
+		struct SnapshotHeader
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t indexOffset;
+			uint32_t chunkCount;
+			uint32_t padding;
+		};
+	}
+
+	void SnapshotStore::Initialize()
+	{
+		m_stopWorker = false;
+		m_worker = std::thread(&SnapshotStore::WorkerLoop, this);
+		m_initialized = true;
+	}
+
+	void SnapshotStore::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopWorker = true;
+		}
+		m_condition.notify_all();
+		if (m_worker.joinable())
+			m_worker.join();
+
+		Unmap();
+		m_chunks.clear();
+		m_previous.clear();
+
+		m_initialized = false;
+	}
+
+	#pragma region capture
+
+	void SnapshotStore::BeginCapture()
+	{
+		m_chunks.clear();
+		m_sharedChunks = 0;
+		m_captureStart = std::chrono::steady_clock::now();
+	}
+
+	void SnapshotStore::AddChunk(uint32_t id, uint32_t version, uint64_t revision, const ChunkFunction& write)
+	{
+		// unchanged since the previous capture, the worker may still be writing these bytes so they are shared, never modified
+		auto previous = m_previous.find(id);
+		if (revision != 0 && previous != m_previous.end() && previous->second.revision == revision && previous->second.version == version)
+		{
+			m_chunks.push_back(previous->second);
+			m_sharedChunks++;
+			return;
+		}
+
+		auto bytes = std::make_shared<std::vector<uint8_t>>();
+		SnapshotWriter writer(*bytes);
+		write(writer);
+		m_chunks.push_back({ id, version, revision, std::move(bytes) });
+	}
+
+	void SnapshotStore::Save(const std::string& path)
+	{
+		m_previous.clear();
+		for (const CapturedChunk& chunk : m_chunks)
+			m_previous[chunk.id] = chunk;
+
+		auto capture = std::make_unique<Capture>();
+		capture->path = path;
+		capture->chunks = std::move(m_chunks);
+		m_chunks.clear();
+
+		m_captureMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - m_captureStart).count();
+
+		if (!m_initialized)
+		{
+			GAME_LOG_ERROR("snapshot store is not initialized, %s was not saved", path);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending = std::move(capture);
+		}
+		m_condition.notify_one();
+	}
+
+	bool SnapshotStore::IsSaving()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_saving || m_pending;
+	}
+
+	SnapshotStore::Stats SnapshotStore::GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats stats = m_stats;
+		stats.sharedChunks = m_sharedChunks;
+		stats.captureMs = m_captureMs;
+		return stats;
+	}
+
+	#pragma endregion
+
+	#pragma region worker
+
+	void SnapshotStore::WorkerLoop()
+	{
+		while (true)
+		{
+			std::unique_ptr<Capture> capture;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stopWorker || m_pending; });
+
+				// a queued save still goes out on shutdown
+				if (!m_pending)
+					return;
+				capture = std::move(m_pending);
+				m_saving = true;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			Stats stats;
+			bool saved = WriteCapture(*capture, stats);
+			if (!saved)
+			{
+				GAME_LOG_ERROR("could not save the snapshot %s", capture->path);
+				m_filePath.clear();		// the index is read again from whatever made it to disk
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stats.saves += saved;
+			m_stats.writtenChunks = stats.writtenChunks;
+			m_stats.keptChunks = stats.keptChunks;
+			m_stats.writtenBytes = stats.writtenBytes;
+			m_stats.fileBytes = static_cast<size_t>(m_fileBytes);
+			m_stats.compacted = stats.compacted;
+			m_stats.failed = !saved;
+			m_stats.saveMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			m_saving = false;
+		}
+	}
+
+	// chunks already in the file with the same content stay where they are, the rest is appended
+	bool SnapshotStore::WriteCapture(const Capture& capture, Stats& stats)
+	{
+		if (m_filePath != capture.path && !ReadFileIndex(capture.path))
+		{
+			m_fileIndex.clear();
+			m_fileBytes = 0;
+		}
+		m_filePath = capture.path;
+
+		std::vector<uint64_t> hashes(capture.chunks.size());
+		std::vector<IndexEntry> index(capture.chunks.size());
+		std::vector<size_t> changed;
+		uint64_t totalBytes = 0;
+		uint64_t changedBytes = 0;
+
+		for (size_t i = 0; i < capture.chunks.size(); i++)
+		{
+			const CapturedChunk& chunk = capture.chunks[i];
+			hashes[i] = Hash(*chunk.bytes);
+			totalBytes += chunk.bytes->size();
+
+			bool kept = false;
+			for (const IndexEntry& entry : m_fileIndex)
+			{
+				if (entry.id == chunk.id && entry.version == chunk.version && entry.size == chunk.bytes->size() && entry.hash == hashes[i])
+				{
+					index[i] = entry;
+					kept = true;
+					break;
+				}
+			}
+
+			if (!kept)
+			{
+				changed.push_back(i);
+				changedBytes += chunk.bytes->size();
+			}
+		}
+
+		// after the append the file would hold the old payloads too
+		uint64_t deadBytes = m_fileBytes + changedBytes - std::min<uint64_t>(m_fileBytes + changedBytes, sizeof(SnapshotHeader) + totalBytes);
+		if (m_fileBytes == 0 || (deadBytes > totalBytes && deadBytes > s_minCompactBytes))
+			return WriteFull(capture, hashes, stats);
+
+		std::fstream file(capture.path, std::ios::binary | std::ios::in | std::ios::out);
+		if (!file)
+			return false;
+
+		// past the current index, whatever an interrupted save left there is overwritten
+		uint64_t offset = m_fileBytes;
+		file.seekp(static_cast<std::streamoff>(offset));
+		for (size_t i : changed)
+		{
+			const CapturedChunk& chunk = capture.chunks[i];
+			file.write(reinterpret_cast<const char*>(chunk.bytes->data()), chunk.bytes->size());
+			index[i] = { chunk.id, chunk.version, offset, chunk.bytes->size(), hashes[i] };
+			offset += chunk.bytes->size();
+		}
+
+		uint64_t indexOffset = offset;
+		file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+		file.flush();
+
+		// the new index only counts once the header points at it
+		SnapshotHeader header = { s_snapshotMagic, s_snapshotVersion, indexOffset, static_cast<uint32_t>(index.size()), 0 };
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.flush();
+		if (!file)
+			return false;
+
+		m_fileIndex = std::move(index);
+		m_fileBytes = indexOffset + m_fileIndex.size() * sizeof(IndexEntry);
+
+		stats.writtenChunks = static_cast<int>(changed.size());
+		stats.keptChunks = static_cast<int>(capture.chunks.size() - changed.size());
+		stats.writtenBytes = static_cast<size_t>(changedBytes);
+		return true;
+	}
+
+	// next to the old file first, it replaces the old one only when complete
+	bool SnapshotStore::WriteFull(const Capture& capture, const std::vector<uint64_t>& hashes, Stats& stats)
+	{
+		std::filesystem::path path(capture.path);
+		std::error_code error;
+		if (path.has_parent_path())
+			std::filesystem::create_directories(path.parent_path(), error);
+
+		std::string temporary = capture.path + ".tmp";
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		SnapshotHeader header = { s_snapshotMagic, s_snapshotVersion, 0, static_cast<uint32_t>(capture.chunks.size()), 0 };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		std::vector<IndexEntry> index(capture.chunks.size());
+		uint64_t offset = sizeof(header);
+		for (size_t i = 0; i < capture.chunks.size(); i++)
+		{
+			const CapturedChunk& chunk = capture.chunks[i];
+			file.write(reinterpret_cast<const char*>(chunk.bytes->data()), chunk.bytes->size());
+			index[i] = { chunk.id, chunk.version, offset, chunk.bytes->size(), hashes[i] };
+			offset += chunk.bytes->size();
+		}
+
+		header.indexOffset = offset;
+		file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.close();
+		if (!file)
+			return false;
+
+		std::filesystem::rename(temporary, path, error);
+		if (error)
+			return false;
+
+		bool compacted = m_fileBytes != 0;
+		m_fileIndex = std::move(index);
+		m_fileBytes = offset + m_fileIndex.size() * sizeof(IndexEntry);
+
+		stats.writtenChunks = static_cast<int>(capture.chunks.size());
+		stats.keptChunks = 0;
+		stats.writtenBytes = static_cast<size_t>(offset - sizeof(header));
+		stats.compacted = compacted;
+		return true;
+	}
+
+	bool SnapshotStore::ReadFileIndex(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+			return false;
+
+		uint64_t size = static_cast<uint64_t>(file.tellg());
+		SnapshotHeader header = {};
+		file.seekg(0);
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			return false;
+		if (header.magic != s_snapshotMagic || header.version != s_snapshotVersion)
+			return false;
+
+		uint64_t indexBytes = static_cast<uint64_t>(header.chunkCount) * sizeof(IndexEntry);
+		if (header.indexOffset < sizeof(header) || header.indexOffset > size || size - header.indexOffset < indexBytes)
+			return false;
+
+		m_fileIndex.resize(header.chunkCount);
+		file.seekg(static_cast<std::streamoff>(header.indexOffset));
+		if (!file.read(reinterpret_cast<char*>(m_fileIndex.data()), indexBytes))
+			return false;
+
+		m_fileBytes = header.indexOffset + indexBytes;
+		return true;
+	}
+
+	// FNV-1a, only compared against the hash of the same chunk in the file
+	uint64_t SnapshotStore::Hash(const std::vector<uint8_t>& bytes)
+	{
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (uint8_t byte : bytes)
+		{
+			hash ^= byte;
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	#pragma endregion
+
+	#pragma region loading
+
+	bool SnapshotStore::Map(const std::string& path)
+	{
+		Unmap();
+
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size = {};
+		HANDLE mapping = nullptr;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		m_mapped = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		m_mappedSize = static_cast<size_t>(size.QuadPart);
+		m_mapping = mapping;
+		m_mappedFile = reinterpret_cast<intptr_t>(file);
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat info = {};
+		void* mapped = MAP_FAILED;
+		if (fstat(file, &info) == 0 && info.st_size > 0)
+			mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapped == MAP_FAILED)
+		{
+			close(file);
+			return false;
+		}
+
+		m_mapped = static_cast<const uint8_t*>(mapped);
+		m_mappedSize = static_cast<size_t>(info.st_size);
+		m_mappedFile = file;
+#endif
+
+		if (!m_mapped)
+		{
+			Unmap();
+			return false;
+		}
+
+		SnapshotHeader header = {};
+		bool valid = m_mappedSize >= sizeof(header);
+		if (valid)
+		{
+			std::memcpy(&header, m_mapped, sizeof(header));
+			valid = header.magic == s_snapshotMagic;
+		}
+		if (valid && header.version != s_snapshotVersion)
+		{
+			GAME_LOG_WARNING("snapshot %s has file version %d, expected %d", path, header.version, s_snapshotVersion);
+			valid = false;
+		}
+
+		uint64_t indexBytes = static_cast<uint64_t>(header.chunkCount) * sizeof(IndexEntry);
+		valid = valid && header.indexOffset >= sizeof(header) && header.indexOffset <= m_mappedSize && m_mappedSize - header.indexOffset >= indexBytes;
+		if (valid)
+		{
+			m_mappedIndex.resize(header.chunkCount);
+			std::memcpy(m_mappedIndex.data(), m_mapped + header.indexOffset, indexBytes);
+			for (const IndexEntry& entry : m_mappedIndex)
+				valid = valid && entry.offset <= header.indexOffset && entry.size <= header.indexOffset - entry.offset;
+		}
+
+		if (!valid)
+		{
+			GAME_LOG_ERROR("%s is not a valid snapshot", path);
+			Unmap();
+			return false;
+		}
+		return true;
+	}
+
+	void SnapshotStore::Unmap()
+	{
+#ifdef _WIN32
+		if (m_mapped)
+			UnmapViewOfFile(m_mapped);
+		if (m_mapping)
+			CloseHandle(static_cast<HANDLE>(m_mapping));
+		if (m_mappedFile != -1)
+			CloseHandle(reinterpret_cast<HANDLE>(m_mappedFile));
+#else
+		if (m_mapped)
+			munmap(const_cast<uint8_t*>(m_mapped), m_mappedSize);
+		if (m_mappedFile != -1)
+			close(static_cast<int>(m_mappedFile));
+#endif
+
+		m_mapped = nullptr;
+		m_mappedSize = 0;
+		m_mapping = nullptr;
+		m_mappedFile = -1;
+		m_mappedIndex.clear();
+	}
+
+	bool SnapshotStore::ReadChunk(uint32_t id, uint32_t& version, SnapshotReader& reader) const
+	{
+		for (const IndexEntry& entry : m_mappedIndex)
+		{
+			if (entry.id != id)
+				continue;
+
+			version = entry.version;
+			reader = SnapshotReader(m_mapped + entry.offset, static_cast<size_t>(entry.size));
+			return true;
+		}
+		return false;
+	}
+
+	#pragma endregion
+
+}
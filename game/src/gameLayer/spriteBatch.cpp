@@ -0,0 +1,185 @@
+#include "spriteBatch.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+
+namespace game
+{
+
+	namespace
+	{
+		uint16_t PackUnorm16(float v)
+		{
+			return static_cast<uint16_t>(std::clamp(v, 0.f, 1.f) * 65535.f + 0.5f);
+		}
+
+		uint8_t PackUnorm8(float v)
+		{
+			return static_cast<uint8_t>(std::clamp(v, 0.f, 1.f) * 255.f + 0.5f);
+		}
+	}
+
+
+	void SpriteBatch::Initialize(ShaderCache& shaderCache, int maxInstances)
+	{
+		m_maxInstances = maxInstances;
+		m_instances.reserve(maxInstances);
+		Memory::RecordAllocation(MemoryTag::Sprites, m_instances.capacity() * sizeof(QuadInstance));
+
+		m_shader = shaderCache.Load(RESOURCES_PATH "instanced_quad.vert", RESOURCES_PATH "fragment.frag");
+
+		glGenVertexArrays(1, &m_vao);
+		glGenBuffers(1, &m_vbo);
+
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(QuadInstance) * maxInstances, nullptr, GL_STREAM_DRAW);
+
+		constexpr GLsizei stride = sizeof(QuadInstance);
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(QuadInstance, rect));
+		glVertexAttribDivisor(0, 1);
+
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(QuadInstance, uv));
+		glVertexAttribDivisor(1, 1);
+
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(QuadInstance, color));
+		glVertexAttribDivisor(2, 1);
+
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, stride, (void*)offsetof(QuadInstance, texIndex));
+		glVertexAttribDivisor(3, 1);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_initialized = true;
+	}
+
+	void SpriteBatch::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		glDeleteBuffers(1, &m_vbo);
+		glDeleteVertexArrays(1, &m_vao);
+		m_vbo = 0;
+		m_vao = 0;
+
+		Memory::RecordFree(MemoryTag::Sprites, m_instances.capacity() * sizeof(QuadInstance));
+		m_instances = {};
+		m_textureCount = 0;
+		m_initialized = false;
+	}
+
+	void SpriteBatch::SetCamera(const LittleEngine::Graphics::Camera& camera)
+	{
+		if (!m_instances.empty())
+			Flush();
+
+		m_view = camera.GetViewMatrix();
+		m_projection = camera.GetProjectionMatrix();
+	}
+
+	void SpriteBatch::DrawRect(const glm::vec4& rect, LittleEngine::Graphics::Texture& texture, const LittleEngine::Graphics::Color& color, const glm::vec4& uv)
+	{
+		if (static_cast<int>(m_instances.size()) >= m_maxInstances)
+			Flush();
+
+		int slot = GetTextureSlot(texture);
+
+		QuadInstance& q = m_instances.emplace_back();
+		q.rect = rect;
+		q.uv[0] = PackUnorm16(uv.x);
+		q.uv[1] = PackUnorm16(uv.y);
+		q.uv[2] = PackUnorm16(uv.z);
+		q.uv[3] = PackUnorm16(uv.w);
+		q.color[0] = PackUnorm8(color.x);
+		q.color[1] = PackUnorm8(color.y);
+		q.color[2] = PackUnorm8(color.z);
+		q.color[3] = PackUnorm8(color.w);
+		q.texIndex = static_cast<uint8_t>(slot);
+	}
+
+	void SpriteBatch::DrawInstances(const QuadInstance* instances, size_t count, LittleEngine::Graphics::Texture& texture)
+	{
+		while (count > 0)
+		{
+			if (static_cast<int>(m_instances.size()) >= m_maxInstances)
+				Flush();
+
+			uint8_t slot = static_cast<uint8_t>(GetTextureSlot(texture));
+			size_t batch = std::min(count, static_cast<size_t>(m_maxInstances) - m_instances.size());
+
+			size_t first = m_instances.size();
+			m_instances.insert(m_instances.end(), instances, instances + batch);
+			for (size_t i = first; i < m_instances.size(); i++)
+				m_instances[i].texIndex = slot;
+
+			instances += batch;
+			count -= batch;
+		}
+	}
+
+	void SpriteBatch::Flush()
+	{
+		if (m_instances.empty() || !m_shader)
+		{
+			m_instances.clear();
+			m_textureCount = 0;
+			return;
+		}
+
+		// samplers are set every flush, the program may have been hot reloaded.
+		m_shader->Use();
+		m_shader->SetMat4("view", m_view);
+		m_shader->SetMat4("projection", m_projection);
+		for (int i = 0; i < m_textureCount; i++)
+			m_shader->SetInt("uTextures[" + std::to_string(i) + "]", i);
+
+		for (int i = 0; i < m_textureCount; i++)
+			m_textures[i]->Bind(i);
+
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+		// orphan the buffer so the driver does not wait on the previous draw
+		GLsizeiptr size = sizeof(QuadInstance) * m_instances.size();
+		glBufferData(GL_ARRAY_BUFFER, sizeof(QuadInstance) * m_maxInstances, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_instances.data());
+
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(m_instances.size()));
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_frameInstances += static_cast<int>(m_instances.size());
+		m_frameDrawCalls++;
+
+		m_instances.clear();
+		m_textureCount = 0;
+	}
+
+	int SpriteBatch::GetTextureSlot(LittleEngine::Graphics::Texture& texture)
+	{
+		for (int i = 0; i < m_textureCount; i++)
+		{
+			if (m_textures[i] == &texture)
+				return i;
+		}
+
+		if (m_textureCount >= s_maxTextures)
+			Flush();
+
+		m_textures[m_textureCount] = &texture;
+		return m_textureCount++;
+	}
+
+}
@@ -0,0 +1,392 @@
+#include "textureManager.h"
+#include "asyncLog.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+
+namespace game
+{
+
+	namespace
+	{
+		uint32_t ReadBig32(const uint8_t* p) { return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; }
+		uint32_t ReadBig16(const uint8_t* p) { return (uint32_t(p[0]) << 8) | p[1]; }
+		uint32_t ReadLittle16(const uint8_t* p) { return uint32_t(p[0]) | (uint32_t(p[1]) << 8); }
+		int32_t ReadLittle32(const uint8_t* p) { return static_cast<int32_t>(uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24)); }
+	}
+
+	void TextureManager::Initialize()
+	{
+		// mid grey, drawn while a texture streams in
+		m_placeholder.Create(4, 4, GL_RGBA);
+		GLfloat clearColor[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+		m_placeholder.Bind();
+		glClearColor(0.5f, 0.5f, 0.5f, 1.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		m_placeholder.Unbind();
+		glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+		m_stopWorker = false;
+		m_worker = std::thread(&TextureManager::WorkerLoop, this);
+
+		m_initialized = true;
+	}
+
+	void TextureManager::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopWorker = true;
+			m_requests.clear();
+		}
+		m_condition.notify_one();
+		if (m_worker.joinable())
+			m_worker.join();
+
+		for (std::unique_ptr<Entry>& entry : m_entries)
+		{
+			if (entry->alive && entry->state == State::Resident)
+				entry->texture.Cleanup();
+		}
+		m_entries.clear();
+		m_freeEntries.clear();
+		m_ready.clear();
+		m_finished.clear();
+		m_residentBytes = 0;
+
+		m_placeholder.Cleanup();
+
+		m_initialized = false;
+	}
+
+	TextureHandle TextureManager::Load(const std::string& path, const TextureOptions& options, bool preload)
+	{
+		uint32_t index = 0;
+		if (!m_freeEntries.empty())
+		{
+			index = m_freeEntries.back();
+			m_freeEntries.pop_back();
+		}
+		else
+		{
+			index = static_cast<uint32_t>(m_entries.size());
+			m_entries.push_back(std::make_unique<Entry>());
+		}
+
+		Entry& entry = *m_entries[index];
+		entry.path = path;
+		entry.options = options;
+		entry.state = State::Evicted;
+		entry.size = { 0, 0 };
+		entry.bytes = 0;
+		entry.lastUsedFrame = m_frame;
+		entry.alive = true;
+
+		if (preload)
+		{
+			std::ifstream file(path, std::ios::binary);
+			if (!file)
+			{
+				GAME_LOG_ERROR("TextureManager: could not read %s", path);
+				entry.state = State::Failed;
+				return { index, entry.generation };
+			}
+
+			std::vector<uint8_t> header(64 * 1024);
+			file.read(reinterpret_cast<char*>(header.data()), header.size());
+			header.resize(static_cast<size_t>(file.gcount()));
+
+			entry.size = ReadImageSize(header);
+			entry.bytes = ComputeBytes(entry.size, options);
+			Upload(entry);
+		}
+
+		return { index, entry.generation };
+	}
+
+	void TextureManager::Unload(TextureHandle handle)
+	{
+		Entry* entry = GetEntry(handle);
+		if (!entry)
+			return;
+
+		if (entry->state == State::Resident)
+			Evict(*entry);
+
+		// a queued read finishes with a stale generation and is dropped
+		m_ready.erase(std::remove(m_ready.begin(), m_ready.end(), handle.index), m_ready.end());
+
+		entry->alive = false;
+		entry->state = State::Evicted;
+		if (++entry->generation == 0)
+			entry->generation = 1;
+		m_freeEntries.push_back(handle.index);
+	}
+
+	bool TextureManager::IsAlive(TextureHandle handle) const
+	{
+		return GetEntry(handle) != nullptr;
+	}
+
+	bool TextureManager::IsResident(TextureHandle handle) const
+	{
+		const Entry* entry = GetEntry(handle);
+		return entry && entry->state == State::Resident;
+	}
+
+	LittleEngine::Graphics::Texture& TextureManager::Get(TextureHandle handle)
+	{
+		Entry* entry = GetEntry(handle);
+		if (!entry)
+			return m_placeholder.GetTexture();
+
+		entry->lastUsedFrame = m_frame;
+		if (entry->state == State::Resident)
+			return entry->texture;
+
+		if (entry->state == State::Evicted)
+		{
+			entry->state = State::Queued;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_requests.push_back({ handle.index, handle.generation, entry->path });
+			}
+			m_condition.notify_one();
+		}
+
+		m_placeholderDraws++;
+		return m_placeholder.GetTexture();
+	}
+
+	size_t TextureManager::GetTextureBytes(TextureHandle handle) const
+	{
+		const Entry* entry = GetEntry(handle);
+		return entry ? entry->bytes : 0;
+	}
+
+	void TextureManager::Update()
+	{
+		if (!m_initialized)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_collected.swap(m_finished);
+		}
+
+		for (const Result& result : m_collected)
+		{
+			if (result.index >= m_entries.size())
+				continue;
+			Entry& entry = *m_entries[result.index];
+			if (!entry.alive || entry.generation != result.generation || entry.state != State::Queued)
+				continue;
+
+			if (!result.ok)
+			{
+				GAME_LOG_ERROR("TextureManager: could not read %s", entry.path);
+				entry.state = State::Failed;
+				continue;
+			}
+
+			entry.size = result.size;
+			entry.bytes = ComputeBytes(result.size, entry.options);
+			entry.state = State::Ready;
+			m_ready.push_back(result.index);
+		}
+		m_collected.clear();
+
+		// most recently requested first, those are on screen now
+		std::stable_sort(m_ready.begin(), m_ready.end(), [this](uint32_t a, uint32_t b)
+		{
+			return m_entries[a]->lastUsedFrame > m_entries[b]->lastUsedFrame;
+		});
+
+		int uploads = 0;
+		size_t consumed = 0;
+		for (; consumed < m_ready.size() && uploads < settings.maxUploadsPerFrame; consumed++)
+		{
+			Entry& entry = *m_entries[m_ready[consumed]];
+
+			// no longer drawn while it was waiting, it can be requested again later
+			if (m_frame - entry.lastUsedFrame > static_cast<uint64_t>(settings.protectedFrames))
+			{
+				entry.state = State::Evicted;
+				continue;
+			}
+
+			Upload(entry);
+			uploads++;
+		}
+		m_ready.erase(m_ready.begin(), m_ready.begin() + consumed);
+
+		EnforceBudget();
+
+		m_stats.registered = 0;
+		m_stats.resident = 0;
+		m_stats.pending = 0;
+		for (const std::unique_ptr<Entry>& entry : m_entries)
+		{
+			if (!entry->alive)
+				continue;
+			m_stats.registered++;
+			m_stats.resident += entry->state == State::Resident;
+			m_stats.pending += entry->state == State::Queued || entry->state == State::Ready;
+		}
+		m_stats.residentBytes = m_residentBytes;
+		m_stats.placeholderDraws = m_placeholderDraws;
+
+		m_placeholderDraws = 0;
+		m_frame++;
+	}
+
+	TextureManager::Entry* TextureManager::GetEntry(TextureHandle handle)
+	{
+		if (handle.index >= m_entries.size())
+			return nullptr;
+		Entry* entry = m_entries[handle.index].get();
+		if (!entry->alive || entry->generation != handle.generation)
+			return nullptr;
+		return entry;
+	}
+
+	const TextureManager::Entry* TextureManager::GetEntry(TextureHandle handle) const
+	{
+		return const_cast<TextureManager*>(this)->GetEntry(handle);
+	}
+
+	void TextureManager::Upload(Entry& entry)
+	{
+		entry.texture.LoadFromFile(entry.path, entry.options.pixelated, entry.options.mipmaps, entry.options.flip);
+		entry.state = State::Resident;
+		m_residentBytes += entry.bytes;
+		m_stats.peakBytes = std::max(m_stats.peakBytes, m_residentBytes);
+		m_stats.uploads++;
+	}
+
+	void TextureManager::Evict(Entry& entry)
+	{
+		entry.texture.Cleanup();
+		entry.state = State::Evicted;
+		m_residentBytes -= entry.bytes;
+		m_stats.evictions++;
+	}
+
+	// least recently drawn first, textures drawn in the last protectedFrames stay
+	void TextureManager::EnforceBudget()
+	{
+		m_stats.overBudget = false;
+		while (m_residentBytes > settings.budgetBytes)
+		{
+			Entry* oldest = nullptr;
+			for (std::unique_ptr<Entry>& entry : m_entries)
+			{
+				if (!entry->alive || entry->state != State::Resident)
+					continue;
+				if (m_frame - entry->lastUsedFrame <= static_cast<uint64_t>(settings.protectedFrames))
+					continue;
+				if (!oldest || entry->lastUsedFrame < oldest->lastUsedFrame)
+					oldest = entry.get();
+			}
+
+			if (!oldest)
+			{
+				m_stats.overBudget = true;
+				return;
+			}
+			Evict(*oldest);
+		}
+	}
+
+	// reads the whole file so the upload finds it in the OS cache, the header gives the size
+	void TextureManager::WorkerLoop()
+	{
+		std::vector<uint8_t> bytes;
+
+		while (true)
+		{
+			Request request;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_stopWorker || !m_requests.empty(); });
+				if (m_stopWorker)
+					return;
+
+				request = std::move(m_requests.front());
+				m_requests.pop_front();
+			}
+
+			std::ifstream file(request.path, std::ios::binary);
+			bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+			bool ok = file.is_open() && !bytes.empty();
+			glm::ivec2 size = ReadImageSize(bytes);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_finished.push_back({ request.index, request.generation, size, ok });
+		}
+	}
+
+	// png, jpeg, bmp and tga headers, {0, 0} for anything else
+	glm::ivec2 TextureManager::ReadImageSize(const std::vector<uint8_t>& bytes)
+	{
+		const uint8_t* p = bytes.data();
+		size_t size = bytes.size();
+
+		static const uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+		if (size >= 24 && std::equal(pngSignature, pngSignature + 8, p))
+			return { static_cast<int>(ReadBig32(p + 16)), static_cast<int>(ReadBig32(p + 20)) };
+
+		if (size >= 4 && p[0] == 0xFF && p[1] == 0xD8)
+		{
+			// walk the segments to the first start of frame marker
+			size_t offset = 2;
+			while (offset + 9 < size)
+			{
+				if (p[offset] != 0xFF)
+				{
+					offset++;
+					continue;
+				}
+				uint8_t marker = p[offset + 1];
+				if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+					return { static_cast<int>(ReadBig16(p + offset + 7)), static_cast<int>(ReadBig16(p + offset + 5)) };
+				if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0xFF)
+				{
+					offset += marker == 0xFF ? 1 : 2;
+					continue;
+				}
+				offset += 2 + ReadBig16(p + offset + 2);
+			}
+			return { 0, 0 };
+		}
+
+		if (size >= 26 && p[0] == 'B' && p[1] == 'M')
+			return { std::abs(ReadLittle32(p + 18)), std::abs(ReadLittle32(p + 22)) };
+
+		// tga has no magic, check for an uncompressed or rle true color / grey image type
+		if (size >= 18 && (p[2] == 2 || p[2] == 3 || p[2] == 10 || p[2] == 11) && p[1] == 0)
+			return { static_cast<int>(ReadLittle16(p + 12)), static_cast<int>(ReadLittle16(p + 14)) };
+
+		return { 0, 0 };
+	}
+
+	// RGBA8 upload, a full mip chain adds a third
+	size_t TextureManager::ComputeBytes(glm::ivec2 size, const TextureOptions& options)
+	{
+		size_t bytes = static_cast<size_t>(size.x) * static_cast<size_t>(size.y) * 4;
+		if (options.mipmaps)
+			bytes += bytes / 3;
+		return bytes;
+	}
+
+}
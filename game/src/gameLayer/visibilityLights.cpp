@@ -0,0 +1,486 @@
+#include "visibilityLights.h"
+#include "parallel.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <set>
+
+
+namespace game
+{
+
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+
+		float Cross(glm::vec2 a, glm::vec2 b)
+		{
+			return a.x * b.y - a.y * b.x;
+		}
+
+		// distance along the ray to the line through the segment
+		float RayDistance(glm::vec2 origin, glm::vec2 dir, glm::vec2 a, glm::vec2 b)
+		{
+			glm::vec2 e = b - a;
+			float denom = Cross(dir, e);
+			if (std::abs(denom) < 1e-9f)
+				return std::min(glm::length(a - origin), glm::length(b - origin));
+			return Cross(a - origin, e) / denom;
+		}
+
+		bool SegmentsCross(glm::vec2 p, glm::vec2 q, glm::vec2 a, glm::vec2 b)
+		{
+			float d1 = Cross(q - p, a - p);
+			float d2 = Cross(q - p, b - p);
+			float d3 = Cross(b - a, p - a);
+			float d4 = Cross(b - a, q - a);
+			return ((d1 > 0.f) != (d2 > 0.f)) && ((d3 > 0.f) != (d4 > 0.f));
+		}
+
+		struct Segment
+		{
+			glm::vec2 begin;	// the sweep reaches begin first (counter clockwise)
+			glm::vec2 end;
+		};
+
+		struct EndPoint
+		{
+			float angle;
+			int segment;
+			bool begin;
+		};
+
+		// orders the active segments by distance along the current sweep ray.
+		// Non intersecting segments keep their relative order while both are active, so the order
+		// stays valid when the ray moves on; a new segment is placed using a ray inside its first wedge.
+		struct Closer
+		{
+			const std::vector<Segment>* segments;
+			const glm::vec2* origin;
+			const glm::vec2* dir;
+
+			bool operator()(int a, int b) const
+			{
+				const Segment& sa = (*segments)[a];
+				const Segment& sb = (*segments)[b];
+				return RayDistance(*origin, *dir, sa.begin, sa.end) < RayDistance(*origin, *dir, sb.begin, sb.end);
+			}
+		};
+
+		// keeps the part of a -> b inside the convex, counter clockwise ring, false if nothing is left
+		bool ClipToRing(const glm::vec2* ring, int count, glm::vec2& a, glm::vec2& b)
+		{
+			glm::vec2 d = b - a;
+			float t0 = 0.f;
+			float t1 = 1.f;
+			for (int k = 0; k < count; k++)
+			{
+				glm::vec2 edge = ring[(k + 1) % count] - ring[k];
+				float side = Cross(edge, a - ring[k]);	// >= 0 inside
+				float rate = Cross(edge, d);
+				if (std::abs(rate) < 1e-12f)
+				{
+					if (side < 0.f)
+						return false;
+					continue;
+				}
+				float t = -side / rate;
+				if (rate > 0.f)
+					t0 = std::max(t0, t);
+				else
+					t1 = std::min(t1, t);
+				if (t0 >= t1)
+					return false;
+			}
+			glm::vec2 start = a;
+			a = start + d * t0;
+			b = start + d * t1;
+			return true;
+		}
+
+		struct SweepScratch
+		{
+			std::vector<Segment> walls;
+			std::vector<float> splits;
+			std::vector<Segment> segments;
+			std::vector<EndPoint> endPoints;
+			std::vector<float> nextAngle;
+			std::vector<std::multiset<int, Closer>::iterator> activeIt;
+			std::vector<uint8_t> active;
+		};
+	}
+
+
+	void VisibilityLights::Initialize(ShaderCache& shaderCache)
+	{
+		m_shader = shaderCache.Load(RESOURCES_PATH "visibility_light.vert", RESOURCES_PATH "visibility_light.frag");
+
+		glGenVertexArrays(1, &m_vao);
+		glGenBuffers(1, &m_vbo);
+
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		m_initialized = true;
+	}
+
+	void VisibilityLights::Shutdown()
+	{
+		if (!m_initialized)
+			return;
+
+		glDeleteBuffers(1, &m_vbo);
+		glDeleteVertexArrays(1, &m_vao);
+		m_vbo = 0;
+		m_vao = 0;
+		m_vboCapacity = 0;
+
+		m_initialized = false;
+	}
+
+
+	void VisibilityLights::Compute(const LightStore& lights)
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_store = &lights;
+
+		// obstacle edges, shared by every light
+		m_edges.clear();
+		m_edgeBounds.clear();
+		const LightStore::ObstacleRange* ranges = lights.GetObstacleRanges();
+		const glm::vec2* vertices = lights.GetObstacleVertices();
+		for (size_t o = 0; o < lights.GetObstacleCount(); o++)
+		{
+			const LightStore::ObstacleRange& range = ranges[o];
+			if (range.count < 2)
+				continue;
+
+			// a two point obstacle is a single wall, not a closed polygon
+			uint32_t edgeCount = range.count == 2 ? 1 : range.count;
+			for (uint32_t i = 0; i < edgeCount; i++)
+			{
+				glm::vec2 a = vertices[range.first + i];
+				glm::vec2 b = vertices[range.first + (i + 1) % range.count];
+				m_edges.push_back({ a, b });
+				m_edgeBounds.push_back({ std::min(a.x, b.x), std::min(a.y, b.y), std::max(a.x, b.x), std::max(a.y, b.y) });
+			}
+		}
+
+		size_t lightCount = lights.GetLightCount();
+		m_polygons.resize(lightCount);
+		m_handles.resize(lightCount);
+		m_colors.assign(lights.GetColors(), lights.GetColors() + lightCount);
+		m_intensities.assign(lights.GetIntensities(), lights.GetIntensities() + lightCount);
+		m_radii.assign(lights.GetRadii(), lights.GetRadii() + lightCount);
+		for (size_t i = 0; i < lightCount; i++)
+			m_handles[i] = lights.GetLightHandle(i);
+
+		const glm::vec2* positions = lights.GetPositions();
+		Parallel::For(lightCount, 4, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				ComputeLight(i, positions[i], m_radii[i]);
+		});
+
+		m_computeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void VisibilityLights::ComputeLight(size_t index, glm::vec2 position, float radius)
+	{
+		std::vector<glm::vec2>& polygon = m_polygons[index];
+		polygon.clear();
+		if (radius <= 0.f)
+			return;
+
+		thread_local SweepScratch scratch;
+		std::vector<Segment>& segments = scratch.segments;
+		std::vector<EndPoint>& endPoints = scratch.endPoints;
+		segments.clear();
+		endPoints.clear();
+
+		auto addSegment = [&](glm::vec2 a, glm::vec2 b)
+		{
+			float area = Cross(a - position, b - position);
+			if (std::abs(area) < 1e-7f)
+				return;		// degenerate or seen edge on
+
+			// counter clockwise around the light: a -> b
+			if (area < 0.f)
+				std::swap(a, b);
+			segments.push_back({ a, b });
+		};
+
+		// boundary polygon around the light radius, every ray hits at least this
+		float outer = radius / std::cos(s_pi / s_boundarySegments);
+		glm::vec2 ring[s_boundarySegments];
+		glm::vec2 innerRing[s_boundarySegments];
+		for (int k = 0; k < s_boundarySegments; k++)
+		{
+			float angle = 2.f * s_pi * k / s_boundarySegments;
+			glm::vec2 d = { std::cos(angle), std::sin(angle) };
+			ring[k] = position + outer * d;
+			innerRing[k] = position + outer * 0.999f * d;
+		}
+		for (int k = 0; k < s_boundarySegments; k++)
+			addSegment(ring[k], ring[(k + 1) % s_boundarySegments]);
+
+		// the open segments are ordered by distance, which only holds while no two of them cross: obstacle edges are
+		// clipped to just inside the boundary and split where they cross each other (quadratic in the edges near the light)
+		std::vector<Segment>& walls = scratch.walls;
+		walls.clear();
+		glm::vec4 lightBounds = { position.x - radius, position.y - radius, position.x + radius, position.y + radius };
+		for (size_t e = 0; e < m_edges.size(); e++)
+		{
+			const glm::vec4& bounds = m_edgeBounds[e];
+			if (bounds.x > lightBounds.z || bounds.z < lightBounds.x || bounds.y > lightBounds.w || bounds.w < lightBounds.y)
+				continue;
+
+			// exact circle test: closest point of the edge
+			const Edge& edge = m_edges[e];
+			glm::vec2 ab = edge.b - edge.a;
+			float t = std::clamp(glm::dot(position - edge.a, ab) / std::max(glm::dot(ab, ab), 1e-12f), 0.f, 1.f);
+			if (glm::length(edge.a + ab * t - position) > radius)
+				continue;
+
+			glm::vec2 a = edge.a;
+			glm::vec2 b = edge.b;
+			if (ClipToRing(innerRing, s_boundarySegments, a, b))
+				walls.push_back({ a, b });
+		}
+
+		std::vector<float>& splits = scratch.splits;
+		for (size_t i = 0; i < walls.size(); i++)
+		{
+			glm::vec2 a = walls[i].begin;
+			glm::vec2 d = walls[i].end - a;
+
+			splits.clear();
+			for (size_t j = 0; j < walls.size(); j++)
+			{
+				glm::vec2 other = walls[j].end - walls[j].begin;
+				float denom = Cross(d, other);
+				if (j == i || std::abs(denom) < 1e-12f)
+					continue;
+				float t = Cross(walls[j].begin - a, other) / denom;
+				float u = Cross(walls[j].begin - a, d) / denom;
+				// an end point of the other edge lying on this one splits it too
+				if (t > 1e-5f && t < 1.f - 1e-5f && u > -1e-5f && u < 1.f + 1e-5f)
+					splits.push_back(t);
+			}
+			std::sort(splits.begin(), splits.end());
+			splits.push_back(1.f);
+
+			float previous = 0.f;
+			for (float t : splits)
+			{
+				addSegment(a + d * previous, a + d * t);
+				previous = t;
+			}
+		}
+
+		for (int s = 0; s < static_cast<int>(segments.size()); s++)
+		{
+			glm::vec2 b = segments[s].begin - position;
+			glm::vec2 e = segments[s].end - position;
+			endPoints.push_back({ std::atan2(b.y, b.x), s, true });
+			endPoints.push_back({ std::atan2(e.y, e.x), s, false });
+		}
+
+		std::sort(endPoints.begin(), endPoints.end(), [](const EndPoint& a, const EndPoint& b)
+		{
+			if (a.angle != b.angle)
+				return a.angle < b.angle;
+			return a.begin && !b.begin;
+		});
+
+		// next distinct angle after each end point, to place inserted segments inside their first wedge
+		size_t count = endPoints.size();
+		std::vector<float>& nextAngle = scratch.nextAngle;
+		nextAngle.resize(count);
+		nextAngle[count - 1] = endPoints[0].angle + 2.f * s_pi;
+		for (size_t i = count - 1; i-- > 0;)
+			nextAngle[i] = endPoints[i + 1].angle > endPoints[i].angle + 1e-6f ? endPoints[i + 1].angle : nextAngle[i + 1];
+
+		glm::vec2 dir = { 1.f, 0.f };
+		std::multiset<int, Closer> open(Closer{ &segments, &position, &dir });
+		scratch.activeIt.assign(segments.size(), open.end());
+		scratch.active.assign(segments.size(), 0);
+
+		auto emitWedge = [&](float angle0, float angle1, int segment)
+		{
+			const Segment& s = segments[segment];
+			glm::vec2 d0 = { std::cos(angle0), std::sin(angle0) };
+			glm::vec2 d1 = { std::cos(angle1), std::sin(angle1) };
+			polygon.push_back(position + d0 * RayDistance(position, d0, s.begin, s.end));
+			polygon.push_back(position + d1 * RayDistance(position, d1, s.begin, s.end));
+		};
+
+		polygon.push_back(position);
+
+		// two passes: the first one only opens the segments crossing the -pi / pi cut
+		float wedgeStart = 0.f;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				const EndPoint& point = endPoints[i];
+				int before = open.empty() ? -1 : *open.begin();
+
+				if (point.begin)
+				{
+					if (!scratch.active[point.segment])
+					{
+						float mid = 0.5f * (point.angle + nextAngle[i]);
+						dir = { std::cos(mid), std::sin(mid) };
+						scratch.activeIt[point.segment] = open.insert(point.segment);
+						scratch.active[point.segment] = 1;
+					}
+				}
+				else if (scratch.active[point.segment])
+				{
+					open.erase(scratch.activeIt[point.segment]);
+					scratch.active[point.segment] = 0;
+				}
+
+				int after = open.empty() ? -1 : *open.begin();
+				if (before != after)
+				{
+					if (pass == 1 && before >= 0)
+						emitWedge(wedgeStart, point.angle, before);
+					wedgeStart = point.angle;
+				}
+			}
+		}
+
+		// close the fan
+		if (polygon.size() > 1)
+			polygon.push_back(polygon[1]);
+	}
+
+
+	void VisibilityLights::Render(const LittleEngine::Graphics::Camera& camera, LittleEngine::Graphics::RenderTarget& target)
+	{
+		if (!m_initialized || !m_shader)
+			return;
+
+		// all fans in one buffer
+		m_upload.clear();
+		for (const std::vector<glm::vec2>& polygon : m_polygons)
+			m_upload.insert(m_upload.end(), polygon.begin(), polygon.end());
+		m_fanVertices = static_cast<int>(m_upload.size());
+
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+
+		glm::ivec2 size = target.GetSize();
+		target.Bind();
+		glViewport(0, 0, size.x, size.y);
+		GLfloat clearColor[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+		glClearColor(0.f, 0.f, 0.f, 1.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+		if (!m_upload.empty())
+		{
+			glBindVertexArray(m_vao);
+			glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+			// orphan the buffer so the driver does not wait on the previous frame
+			size_t bytes = m_upload.size() * sizeof(glm::vec2);
+			m_vboCapacity = std::max(m_vboCapacity, bytes);
+			glBufferData(GL_ARRAY_BUFFER, m_vboCapacity, nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_upload.data());
+
+			m_shader->Use();
+			m_shader->SetMat4("view", camera.GetViewMatrix());
+			m_shader->SetMat4("projection", camera.GetProjectionMatrix());
+
+			// lights add up
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE, GL_ONE);
+
+			GLint first = 0;
+			for (size_t i = 0; i < m_polygons.size(); i++)
+			{
+				GLsizei count = static_cast<GLsizei>(m_polygons[i].size());
+				if (count >= 3 && m_intensities[i] > 0.f)
+				{
+					m_shader->SetVec2("uLightPos", m_polygons[i][0]);
+					m_shader->SetVec3("uLightColor", m_colors[i]);
+					m_shader->SetFloat("uLightRadius", m_radii[i]);
+					m_shader->SetFloat("uLightIntensity", m_intensities[i]);
+					glDrawArrays(GL_TRIANGLE_FAN, first, count);
+				}
+				first += count;
+			}
+
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		target.Unbind();
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+
+	bool VisibilityLights::IsVisible(LightHandle light, glm::vec2 point) const
+	{
+		if (!m_store)
+			return false;
+
+		// the dense index may have moved since Compute
+		int index = m_store->GetLightIndex(light);
+		if (index < 0 || index >= static_cast<int>(m_handles.size()) || m_handles[index] != light)
+		{
+			auto it = std::find(m_handles.begin(), m_handles.end(), light);
+			if (it == m_handles.end())
+				return false;
+			index = static_cast<int>(it - m_handles.begin());
+		}
+
+		const std::vector<glm::vec2>& polygon = m_polygons[index];
+		if (polygon.size() < 4 || glm::length(point - polygon[0]) > m_radii[index])
+			return false;
+
+		// crossing number over the closed ring
+		bool inside = false;
+		for (size_t i = 1; i + 1 < polygon.size(); i++)
+		{
+			glm::vec2 a = polygon[i];
+			glm::vec2 b = polygon[i + 1];
+			if ((a.y > point.y) != (b.y > point.y))
+			{
+				float x = a.x + (point.y - a.y) / (b.y - a.y) * (b.x - a.x);
+				if (point.x < x)
+					inside = !inside;
+			}
+		}
+		return inside;
+	}
+
+	bool VisibilityLights::HasLineOfSight(glm::vec2 from, glm::vec2 to) const
+	{
+		glm::vec4 bounds = { std::min(from.x, to.x), std::min(from.y, to.y), std::max(from.x, to.x), std::max(from.y, to.y) };
+
+		for (size_t e = 0; e < m_edges.size(); e++)
+		{
+			const glm::vec4& edgeBounds = m_edgeBounds[e];
+			if (edgeBounds.x > bounds.z || edgeBounds.z < bounds.x || edgeBounds.y > bounds.w || edgeBounds.w < bounds.y)
+				continue;
+			if (SegmentsCross(from, to, m_edges[e].a, m_edges[e].b))
+				return false;
+		}
+		return true;
+	}
+
+}